@@ -149,6 +149,12 @@ pub fn build(b: *std.Build) void {
         .optimize = .ReleaseFast, // Always use ReleaseFast for benchmarks
     });
 
+    // `-Dmeta-sweep` builds the metadata layout sweep (`zig build benchmark -Dmeta-sweep -- meta`).
+    // Off by default: it instantiates the whole suite once per layout, which is slow to compile.
+    const bench_options = b.addOptions();
+    bench_options.addOption(bool, "meta_sweep", b.option(bool, "meta-sweep", "Build the metadata layout sweep into the benchmark") orelse false);
+    bench_mod.addOptions("bench_options", bench_options);
+
     // C++ compilation flags
     const cpp_flags = &[_][]const u8{
         "-std=c++17",
@@ -275,6 +281,10 @@ pub fn build(b: *std.Build) void {
 
     const bench_run = b.addRunArtifact(bench_exe);
     bench_run.step.dependOn(b.getInstallStep());
+    // Select sections, e.g. `zig build benchmark -- features`
+    if (b.args) |args| {
+        bench_run.addArgs(args);
+    }
     const bench_step = b.step("benchmark", "Run performance benchmarks (ReleaseFast)");
     bench_step.dependOn(&bench_run.step);
 
@@ -4,7 +4,11 @@
 //! Run with: zig build benchmark
 
 const std = @import("std");
-const HashMap = @import("root.zig").HashMap;
+const builtin = @import("builtin");
+const verztable = @import("root.zig");
+const bench_options = @import("bench_options");
+const HashMap = verztable.HashMap;
+const HashMapWithOptions = verztable.HashMapWithOptions;
 const Timer = std.time.Timer;
 
 const cpp = @cImport({
@@ -22,6 +26,8 @@ const SIZE_1K: usize = 1_000; // Used for memory benchmarks
 const SIZE_3K: usize = 3_000;
 const SIZE_100K: usize = 100_000;
 const SIZE_1M: usize = 1_000_000;
+const SIZE_10M: usize = 10_000_000; // Huge-page and snapshot benchmarks only
+const SIZE_100M: usize = 100_000_000;
 
 // ============================================================================
 // Value Types
@@ -48,11 +54,49 @@ const Value64 = extern struct {
     }
 };
 
+// Feature benchmarks only: the value sizes of whole-map analytics passes
+const Value256 = extern struct {
+    data: [256]u8 = .{0} ** 256,
+    fn fromU64(v: u64) Value256 {
+        var r: Value256 = .{};
+        const bytes: [8]u8 = @bitCast(v);
+        inline for (0..32) |j| {
+            inline for (0..8) |i| r.data[j * 8 + i] = bytes[i];
+        }
+        return r;
+    }
+};
+
 fn makeValue(comptime V: type, i: u64) V {
     if (V == void) return {};
     return V.fromU64(i);
 }
 
+// ============================================================================
+// Composite Key Type (feature benchmarks only)
+// ============================================================================
+
+/// Multi-field key whose hash runs wyhash over all 24 bytes, standing in for the
+/// composite/custom key types where caching the hash matters.
+const CompositeKey = extern struct {
+    tenant: u64,
+    id: u64,
+    region: u32,
+    kind: u32,
+
+    fn fromU64(v: u64) CompositeKey {
+        return .{ .tenant = v, .id = v *% 0x9e3779b97f4a7c15, .region = @truncate(v >> 7), .kind = @truncate(v >> 41) };
+    }
+
+    fn hash(k: CompositeKey) u64 {
+        return std.hash.Wyhash.hash(0, std.mem.asBytes(&k));
+    }
+
+    fn eql(a: CompositeKey, b: CompositeKey) bool {
+        return a.tenant == b.tenant and a.id == b.id and a.region == b.region and a.kind == b.kind;
+    }
+};
+
 // ============================================================================
 // C++ Hash Table Wrappers (Abseil, Boost, Ankerl)
 // ============================================================================
@@ -205,7 +249,11 @@ fn Benchmarks(comptime K: type, comptime V: type) type {
         }
 
         fn benchThis(comptime Op: BenchOp, comptime size: usize, keys: []const K, extra: anytype, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
-            const Map = HashMap(K, V);
+            return benchMap(HashMap(K, V), Op, size, keys, extra, alloc);
+        }
+
+        /// `benchThis` against any verztable type over `K`/`V`, e.g. a `HashMapWithOptions` variant.
+        fn benchMap(comptime Map: type, comptime Op: BenchOp, comptime size: usize, keys: []const K, extra: anytype, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
             var times: [BENCHMARK_ITERATIONS]u64 = undefined;
 
             for (0..BENCHMARK_ITERATIONS) |iter_idx| {
@@ -470,6 +518,91 @@ fn Benchmarks(comptime K: type, comptime V: type) type {
             return times;
         }
 
+        /// Random lookups through `getManyBatched`/`containsManyBatched` with `batch_size`
+        /// keys in flight. Keys are gathered into lookup order before the timer starts.
+        fn benchLookupBatch(comptime batch_size: usize, comptime size: usize, keys: []const K, order: []const usize, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+            const Map = HashMap(K, V);
+            var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+
+            const probe_keys = try alloc.alloc(K, size);
+            defer alloc.free(probe_keys);
+            for (probe_keys, order[0..size]) |*p, idx| p.* = keys[idx];
+
+            const out = try alloc.alloc(if (is_set) bool else ?V, size);
+            defer alloc.free(out);
+
+            for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+                var map = Map.init(alloc);
+                defer map.deinit();
+                for (keys[0..size]) |k| {
+                    if (is_set) try map.add(k) else try map.put(k, makeValue(V, keyToU64(k)));
+                }
+
+                var timer = try Timer.start();
+                const found = if (is_set)
+                    map.containsManyBatched(batch_size, probe_keys, out)
+                else
+                    map.getManyBatched(batch_size, probe_keys, out);
+                std.mem.doNotOptimizeAway(found);
+                times[iter_idx] = timer.read();
+            }
+            return times;
+        }
+
+        /// `.insert_reserved` through the AssumeCapacity inserts: same setup, no growth path.
+        fn benchInsertAssumeCapacity(comptime size: usize, keys: []const K, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+            const Map = HashMap(K, V);
+            var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+
+            for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+                var map = Map.init(alloc);
+                defer map.deinit();
+                try map.ensureTotalCapacity(size);
+
+                var timer = try Timer.start();
+                for (keys[0..size]) |k| {
+                    if (is_set) map.addAssumeCapacity(k) else map.putAssumeCapacity(k, makeValue(V, keyToU64(k)));
+                }
+                times[iter_idx] = timer.read();
+                std.mem.doNotOptimizeAway(map.count());
+            }
+            return times;
+        }
+
+        /// Time one doubling of a table holding `size` keys.
+        /// `rebuild == false` measures `reserve` (the table's own rehash); `rebuild == true`
+        /// measures building the same doubled table by re-`put`ting every key, which re-hashes
+        /// each key the way rehash did before it reused cached hashes.
+        fn benchGrowth(comptime rebuild: bool, comptime size: usize, keys: []const K, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+            const Map = HashMap(K, V);
+            var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+
+            for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+                var map = Map.init(alloc);
+                defer map.deinit();
+                for (keys[0..size]) |k| {
+                    if (is_set) try map.add(k) else try map.put(k, makeValue(V, keyToU64(k)));
+                }
+                const doubled = map.capacity() + 1;
+
+                var timer = try Timer.start();
+                if (rebuild) {
+                    var grown = Map.init(alloc);
+                    defer grown.deinit();
+                    try grown.reserve(doubled);
+                    var it = map.iterator();
+                    while (it.next()) |bucket| {
+                        if (is_set) try grown.add(bucket.key) else try grown.put(bucket.key, bucket.val);
+                    }
+                    times[iter_idx] = timer.read();
+                } else {
+                    try map.reserve(doubled);
+                    times[iter_idx] = timer.read();
+                }
+            }
+            return times;
+        }
+
         fn benchStd(comptime Op: BenchOp, comptime size: usize, keys: []const K, extra: anytype, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
             const StdMap = if (is_string) std.StringHashMap(V) else std.AutoHashMap(K, V);
             var times: [BENCHMARK_ITERATIONS]u64 = undefined;
@@ -1033,6 +1166,8 @@ fn formatSize(size: usize) []const u8 {
         3_000 => "3K",
         100_000 => "100K",
         1_000_000 => "1M",
+        10_000_000 => "10M",
+        100_000_000 => "100M",
         else => "?",
     };
 }
@@ -1042,7 +1177,7 @@ fn keyTypeName(comptime K: type) []const u8 {
 }
 
 fn valueTypeName(comptime V: type) []const u8 {
-    return if (V == void) "void (set)" else if (V == Value4) "4B" else if (V == Value64) "64B" else "?";
+    return if (V == void) "void (set)" else if (V == Value4) "4B" else if (V == Value64) "64B" else if (V == Value256) "256B" else "?";
 }
 
 const Xoshiro = std.Random.Xoshiro256;
@@ -1136,6 +1271,52 @@ fn generateZipfianIndices(comptime size: usize, allocator: std.mem.Allocator) ![
     return indices;
 }
 
+/// Op sequences of the mixed workloads for one size, shared by every table being compared.
+fn Workloads(comptime K: type) type {
+    return struct {
+        const Self = @This();
+
+        mixed: MixedOpsData(K),
+        read_heavy: MixedOpsData(K),
+        write_heavy: MixedOpsData(K),
+        update_heavy: MixedOpsData(K),
+        // Same ops as mixed but with skewed indices
+        zipfian: MixedOpsData(K),
+
+        fn init(comptime size: usize, keys: []const K, miss_keys: []const K, allocator: std.mem.Allocator) !Self {
+            const mixed_gen = try generateMixedOps(size, allocator);
+            errdefer allocator.free(mixed_gen.ops);
+            errdefer allocator.free(mixed_gen.indices);
+            const read_heavy_gen = try generateReadHeavyOps(size, allocator);
+            errdefer allocator.free(read_heavy_gen.ops);
+            errdefer allocator.free(read_heavy_gen.indices);
+            const write_heavy_gen = try generateWriteHeavyOps(size, allocator);
+            errdefer allocator.free(write_heavy_gen.ops);
+            errdefer allocator.free(write_heavy_gen.indices);
+            const update_heavy_gen = try generateUpdateHeavyOps(size, allocator);
+            errdefer allocator.free(update_heavy_gen.ops);
+            errdefer allocator.free(update_heavy_gen.indices);
+            const zipfian_indices = try generateZipfianIndices(size, allocator);
+
+            return .{
+                .mixed = .{ .ops = mixed_gen.ops, .indices = mixed_gen.indices, .hit_keys = keys, .miss_keys = miss_keys },
+                .read_heavy = .{ .ops = read_heavy_gen.ops, .indices = read_heavy_gen.indices, .hit_keys = keys, .miss_keys = miss_keys },
+                .write_heavy = .{ .ops = write_heavy_gen.ops, .indices = write_heavy_gen.indices, .hit_keys = keys, .miss_keys = miss_keys },
+                .update_heavy = .{ .ops = update_heavy_gen.ops, .indices = update_heavy_gen.indices, .hit_keys = keys, .miss_keys = miss_keys },
+                .zipfian = .{ .ops = mixed_gen.ops, .indices = zipfian_indices, .hit_keys = keys, .miss_keys = miss_keys },
+            };
+        }
+
+        fn deinit(self: Self, allocator: std.mem.Allocator) void {
+            inline for (.{ self.mixed, self.read_heavy, self.write_heavy, self.update_heavy }) |data| {
+                allocator.free(data.ops);
+                allocator.free(data.indices);
+            }
+            allocator.free(self.zipfian.indices);
+        }
+    };
+}
+
 // ============================================================================
 // Benchmark Runner
 // ============================================================================
@@ -1151,31 +1332,13 @@ fn runComparison(
 ) !void {
     const B = Benchmarks(K, V);
 
-    const mixed_gen = try generateMixedOps(size, allocator);
-    defer allocator.free(mixed_gen.ops);
-    defer allocator.free(mixed_gen.indices);
-    const mixed_data = MixedOpsData(K){ .ops = mixed_gen.ops, .indices = mixed_gen.indices, .hit_keys = keys, .miss_keys = miss_keys };
-
-    // Generate data for new workloads
-    const read_heavy_gen = try generateReadHeavyOps(size, allocator);
-    defer allocator.free(read_heavy_gen.ops);
-    defer allocator.free(read_heavy_gen.indices);
-    const read_heavy_data = MixedOpsData(K){ .ops = read_heavy_gen.ops, .indices = read_heavy_gen.indices, .hit_keys = keys, .miss_keys = miss_keys };
-
-    const write_heavy_gen = try generateWriteHeavyOps(size, allocator);
-    defer allocator.free(write_heavy_gen.ops);
-    defer allocator.free(write_heavy_gen.indices);
-    const write_heavy_data = MixedOpsData(K){ .ops = write_heavy_gen.ops, .indices = write_heavy_gen.indices, .hit_keys = keys, .miss_keys = miss_keys };
-
-    const update_heavy_gen = try generateUpdateHeavyOps(size, allocator);
-    defer allocator.free(update_heavy_gen.ops);
-    defer allocator.free(update_heavy_gen.indices);
-    const update_heavy_data = MixedOpsData(K){ .ops = update_heavy_gen.ops, .indices = update_heavy_gen.indices, .hit_keys = keys, .miss_keys = miss_keys };
-
-    // Zipfian: use same ops as mixed but with skewed indices
-    const zipfian_indices = try generateZipfianIndices(size, allocator);
-    defer allocator.free(zipfian_indices);
-    const zipfian_data = MixedOpsData(K){ .ops = mixed_gen.ops, .indices = zipfian_indices, .hit_keys = keys, .miss_keys = miss_keys };
+    const workloads = try Workloads(K).init(size, keys, miss_keys, allocator);
+    defer workloads.deinit(allocator);
+    const mixed_data = workloads.mixed;
+    const read_heavy_data = workloads.read_heavy;
+    const write_heavy_data = workloads.write_heavy;
+    const update_heavy_data = workloads.update_heavy;
+    const zipfian_data = workloads.zipfian;
 
     std.debug.print("\n  {s} elements:\n", .{comptime formatSize(size)});
     std.debug.print("  ┌────────────────┬──────────┬──────────┬──────────┬──────────┬──────────┐\n", .{});
@@ -1305,7 +1468,7 @@ fn runMemoryBenchmark(comptime K: type, comptime V: type, comptime size: usize,
         // Approximate memory: bucket_count * (bucket_size + metadata)
         const bucket_count = map.bucketCount();
         const bucket_size = @sizeOf(Map.Bucket);
-        const meta_size = @sizeOf(u16);
+        const meta_size = @sizeOf(Map.MetaType);
         ours_mem = bucket_count * (bucket_size + meta_size);
         if (is_string) {
             // Add string storage (keys are slices pointing to external storage, not counted)
@@ -1590,6 +1753,1394 @@ fn runBenchmarks(allocator: std.mem.Allocator) !void {
     }
 }
 
+// ============================================================================
+// Feature Benchmarks (verztable-only APIs, no C++ counterpart)
+// ============================================================================
+
+fn perOpStats(times: [BENCHMARK_ITERATIONS]u64, divisor: usize) BenchStats {
+    var per: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (times, &per) |t, *p| p.* = t / divisor;
+    return BenchStats.compute(&per);
+}
+
+fn printFeatureHeader(title: []const u8, baseline: []const u8, variant: []const u8) void {
+    std.debug.print("\n  {s}:\n", .{title});
+    std.debug.print("  ┌────────────────┬──────────┬──────────┬─────────┐\n", .{});
+    std.debug.print("  │ Operation      │ {s:<8} │ {s:<8} │ Speedup │\n", .{ baseline, variant });
+    std.debug.print("  ├────────────────┼──────────┼──────────┼─────────┤\n", .{});
+}
+
+fn printFeatureRow(name: []const u8, baseline: BenchStats, variant: BenchStats) void {
+    const speedup = @as(f64, @floatFromInt(baseline.mean)) / @as(f64, @floatFromInt(@max(variant.mean, 1)));
+    std.debug.print("  │ {s:<14} │", .{name});
+    printTime(baseline.mean);
+    std.debug.print(" │", .{});
+    printTime(variant.mean);
+    std.debug.print(" │ {d:>6.2}x │\n", .{speedup});
+}
+
+fn printFeatureFooter() void {
+    std.debug.print("  └────────────────┴──────────┴──────────┴─────────┘\n", .{});
+}
+
+fn runBatchLookupBenchmark(comptime K: type, comptime V: type, comptime size: usize, keys: []const K, order: []const usize, allocator: std.mem.Allocator) !void {
+    const B = Benchmarks(K, V);
+    const title = comptime std.fmt.comptimePrint("Batched lookup, {s} key → {s}, {s} elements", .{ keyTypeName(K), valueTypeName(V), formatSize(size) });
+
+    printFeatureHeader(title, "get()", "getMany");
+    const baseline = perOpStats(try B.benchThis(.lookup, size, keys, order, allocator), size);
+    inline for (.{ 8, 16, 32 }) |batch_size| {
+        const batched = perOpStats(try B.benchLookupBatch(batch_size, size, keys, order, allocator), size);
+        printFeatureRow(comptime std.fmt.comptimePrint("Batch of {d}", .{batch_size}), baseline, batched);
+    }
+    printFeatureFooter();
+}
+
+fn runAssumeCapacityBenchmark(comptime K: type, comptime V: type, comptime size: usize, keys: []const K, allocator: std.mem.Allocator) !void {
+    const B = Benchmarks(K, V);
+    const title = comptime std.fmt.comptimePrint("Reserved insert, {s} key → {s}, {s} elements", .{ keyTypeName(K), valueTypeName(V), formatSize(size) });
+
+    printFeatureHeader(title, "put()", "assume");
+    printFeatureRow(
+        "Per key",
+        perOpStats(try B.benchThis(.insert_reserved, size, keys, {}, allocator), size),
+        perOpStats(try B.benchInsertAssumeCapacity(size, keys, allocator), size),
+    );
+    printFeatureFooter();
+}
+
+/// `fromSlices` on a pool of `threads - 1` workers plus the calling thread.
+fn benchFromSlices(comptime Map: type, keys: anytype, values: anytype, threads: usize, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    var pool: std.Thread.Pool = undefined;
+    try pool.init(.{ .allocator = alloc, .n_jobs = threads - 1 });
+    defer pool.deinit();
+
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var timer = try Timer.start();
+        var map = try Map.fromSlices(alloc, &pool, keys, values);
+        times[iter_idx] = timer.read();
+        std.mem.doNotOptimizeAway(map.count());
+        map.deinit();
+    }
+    return times;
+}
+
+fn runParallelBuildBenchmark(comptime K: type, comptime V: type, keys: []const K, allocator: std.mem.Allocator) !void {
+    const Map = HashMap(K, V);
+    const title = comptime std.fmt.comptimePrint("Bulk build, {s} key → {s}, {s} elements", .{ keyTypeName(K), valueTypeName(V), formatSize(SIZE_1M) });
+
+    const values = try allocator.alloc(V, keys.len);
+    defer allocator.free(values);
+    for (values, 0..) |*v, i| v.* = makeValue(V, i);
+
+    const cpus = std.Thread.getCpuCount() catch 1;
+    printFeatureHeader(title, "put()", "parallel");
+    const baseline = perOpStats(try benchMapFill(Map, V, keys, allocator), keys.len);
+    inline for (.{ 1, 2, 4, 8, 16 }) |threads| {
+        if (threads <= cpus) {
+            const built = perOpStats(try benchFromSlices(Map, keys, values, threads, allocator), keys.len);
+            printFeatureRow(comptime std.fmt.comptimePrint("{d} thread{s}", .{ threads, if (threads == 1) "" else "s" }), baseline, built);
+        }
+    }
+    printFeatureFooter();
+}
+
+/// One doubling of a table built from `keys`, rehashed on a pool of `threads - 1` workers plus
+/// the calling thread.
+fn benchParallelRehash(comptime Map: type, comptime V: type, keys: anytype, threads: usize, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    var pool: std.Thread.Pool = undefined;
+    try pool.init(.{ .allocator = alloc, .n_jobs = threads - 1 });
+    defer pool.deinit();
+
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var map = Map.init(alloc);
+        defer map.deinit();
+        try fillMap(V, &map, keys);
+        map.setRehashPool(&pool);
+        const doubled = map.capacity() + 1;
+
+        var timer = try Timer.start();
+        try map.reserve(doubled);
+        times[iter_idx] = timer.read();
+    }
+    return times;
+}
+
+fn runParallelRehashBenchmark(comptime K: type, comptime V: type, keys: []const K, allocator: std.mem.Allocator) !void {
+    const Map = HashMapWithOptions(K, V, verztable.autoHash(K), verztable.autoEql(K), .{ .parallel_rehash = true });
+    const title = comptime std.fmt.comptimePrint("Parallel rehash (one doubling), {s} key → {s}, {s} elements", .{ keyTypeName(K), valueTypeName(V), formatSize(SIZE_1M) });
+
+    const cpus = std.Thread.getCpuCount() catch 1;
+    printFeatureHeader(title, "rehash", "parallel");
+    const baseline = perOpStats(try benchMapGrowth(Map, V, keys, allocator), keys.len);
+    inline for (.{ 1, 2, 4, 8, 16 }) |threads| {
+        if (threads <= cpus) {
+            const rehashed = perOpStats(try benchParallelRehash(Map, V, keys, threads, allocator), keys.len);
+            printFeatureRow(comptime std.fmt.comptimePrint("{d} thread{s}", .{ threads, if (threads == 1) "" else "s" }), baseline, rehashed);
+        }
+    }
+    printFeatureFooter();
+}
+
+/// A `parallelReduce` summing the first byte of every value, on a pool of `threads - 1` workers
+/// plus the calling thread (the same checksum as `benchMapScan` over values).
+fn benchParallelReduce(comptime Map: type, comptime V: type, keys: []const u64, threads: usize, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    var pool: std.Thread.Pool = undefined;
+    try pool.init(.{ .allocator = alloc, .n_jobs = threads - 1 });
+    defer pool.deinit();
+
+    const Checksum = struct {
+        fn accumulate(_: void, acc: u64, _: *const u64, value: *const V) u64 {
+            return acc +% value.data[0];
+        }
+        fn combine(_: void, a: u64, b: u64) u64 {
+            return a +% b;
+        }
+    };
+
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var map = Map.init(alloc);
+        defer map.deinit();
+        try fillMap(V, &map, keys);
+
+        var timer = try Timer.start();
+        const checksum = try map.parallelReduce(&pool, u64, 0, {}, Checksum.accumulate, Checksum.combine);
+        std.mem.doNotOptimizeAway(checksum);
+        times[iter_idx] = timer.read();
+    }
+    return times;
+}
+
+fn runParallelScanBenchmark(comptime V: type, keys: []const u64, allocator: std.mem.Allocator) !void {
+    const Map = HashMap(u64, V);
+    const title = comptime std.fmt.comptimePrint("Full scan (value checksum), u64 key → {s}, {s} elements", .{ valueTypeName(V), formatSize(SIZE_1M) });
+
+    const cpus = std.Thread.getCpuCount() catch 1;
+    printFeatureHeader(title, "iterator", "parallel");
+    const baseline = perOpStats(try benchMapScan(Map, V, true, keys, allocator), keys.len);
+    inline for (.{ 1, 2, 4, 8, 16 }) |threads| {
+        if (threads <= cpus) {
+            const reduced = perOpStats(try benchParallelReduce(Map, V, keys, threads, allocator), keys.len);
+            printFeatureRow(comptime std.fmt.comptimePrint("{d} thread{s}", .{ threads, if (threads == 1) "" else "s" }), baseline, reduced);
+        }
+    }
+    printFeatureFooter();
+}
+
+/// Full iteration of a u64 map that keeps one key in `keep_every` after removing the rest,
+/// with `next()` or with `nextBatch` into a 64-entry buffer.
+fn benchIterBatch(comptime V: type, comptime batch: bool, keep_every: usize, keys: []const u64, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    const Map = HashMap(u64, V);
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var map = Map.init(alloc);
+        defer map.deinit();
+        try fillMap(V, &map, keys);
+        for (keys, 0..) |k, i| {
+            if (i % keep_every != 0) _ = map.remove(k);
+        }
+
+        var timer = try Timer.start();
+        var checksum: u64 = 0;
+        var it = map.iterator();
+        if (batch) {
+            var buf: [64]*const Map.Bucket = undefined;
+            while (true) {
+                const buckets = it.nextBatch(&buf);
+                for (buckets) |bucket| checksum +%= bucket.key +% bucket.val.data[0];
+                if (buckets.len < buf.len) break;
+            }
+        } else {
+            while (it.next()) |bucket| checksum +%= bucket.key +% bucket.val.data[0];
+        }
+        std.mem.doNotOptimizeAway(checksum);
+        times[iter_idx] = timer.read();
+    }
+    return times;
+}
+
+fn runIterBatchBenchmark(comptime V: type, keys: []const u64, allocator: std.mem.Allocator) !void {
+    const title = comptime std.fmt.comptimePrint("Batch iteration, u64 key → {s}, {s} inserted", .{ valueTypeName(V), formatSize(SIZE_1M) });
+
+    printFeatureHeader(title, "next()", "batch");
+    inline for (.{ 1, 8, 64 }) |keep_every| {
+        const live = (keys.len + keep_every - 1) / keep_every;
+        printFeatureRow(
+            comptime std.fmt.comptimePrint("1/{d} live", .{keep_every}),
+            perOpStats(try benchIterBatch(V, false, keep_every, keys, allocator), live),
+            perOpStats(try benchIterBatch(V, true, keep_every, keys, allocator), live),
+        );
+    }
+    printFeatureFooter();
+}
+
+/// Remove the 30% of `keys` whose value ends in 0-2 (mod 10): either collect the keys with an
+/// iterator and `remove` each, or a single `removeIf` pass.
+fn benchSweep(comptime K: type, comptime V: type, comptime single_pass: bool, keys: []const K, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    const Map = HashMap(K, V);
+    const Expired = struct {
+        fn check(_: void, _: *const K, value: *V) bool {
+            return value.data[0] % 10 < 3;
+        }
+    };
+
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var map = Map.init(alloc);
+        defer map.deinit();
+        try fillMap(V, &map, keys);
+        var expired: std.ArrayList(K) = .empty;
+        defer expired.deinit(alloc);
+        try expired.ensureTotalCapacity(alloc, keys.len);
+
+        var timer = try Timer.start();
+        if (single_pass) {
+            std.mem.doNotOptimizeAway(map.removeIf({}, Expired.check));
+        } else {
+            var it = map.iterator();
+            while (it.nextEntry()) |entry| {
+                if (entry.value_ptr.data[0] % 10 < 3) expired.appendAssumeCapacity(entry.key_ptr.*);
+            }
+            for (expired.items) |k| std.mem.doNotOptimizeAway(map.remove(k));
+        }
+        times[iter_idx] = timer.read();
+    }
+    return times;
+}
+
+fn runSweepBenchmark(comptime K: type, comptime V: type, keys: []const K, allocator: std.mem.Allocator) !void {
+    const title = comptime std.fmt.comptimePrint("Sweep 30%, {s} key → {s}, {s} elements", .{ keyTypeName(K), valueTypeName(V), formatSize(SIZE_1M) });
+
+    printFeatureHeader(title, "remove()", "removeIf");
+    printFeatureRow(
+        "Per key",
+        perOpStats(try benchSweep(K, V, false, keys, allocator), keys.len),
+        perOpStats(try benchSweep(K, V, true, keys, allocator), keys.len),
+    );
+    printFeatureFooter();
+}
+
+/// `cycles` rounds of adding `fill` keys to a set reserved for all of `keys`, then `clear`.
+fn benchClearCycles(comptime Set: type, fill: usize, cycles: usize, keys: []const u64, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var set = Set.init(alloc);
+        defer set.deinit();
+        try set.reserve(keys.len);
+
+        var timer = try Timer.start();
+        for (0..cycles) |cycle| {
+            const start = (cycle * fill) % (keys.len - fill + 1);
+            for (keys[start..][0..fill]) |k| set.addAssumeCapacity(k);
+            set.clear();
+        }
+        times[iter_idx] = timer.read();
+    }
+    return times;
+}
+
+fn runClearBenchmark(keys: []const u64, allocator: std.mem.Allocator) !void {
+    const hashFn = verztable.autoHash(u64);
+    const eqlFn = verztable.autoEql(u64);
+    const Plain = HashMapWithOptions(u64, void, hashFn, eqlFn, .{});
+    const Tracked = HashMapWithOptions(u64, void, hashFn, eqlFn, .{ .track_dirty_pages = true });
+    const title = comptime std.fmt.comptimePrint("Clear + refill, u64 set reserved for {s}", .{formatSize(SIZE_1M)});
+
+    printFeatureHeader(title, "memset", "dirty pg");
+    inline for (.{ .{ 100, 4000 }, .{ 1000, 1000 }, .{ SIZE_100K, 10 }, .{ SIZE_1M, 4 } }) |row| {
+        printFeatureRow(
+            comptime std.fmt.comptimePrint("{s} keys", .{formatSize(row[0])}),
+            perOpStats(try benchClearCycles(Plain, row[0], row[1], keys, allocator), row[1]),
+            perOpStats(try benchClearCycles(Tracked, row[0], row[1], keys, allocator), row[1]),
+        );
+    }
+    printFeatureFooter();
+}
+
+/// `maps` short-lived tables: init, `entries` puts, a get of each key, deinit.
+/// Also the create/fill/destroy cycle of the table pool benchmark.
+fn benchTinyMaps(comptime Map: type, comptime V: type, entries: usize, maps: usize, keys: []const u64, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var timer = try Timer.start();
+        var found: u64 = 0;
+        for (0..maps) |m| {
+            const map_keys = keys[(m * entries) % (keys.len - entries + 1) ..][0..entries];
+            var map = Map.init(alloc);
+            defer map.deinit();
+            for (map_keys, 0..) |k, i| try map.put(k, makeValue(V, i));
+            for (map_keys) |k| {
+                if (map.get(k) != null) found += 1;
+            }
+        }
+        std.mem.doNotOptimizeAway(found);
+        times[iter_idx] = timer.read();
+    }
+    return times;
+}
+
+fn runSmallMapBenchmark(comptime V: type, keys: []const u64, allocator: std.mem.Allocator) !void {
+    const inline_capacity = 16;
+    const maps = 100_000;
+    const title = comptime std.fmt.comptimePrint("Tiny maps (create, fill, get, free), u64 key → {s}, {d} inline", .{ valueTypeName(V), inline_capacity });
+
+    printFeatureHeader(title, "HashMap", "Small");
+    inline for (.{ 4, 8, 16, 32 }) |entries| {
+        printFeatureRow(
+            comptime std.fmt.comptimePrint("{d} entries", .{entries}),
+            perOpStats(try benchTinyMaps(HashMap(u64, V), V, entries, maps, keys, allocator), maps),
+            perOpStats(try benchTinyMaps(verztable.SmallHashMap(u64, V, inline_capacity), V, entries, maps, keys, allocator), maps),
+        );
+    }
+    printFeatureFooter();
+}
+
+fn runTablePoolBenchmark(comptime V: type, keys: []const u64, allocator: std.mem.Allocator) !void {
+    const Map = HashMap(u64, V);
+    const title = comptime std.fmt.comptimePrint("Create/fill/destroy, u64 key → {s}", .{valueTypeName(V)});
+
+    var pool = verztable.TablePool.init(allocator, 64);
+    defer pool.deinit();
+
+    printFeatureHeader(title, "direct", "pooled");
+    inline for (.{ .{ 100, 10_000 }, .{ 1000, 1000 }, .{ SIZE_100K, 10 } }) |row| {
+        printFeatureRow(
+            comptime std.fmt.comptimePrint("{s} keys", .{formatSize(row[0])}),
+            perOpStats(try benchTinyMaps(Map, V, row[0], row[1], keys, allocator), row[1] * row[0]),
+            perOpStats(try benchTinyMaps(Map, V, row[0], row[1], keys, pool.allocator()), row[1] * row[0]),
+        );
+    }
+    printFeatureFooter();
+}
+
+/// Random lookups of present keys in a prefaulted table of `size` keys.
+/// Keys are generated from their index so no key array competes for the TLB.
+fn benchHugeLookups(comptime Map: type, comptime V: type, size: usize, lookups: usize, allocator: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    var map = Map.init(allocator);
+    defer map.deinit();
+    try map.reserve(size);
+    map.prefault();
+    for (0..size) |i| map.putAssumeCapacity(@as(u64, i) *% 0x9E3779B97F4A7C15, makeValue(V, i));
+
+    var rng = makeRng(777);
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var timer = try Timer.start();
+        var found: u64 = 0;
+        for (0..lookups) |_| {
+            const i = rng.random().uintLessThan(u64, size);
+            if (map.get(i *% 0x9E3779B97F4A7C15) != null) found += 1;
+        }
+        std.mem.doNotOptimizeAway(found);
+        times[iter_idx] = timer.read();
+    }
+    return times;
+}
+
+fn runHugePageBenchmark(comptime V: type, allocator: std.mem.Allocator) !void {
+    const hashFn = verztable.autoHash(u64);
+    const eqlFn = verztable.autoEql(u64);
+    const Plain = HashMapWithOptions(u64, V, hashFn, eqlFn, .{});
+    const Huge = HashMapWithOptions(u64, V, hashFn, eqlFn, .{ .huge_pages = true });
+    const title = comptime std.fmt.comptimePrint("Random lookups in large tables, u64 key → {s}", .{valueTypeName(V)});
+    const lookups = SIZE_1M;
+
+    // 100M keys need 2^27 buckets plus metadata; skip that row on small machines
+    const memory = std.process.totalSystemMemory() catch 0;
+
+    printFeatureHeader(title, "4K pages", "huge pg");
+    inline for (.{ SIZE_10M, SIZE_100M }) |size| {
+        if (size < SIZE_100M or memory >= 16 << 30) {
+            printFeatureRow(
+                comptime std.fmt.comptimePrint("{s} keys", .{formatSize(size)}),
+                perOpStats(try benchHugeLookups(Plain, V, size, lookups, allocator), lookups),
+                perOpStats(try benchHugeLookups(Huge, V, size, lookups, allocator), lookups),
+            );
+        }
+    }
+    printFeatureFooter();
+}
+
+/// Loading a table by re-inserting its keys vs. mapping a snapshot written by `writeMapped`,
+/// then random gets in either. The snapshot is in memory, so the mapped side pays no page-ins.
+fn runMappedBenchmark(comptime V: type, keys: []const u64, order: []const usize, allocator: std.mem.Allocator) !void {
+    const Map = HashMap(u64, V);
+    const title = comptime std.fmt.comptimePrint("Load + query, u64 key → {s}, {s} keys", .{ valueTypeName(V), formatSize(SIZE_1M) });
+
+    var map = Map.init(allocator);
+    defer map.deinit();
+    try fillMap(V, &map, keys);
+    var out: std.Io.Writer.Allocating = .init(allocator);
+    defer out.deinit();
+    try map.writeMapped(&out.writer);
+    const snapshot = try allocator.alignedAlloc(u8, .@"64", out.written().len);
+    defer allocator.free(snapshot);
+    @memcpy(snapshot, out.written());
+    const view = try Map.Mapped.fromBytes(snapshot);
+
+    var rebuild_load: [BENCHMARK_ITERATIONS]u64 = undefined;
+    var mapped_load: [BENCHMARK_ITERATIONS]u64 = undefined;
+    var rebuild_get: [BENCHMARK_ITERATIONS]u64 = undefined;
+    var mapped_get: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var timer = try Timer.start();
+        var rebuilt = Map.init(allocator);
+        try fillMap(V, &rebuilt, keys);
+        rebuild_load[iter_idx] = timer.read();
+        std.mem.doNotOptimizeAway(rebuilt.count());
+        rebuilt.deinit();
+
+        timer.reset();
+        const loaded = try Map.Mapped.fromBytes(snapshot);
+        mapped_load[iter_idx] = timer.read();
+        std.mem.doNotOptimizeAway(loaded.count());
+
+        var found: usize = 0;
+        timer.reset();
+        for (order) |i| {
+            if (map.get(keys[i]) != null) found += 1;
+        }
+        rebuild_get[iter_idx] = timer.read();
+        timer.reset();
+        for (order) |i| {
+            if (view.get(keys[i]) != null) found += 1;
+        }
+        mapped_get[iter_idx] = timer.read();
+        std.mem.doNotOptimizeAway(found);
+    }
+
+    printFeatureHeader(title, "rebuild", "mapped");
+    printFeatureRow("Load (per key)", perOpStats(rebuild_load, keys.len), perOpStats(mapped_load, keys.len));
+    printFeatureRow("Random get", perOpStats(rebuild_get, order.len), perOpStats(mapped_get, order.len));
+    printFeatureFooter();
+}
+
+/// Rebuilding a table of `size` keys with `put` vs. `readFrom` of a snapshot in memory,
+/// so the row measures the load itself rather than the disk.
+fn runSnapshotBenchmark(comptime V: type, allocator: std.mem.Allocator) !void {
+    const Map = HashMap(u64, V);
+    const title = comptime std.fmt.comptimePrint("Load a snapshot, u64 key → {s}", .{valueTypeName(V)});
+
+    printFeatureHeader(title, "put", "readFrom");
+    inline for (.{ SIZE_1M, SIZE_10M }) |size| {
+        var map = Map.init(allocator);
+        defer map.deinit();
+        for (0..size) |i| try map.put(@as(u64, i) *% 0x9E3779B97F4A7C15, makeValue(V, i));
+        var out: std.Io.Writer.Allocating = .init(allocator);
+        defer out.deinit();
+        try map.writeTo(&out.writer);
+
+        var rebuild: [BENCHMARK_ITERATIONS]u64 = undefined;
+        var load: [BENCHMARK_ITERATIONS]u64 = undefined;
+        for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+            var timer = try Timer.start();
+            var rebuilt = Map.init(allocator);
+            for (0..size) |i| try rebuilt.put(@as(u64, i) *% 0x9E3779B97F4A7C15, makeValue(V, i));
+            rebuild[iter_idx] = timer.read();
+            std.mem.doNotOptimizeAway(rebuilt.count());
+            rebuilt.deinit();
+
+            timer.reset();
+            var reader: std.Io.Reader = .fixed(out.written());
+            var loaded = try Map.readFrom(allocator, &reader);
+            load[iter_idx] = timer.read();
+            std.mem.doNotOptimizeAway(loaded.map.count());
+            loaded.deinit();
+        }
+        printFeatureRow(
+            comptime std.fmt.comptimePrint("{s} keys", .{formatSize(size)}),
+            perOpStats(rebuild, size),
+            perOpStats(load, size),
+        );
+    }
+    printFeatureFooter();
+}
+
+/// Applying a journal of `keys.len` puts with one `put` per change vs. `replay`, into an empty
+/// table and as updates of a table that already holds every key.
+fn runJournalBenchmark(comptime V: type, keys: []const u64, allocator: std.mem.Allocator) !void {
+    const Map = HashMapWithOptions(u64, V, verztable.autoHash(u64), verztable.autoEql(u64), .{ .journal = true });
+    const title = comptime std.fmt.comptimePrint("Apply {s} changes, u64 key → {s}", .{ formatSize(SIZE_1M), valueTypeName(V) });
+
+    var journal = verztable.Journal.init(allocator);
+    defer journal.deinit();
+    {
+        var primary = Map.init(allocator);
+        defer primary.deinit();
+        primary.setJournal(&journal);
+        try fillMap(V, &primary, keys);
+    }
+
+    printFeatureHeader(title, "per-op", "replay");
+    inline for (.{ .{ "Into empty", false }, .{ "Updates", true } }) |row| {
+        var per_op: [BENCHMARK_ITERATIONS]u64 = undefined;
+        var replayed: [BENCHMARK_ITERATIONS]u64 = undefined;
+        for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+            var replica = Map.init(allocator);
+            defer replica.deinit();
+            if (row[1]) try fillMap(V, &replica, keys);
+            var timer = try Timer.start();
+            try fillMap(V, &replica, keys);
+            per_op[iter_idx] = timer.read();
+
+            var target = Map.init(allocator);
+            defer target.deinit();
+            if (row[1]) try fillMap(V, &target, keys);
+            timer.reset();
+            std.mem.doNotOptimizeAway(try target.replay(journal.bytes.items));
+            replayed[iter_idx] = timer.read();
+        }
+        printFeatureRow(row[0], perOpStats(per_op, keys.len), perOpStats(replayed, keys.len));
+    }
+    printFeatureFooter();
+}
+
+/// Random gets in a private table vs. through a seqlocked reader of the same keys in a
+/// shared memory region (the read side of a table shared across processes).
+fn runSharedBenchmark(comptime V: type, keys: []const u64, order: []const usize, allocator: std.mem.Allocator) !void {
+    if (builtin.os.tag != .linux) return;
+    const Map = HashMap(u64, V);
+    const title = comptime std.fmt.comptimePrint("Lookups, u64 key → {s}, {s} keys", .{ valueTypeName(V), formatSize(SIZE_1M) });
+
+    var map = Map.init(allocator);
+    defer map.deinit();
+    try fillMap(V, &map, keys);
+
+    const fd = try std.posix.memfd_create("verztable-bench", 0);
+    defer std.posix.close(fd);
+    var writer = try Map.Shared.create(fd, keys.len);
+    defer writer.close();
+    for (keys, 0..) |k, i| try writer.put(k, makeValue(V, i));
+    var reader = try Map.Shared.open(fd);
+    defer reader.close();
+
+    var private: [BENCHMARK_ITERATIONS]u64 = undefined;
+    var shared: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var found: usize = 0;
+        var timer = try Timer.start();
+        for (order) |i| {
+            if (map.get(keys[i]) != null) found += 1;
+        }
+        private[iter_idx] = timer.read();
+        timer.reset();
+        for (order) |i| {
+            if (reader.get(keys[i]) != null) found += 1;
+        }
+        shared[iter_idx] = timer.read();
+        std.mem.doNotOptimizeAway(found);
+    }
+
+    printFeatureHeader(title, "private", "shared");
+    printFeatureRow("Random get", perOpStats(private, order.len), perOpStats(shared, order.len));
+    printFeatureFooter();
+}
+
+/// One `HashMap` behind a single mutex: the baseline for `ShardedHashMap`.
+fn MutexMap(comptime V: type) type {
+    return struct {
+        const Self = @This();
+        mutex: std.Thread.Mutex = .{},
+        map: HashMap(u64, V),
+
+        fn init(alloc: std.mem.Allocator) Self {
+            return .{ .map = HashMap(u64, V).init(alloc) };
+        }
+        fn deinit(self: *Self) void {
+            self.map.deinit();
+        }
+        fn get(self: *Self, key: u64) ?V {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            return self.map.get(key);
+        }
+        fn put(self: *Self, key: u64, value: V) !void {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            try self.map.put(key, value);
+        }
+        fn remove(self: *Self, key: u64) bool {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            return self.map.remove(key);
+        }
+    };
+}
+
+/// `ops` split evenly over `threads` threads that all work on one table holding the first half
+/// of `keys`. Read-heavy ops are hits, inserts of the second half and removes (95/3/2); mixed
+/// ops are those of the `.mixed` workload, with its iteration step run as a miss.
+fn benchConcurrentOps(comptime Map: type, comptime V: type, comptime read_heavy: bool, keys: []const u64, ops: []const u8, indices: []const usize, threads: usize, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    const hits = keys[0 .. keys.len / 2];
+    const misses = keys[keys.len / 2 ..];
+    const Worker = struct {
+        fn run(map: *Map, hit_keys: []const u64, miss_keys: []const u64, op_slice: []const u8, idx_slice: []const usize) void {
+            var found: usize = 0;
+            for (op_slice, idx_slice) |op, raw| {
+                const i = raw % hit_keys.len;
+                if (read_heavy) {
+                    switch (op) {
+                        0 => {
+                            if (map.get(hit_keys[i]) != null) found += 1;
+                        },
+                        1 => map.put(miss_keys[i], makeValue(V, i)) catch unreachable,
+                        else => {
+                            if (map.remove(hit_keys[i])) found += 1;
+                        },
+                    }
+                } else {
+                    switch (op) {
+                        0 => {
+                            if (map.get(hit_keys[i]) != null) found += 1;
+                        },
+                        1, 4 => {
+                            if (map.get(miss_keys[i]) == null) found += 1;
+                        },
+                        2 => map.put(hit_keys[i], makeValue(V, i)) catch unreachable,
+                        else => {
+                            if (map.remove(hit_keys[i])) found += 1;
+                            map.put(hit_keys[i], makeValue(V, i)) catch unreachable;
+                        },
+                    }
+                }
+            }
+            std.mem.doNotOptimizeAway(found);
+        }
+    };
+
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var map = Map.init(alloc);
+        defer map.deinit();
+        try fillMap(V, &map, hits);
+
+        var workers: [32]std.Thread = undefined;
+        const chunk = ops.len / threads;
+        var timer = try Timer.start();
+        for (workers[0..threads], 0..) |*worker, t| {
+            worker.* = try std.Thread.spawn(.{}, Worker.run, .{ &map, hits, misses, ops[t * chunk ..][0..chunk], indices[t * chunk ..][0..chunk] });
+        }
+        for (workers[0..threads]) |worker| worker.join();
+        times[iter_idx] = timer.read();
+    }
+    return times;
+}
+
+/// Throughput of threads sharing one table: a single mutex around a `HashMap` vs. a
+/// `ShardedHashMap` with 64 shards, for the read-heavy and mixed op streams.
+fn runShardedBenchmark(comptime V: type, keys: []const u64, allocator: std.mem.Allocator) !void {
+    const Sharded = verztable.ShardedHashMap(u64, V, 64);
+    const cpus = std.Thread.getCpuCount() catch 1;
+
+    inline for (.{ .{ "read-heavy", true }, .{ "mixed", false } }) |workload| {
+        const generated = if (workload[1]) try generateReadHeavyOps(SIZE_1M, allocator) else try generateMixedOps(SIZE_1M, allocator);
+        defer allocator.free(generated.ops);
+        defer allocator.free(generated.indices);
+
+        const title = comptime std.fmt.comptimePrint("Concurrent {s} ops, u64 key → {s}, {s} ops", .{ workload[0], valueTypeName(V), formatSize(SIZE_1M) });
+        printFeatureHeader(title, "mutex", "sharded");
+        inline for (.{ 1, 2, 4, 8, 16, 32 }) |threads| {
+            if (threads <= cpus) {
+                const locked = perOpStats(try benchConcurrentOps(MutexMap(V), V, workload[1], keys, generated.ops, generated.indices, threads, allocator), SIZE_1M);
+                const sharded = perOpStats(try benchConcurrentOps(Sharded, V, workload[1], keys, generated.ops, generated.indices, threads, allocator), SIZE_1M);
+                printFeatureRow(comptime std.fmt.comptimePrint("{d} thread{s}", .{ threads, if (threads == 1) "" else "s" }), locked, sharded);
+            }
+        }
+        printFeatureFooter();
+    }
+}
+
+fn runGrowthBenchmark(comptime K: type, comptime V: type, comptime size: usize, keys: []const K, allocator: std.mem.Allocator) !void {
+    const B = Benchmarks(K, V);
+    const title = comptime std.fmt.comptimePrint("Growth (one doubling), {s} key → {s}, {s} elements", .{ keyTypeName(K), valueTypeName(V), formatSize(size) });
+
+    printFeatureHeader(title, "re-put", "rehash");
+    const rebuild = perOpStats(try B.benchGrowth(true, size, keys, allocator), size);
+    const rehash = perOpStats(try B.benchGrowth(false, size, keys, allocator), size);
+    printFeatureRow("Per key", rebuild, rehash);
+    printFeatureFooter();
+}
+
+/// Insert `keys` into `map` with values derived from their position.
+fn fillMap(comptime V: type, map: anytype, keys: anytype) !void {
+    for (keys, 0..) |k, i| {
+        if (V == void) try map.add(k) else try map.put(k, makeValue(V, i));
+    }
+}
+
+/// Random hits against an arbitrary table type built from `keys`.
+fn benchMapLookup(comptime Map: type, comptime V: type, keys: anytype, order: []const usize, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var map = Map.init(alloc);
+        defer map.deinit();
+        try fillMap(V, &map, keys);
+
+        var timer = try Timer.start();
+        var found: u64 = 0;
+        for (order[0..keys.len]) |idx| {
+            if (V == void) {
+                if (map.contains(keys[idx])) found += 1;
+            } else {
+                if (map.get(keys[idx]) != null) found += 1;
+            }
+        }
+        std.mem.doNotOptimizeAway(found);
+        times[iter_idx] = timer.read();
+    }
+    return times;
+}
+
+/// One doubling (`reserve` past capacity) of an arbitrary table type built from `keys`.
+fn benchMapGrowth(comptime Map: type, comptime V: type, keys: anytype, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var map = Map.init(alloc);
+        defer map.deinit();
+        try fillMap(V, &map, keys);
+        const doubled = map.capacity() + 1;
+
+        var timer = try Timer.start();
+        try map.reserve(doubled);
+        times[iter_idx] = timer.read();
+    }
+    return times;
+}
+
+fn runStoredHashBenchmark(
+    comptime K: type,
+    comptime V: type,
+    comptime hashFn: fn (K) u64,
+    comptime eqlFn: fn (K, K) bool,
+    comptime key_name: []const u8,
+    keys: []const K,
+    order: []const usize,
+    allocator: std.mem.Allocator,
+) !void {
+    const Plain = HashMapWithOptions(K, V, hashFn, eqlFn, .{ .store_hash = false });
+    const Stored = HashMapWithOptions(K, V, hashFn, eqlFn, .{ .store_hash = true });
+    const title = comptime std.fmt.comptimePrint("Stored hash, {s} key → {s} ({d} B vs {d} B per bucket)", .{
+        key_name, valueTypeName(V), @sizeOf(Plain.Bucket) + @sizeOf(Plain.MetaType), @sizeOf(Stored.Bucket) + @sizeOf(Stored.MetaType),
+    });
+
+    printFeatureHeader(title, "no hash", "hash");
+    printFeatureRow(
+        "Rand. Lookup",
+        perOpStats(try benchMapLookup(Plain, V, keys, order, allocator), keys.len),
+        perOpStats(try benchMapLookup(Stored, V, keys, order, allocator), keys.len),
+    );
+    printFeatureRow(
+        "Growth/key",
+        perOpStats(try benchMapGrowth(Plain, V, keys, allocator), keys.len),
+        perOpStats(try benchMapGrowth(Stored, V, keys, allocator), keys.len),
+    );
+    printFeatureFooter();
+}
+
+const InsertLatency = struct {
+    worst: [BENCHMARK_ITERATIONS]u64,
+    total: [BENCHMARK_ITERATIONS]u64,
+};
+
+/// Insert `keys` one by one into a fresh table, timing every insert on its own.
+/// Records the single slowest insert (a full rehash for stop-the-world growth) and the total.
+fn benchInsertLatency(comptime Map: type, comptime V: type, keys: anytype, alloc: std.mem.Allocator) !InsertLatency {
+    var result: InsertLatency = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var map = Map.init(alloc);
+        defer map.deinit();
+
+        var worst: u64 = 0;
+        var total: u64 = 0;
+        var timer = try Timer.start();
+        for (keys, 0..) |k, i| {
+            timer.reset();
+            if (V == void) try map.add(k) else try map.put(k, makeValue(V, i));
+            const t = timer.read();
+            worst = @max(worst, t);
+            total += t;
+        }
+        result.worst[iter_idx] = worst;
+        result.total[iter_idx] = total;
+    }
+    return result;
+}
+
+fn runIncrementalResizeBenchmark(comptime K: type, comptime V: type, comptime key_name: []const u8, keys: []const K, allocator: std.mem.Allocator) !void {
+    const hashFn = verztable.autoHash(K);
+    const eqlFn = verztable.autoEql(K);
+    const StopTheWorld = HashMapWithOptions(K, V, hashFn, eqlFn, .{});
+    const Incremental = HashMapWithOptions(K, V, hashFn, eqlFn, .{ .incremental_resize = true });
+    const title = comptime std.fmt.comptimePrint("Insert latency while growing, {s} key → {s}", .{ key_name, valueTypeName(V) });
+
+    const stw = try benchInsertLatency(StopTheWorld, V, keys, allocator);
+    const inc = try benchInsertLatency(Incremental, V, keys, allocator);
+
+    printFeatureHeader(title, "rehash", "incr.");
+    printFeatureRow("Worst insert", BenchStats.compute(&stw.worst), BenchStats.compute(&inc.worst));
+    printFeatureRow("Mean insert", perOpStats(stw.total, keys.len), perOpStats(inc.total, keys.len));
+    printFeatureFooter();
+}
+
+/// Like `printFeatureRow`, for byte counts; the ratio is how many times smaller the variant is.
+fn printFeatureMemRow(name: []const u8, baseline: usize, variant: usize) void {
+    const ratio = @as(f64, @floatFromInt(baseline)) / @as(f64, @floatFromInt(@max(variant, 1)));
+    std.debug.print("  │ {s:<14} │", .{name});
+    formatMemory(baseline);
+    std.debug.print(" │", .{});
+    formatMemory(variant);
+    std.debug.print(" │ {d:>6.2}x │\n", .{ratio});
+}
+
+/// Pass-through allocator that records the high-water mark of live bytes.
+const PeakTrackingAllocator = struct {
+    child: std.mem.Allocator,
+    live: usize = 0,
+    peak: usize = 0,
+
+    fn allocator(self: *PeakTrackingAllocator) std.mem.Allocator {
+        return .{ .ptr = self, .vtable = &.{ .alloc = alloc, .resize = resize, .remap = remap, .free = free } };
+    }
+
+    fn track(self: *PeakTrackingAllocator, old_len: usize, new_len: usize) void {
+        self.live = self.live - old_len + new_len;
+        self.peak = @max(self.peak, self.live);
+    }
+
+    fn alloc(ctx: *anyopaque, len: usize, alignment: std.mem.Alignment, ret_addr: usize) ?[*]u8 {
+        const self: *PeakTrackingAllocator = @ptrCast(@alignCast(ctx));
+        const ptr = self.child.rawAlloc(len, alignment, ret_addr) orelse return null;
+        self.track(0, len);
+        return ptr;
+    }
+
+    fn resize(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) bool {
+        const self: *PeakTrackingAllocator = @ptrCast(@alignCast(ctx));
+        if (!self.child.rawResize(memory, alignment, new_len, ret_addr)) return false;
+        self.track(memory.len, new_len);
+        return true;
+    }
+
+    fn remap(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) ?[*]u8 {
+        const self: *PeakTrackingAllocator = @ptrCast(@alignCast(ctx));
+        const ptr = self.child.rawRemap(memory, alignment, new_len, ret_addr) orelse return null;
+        self.track(memory.len, new_len);
+        return ptr;
+    }
+
+    fn free(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, ret_addr: usize) void {
+        const self: *PeakTrackingAllocator = @ptrCast(@alignCast(ctx));
+        self.child.rawFree(memory, alignment, ret_addr);
+        self.track(memory.len, 0);
+    }
+};
+
+const GrowthFootprint = struct {
+    peak: usize,
+    times: [BENCHMARK_ITERATIONS]u64,
+};
+
+/// Fill a fresh table with `keys`, recording peak live bytes and the fill time.
+fn benchGrowthFootprint(comptime Map: type, comptime V: type, keys: anytype) !GrowthFootprint {
+    var result: GrowthFootprint = .{ .peak = 0, .times = undefined };
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        // The page allocator remaps with mremap, so both variants see the same backing behavior
+        var tracker: PeakTrackingAllocator = .{ .child = std.heap.page_allocator };
+        var map = Map.init(tracker.allocator());
+        defer map.deinit();
+
+        var timer = try Timer.start();
+        try fillMap(V, &map, keys);
+        result.times[iter_idx] = timer.read();
+        result.peak = @max(result.peak, tracker.peak);
+    }
+    return result;
+}
+
+fn runGrowInPlaceBenchmark(comptime K: type, comptime V: type, comptime key_name: []const u8, keys: []const K) !void {
+    const hashFn = verztable.autoHash(K);
+    const eqlFn = verztable.autoEql(K);
+    const Copying = HashMapWithOptions(K, V, hashFn, eqlFn, .{});
+    const InPlace = HashMapWithOptions(K, V, hashFn, eqlFn, .{ .grow_in_place = true });
+    const title = comptime std.fmt.comptimePrint("Growth footprint, {s} key → {s}", .{ key_name, valueTypeName(V) });
+
+    const copying = try benchGrowthFootprint(Copying, V, keys);
+    const in_place = try benchGrowthFootprint(InPlace, V, keys);
+
+    printFeatureHeader(title, "copy", "in-place");
+    printFeatureMemRow("Peak memory", copying.peak, in_place.peak);
+    printFeatureRow("Fill time/key", perOpStats(copying.times, keys.len), perOpStats(in_place.times, keys.len));
+    printFeatureFooter();
+}
+
+/// Hash for the clustered-key benchmark: keys with the top bit set keep only the high bits of
+/// their hash, so they all share home bucket 0 in any table of up to 2^24 buckets.
+fn clusteredHash(key: u64) u64 {
+    const h = verztable.hashInteger(key);
+    return if (key >> 63 != 0) h & ~@as(u64, 0xFF_FFFF) else h;
+}
+
+/// Time filling a fresh table of an arbitrary type with `keys`.
+fn benchMapFill(comptime Map: type, comptime V: type, keys: anytype, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var map = Map.init(alloc);
+        defer map.deinit();
+
+        var timer = try Timer.start();
+        try fillMap(V, &map, keys);
+        times[iter_idx] = timer.read();
+    }
+    return times;
+}
+
+/// Lookups of absent keys against an arbitrary table type built from `keys`.
+fn benchMapMiss(comptime Map: type, comptime V: type, keys: anytype, miss_keys: anytype, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var map = Map.init(alloc);
+        defer map.deinit();
+        try fillMap(V, &map, keys);
+
+        var timer = try Timer.start();
+        var missed: u64 = 0;
+        for (miss_keys) |k| {
+            if (!map.contains(k)) missed += 1;
+        }
+        std.mem.doNotOptimizeAway(missed);
+        times[iter_idx] = timer.read();
+    }
+    return times;
+}
+
+/// Full pass over the keys (`values` false) or values of a table built from `keys`.
+fn benchMapScan(comptime Map: type, comptime V: type, comptime values: bool, keys: anytype, alloc: std.mem.Allocator) ![BENCHMARK_ITERATIONS]u64 {
+    var times: [BENCHMARK_ITERATIONS]u64 = undefined;
+    for (0..BENCHMARK_ITERATIONS) |iter_idx| {
+        var map = Map.init(alloc);
+        defer map.deinit();
+        try fillMap(V, &map, keys);
+
+        var timer = try Timer.start();
+        var checksum: u64 = 0;
+        if (values) {
+            var it = map.valueIterator();
+            while (it.next()) |v| checksum +%= v.data[0];
+        } else {
+            var it = map.keyIterator();
+            while (it.next()) |k| checksum +%= k;
+        }
+        std.mem.doNotOptimizeAway(checksum);
+        times[iter_idx] = timer.read();
+    }
+    return times;
+}
+
+fn runSeparateValuesBenchmark(comptime V: type, keys: []const u64, miss_keys: []const u64, order: []const usize, allocator: std.mem.Allocator) !void {
+    const hashFn = verztable.autoHash(u64);
+    const eqlFn = verztable.autoEql(u64);
+    const Interleaved = HashMapWithOptions(u64, V, hashFn, eqlFn, .{});
+    const Separate = HashMapWithOptions(u64, V, hashFn, eqlFn, .{ .separate_values = true });
+    const title = comptime std.fmt.comptimePrint("Separate values, u64 key → {s} ({d} B vs {d} B per bucket)", .{
+        valueTypeName(V), @sizeOf(Interleaved.Bucket), @sizeOf(Separate.Bucket),
+    });
+
+    printFeatureHeader(title, "inline", "separate");
+    printFeatureRow(
+        "Insert/key",
+        perOpStats(try benchMapFill(Interleaved, V, keys, allocator), keys.len),
+        perOpStats(try benchMapFill(Separate, V, keys, allocator), keys.len),
+    );
+    printFeatureRow(
+        "Rand. Lookup",
+        perOpStats(try benchMapLookup(Interleaved, V, keys, order, allocator), keys.len),
+        perOpStats(try benchMapLookup(Separate, V, keys, order, allocator), keys.len),
+    );
+    printFeatureRow(
+        "Miss",
+        perOpStats(try benchMapMiss(Interleaved, V, keys, miss_keys, allocator), miss_keys.len),
+        perOpStats(try benchMapMiss(Separate, V, keys, miss_keys, allocator), miss_keys.len),
+    );
+    printFeatureRow(
+        "Key iteration",
+        perOpStats(try benchMapScan(Interleaved, V, false, keys, allocator), keys.len),
+        perOpStats(try benchMapScan(Separate, V, false, keys, allocator), keys.len),
+    );
+    printFeatureRow(
+        "Value iter.",
+        perOpStats(try benchMapScan(Interleaved, V, true, keys, allocator), keys.len),
+        perOpStats(try benchMapScan(Separate, V, true, keys, allocator), keys.len),
+    );
+    printFeatureFooter();
+}
+
+fn runDenseValuesBenchmark(comptime V: type, keys: []const u64, order: []const usize, allocator: std.mem.Allocator) !void {
+    const hashFn = verztable.autoHash(u64);
+    const eqlFn = verztable.autoEql(u64);
+    const Interleaved = HashMapWithOptions(u64, V, hashFn, eqlFn, .{});
+    const Dense = HashMapWithOptions(u64, V, hashFn, eqlFn, .{ .dense_values = true });
+    const title = comptime std.fmt.comptimePrint("Dense values, u64 key → {s} ({d} B vs {d} B per bucket)", .{
+        valueTypeName(V), @sizeOf(Interleaved.Bucket), @sizeOf(Dense.Bucket),
+    });
+
+    printFeatureHeader(title, "inline", "dense");
+    printFeatureRow(
+        "Insert/key",
+        perOpStats(try benchMapFill(Interleaved, V, keys, allocator), keys.len),
+        perOpStats(try benchMapFill(Dense, V, keys, allocator), keys.len),
+    );
+    printFeatureRow(
+        "Rand. Lookup",
+        perOpStats(try benchMapLookup(Interleaved, V, keys, order, allocator), keys.len),
+        perOpStats(try benchMapLookup(Dense, V, keys, order, allocator), keys.len),
+    );
+    printFeatureRow(
+        "Growth/key",
+        perOpStats(try benchMapGrowth(Interleaved, V, keys, allocator), keys.len),
+        perOpStats(try benchMapGrowth(Dense, V, keys, allocator), keys.len),
+    );
+    printFeatureRow(
+        "Value iter.",
+        perOpStats(try benchMapScan(Interleaved, V, true, keys, allocator), keys.len),
+        perOpStats(try benchMapScan(Dense, V, true, keys, allocator), keys.len),
+    );
+    printFeatureFooter();
+}
+
+fn runStashBenchmark(comptime V: type, keys: []const u64, miss_keys: []const u64, order: []const usize, allocator: std.mem.Allocator) !void {
+    const eqlFn = verztable.autoEql(u64);
+    const Doubling = HashMapWithOptions(u64, V, clusteredHash, eqlFn, .{});
+    const Stashed = HashMapWithOptions(u64, V, clusteredHash, eqlFn, .{ .stash_capacity = 256 });
+    const title = comptime std.fmt.comptimePrint("Overflow stash, clustered u64 key → {s}", .{valueTypeName(V)});
+
+    var doubling = Doubling.init(allocator);
+    defer doubling.deinit();
+    try fillMap(V, &doubling, keys);
+    var stashed = Stashed.init(allocator);
+    defer stashed.deinit();
+    try fillMap(V, &stashed, keys);
+
+    printFeatureHeader(title, "double", "stash");
+    printFeatureMemRow(
+        "Table memory",
+        doubling.bucketCount() * (@sizeOf(Doubling.Bucket) + @sizeOf(Doubling.MetaType)),
+        stashed.bucketCount() * (@sizeOf(Stashed.Bucket) + @sizeOf(Stashed.MetaType)),
+    );
+    printFeatureRow(
+        "Insert/key",
+        perOpStats(try benchMapFill(Doubling, V, keys, allocator), keys.len),
+        perOpStats(try benchMapFill(Stashed, V, keys, allocator), keys.len),
+    );
+    printFeatureRow(
+        "Rand. Lookup",
+        perOpStats(try benchMapLookup(Doubling, V, keys, order, allocator), keys.len),
+        perOpStats(try benchMapLookup(Stashed, V, keys, order, allocator), keys.len),
+    );
+    printFeatureRow(
+        "Miss",
+        perOpStats(try benchMapMiss(Doubling, V, keys, miss_keys, allocator), miss_keys.len),
+        perOpStats(try benchMapMiss(Stashed, V, keys, miss_keys, allocator), miss_keys.len),
+    );
+    printFeatureFooter();
+}
+
+fn runFeatureBenchmarks(allocator: std.mem.Allocator) !void {
+    std.debug.print("\n╔══════════════════════════════════════════════════════════════════════════════╗\n", .{});
+    std.debug.print("║                         Feature Benchmarks                                   ║\n", .{});
+    std.debug.print("╚══════════════════════════════════════════════════════════════════════════════╝\n", .{});
+
+    // 1M keys: large enough that random probes miss the last-level cache
+    const u64_keys = try allocator.alloc(u64, SIZE_1M);
+    defer allocator.free(u64_keys);
+    const u64_order = try allocator.alloc(usize, SIZE_1M);
+    defer allocator.free(u64_order);
+
+    var rng = makeRng(12345);
+    for (0..SIZE_1M) |i| {
+        u64_keys[i] = rng.random().int(u64);
+        u64_order[i] = i;
+    }
+    rng.random().shuffle(usize, u64_order);
+
+    const key_storage = try allocator.alloc([80]u8, SIZE_1M);
+    defer allocator.free(key_storage);
+    const str_keys = try allocator.alloc([]const u8, SIZE_1M);
+    defer allocator.free(str_keys);
+
+    rng = makeRng(12345);
+    for (0..SIZE_1M) |i| {
+        const len = 8 + (rng.random().int(usize) % 57);
+        for (0..len) |j| key_storage[i][j] = @truncate(32 + (rng.random().int(u8) % 95));
+        str_keys[i] = key_storage[i][0..len];
+    }
+
+    try runBatchLookupBenchmark(u64, void, SIZE_1M, u64_keys, u64_order, allocator);
+    try runBatchLookupBenchmark(u64, Value64, SIZE_1M, u64_keys, u64_order, allocator);
+    try runBatchLookupBenchmark([]const u8, Value4, SIZE_1M, str_keys, u64_order, allocator);
+
+    try runAssumeCapacityBenchmark(u64, void, SIZE_1M, u64_keys, allocator);
+    try runAssumeCapacityBenchmark(u64, Value64, SIZE_1M, u64_keys, allocator);
+    try runAssumeCapacityBenchmark([]const u8, Value4, SIZE_1M, str_keys, allocator);
+
+    // Cold start: sequential puts vs. a partitioned build across threads
+    try runParallelBuildBenchmark(u64, Value4, u64_keys, allocator);
+    try runParallelBuildBenchmark([]const u8, Value4, str_keys, allocator);
+
+    // Doubling a full table: single-threaded rehash vs. the same rehash on a pool
+    try runParallelRehashBenchmark(u64, Value4, u64_keys, allocator);
+    try runParallelRehashBenchmark([]const u8, Value4, str_keys, allocator);
+
+    // Millions of short-lived maps: heap table vs. inline storage
+    try runSmallMapBenchmark(Value4, u64_keys, allocator);
+
+    // Churned tables: backing allocator vs. recycled blocks
+    try runTablePoolBenchmark(Value4, u64_keys, allocator);
+
+    // Tables far beyond TLB reach: 4 KiB pages vs. 2 MiB pages
+    try runHugePageBenchmark(Value4, allocator);
+
+    // Service restart: re-inserting every key vs. mapping a snapshot in place
+    try runMappedBenchmark(Value4, u64_keys, u64_order, allocator);
+
+    // Persisted tables: re-putting every key vs. one sequential read of the storage block
+    try runSnapshotBenchmark(Value4, allocator);
+
+    // Replication: applying shipped changes one put at a time vs. a batched, prefetched replay
+    try runJournalBenchmark(Value4, u64_keys, allocator);
+
+    // One table for many processes: private copy vs. seqlocked reads of a shared region
+    try runSharedBenchmark(Value4, u64_keys, u64_order, allocator);
+
+    // Request threads sharing a table: one mutex vs. per-shard locks
+    try runShardedBenchmark(Value4, u64_keys, allocator);
+
+    // Reused scratch sets: clearing the whole metadata vs. only the pages written since
+    try runClearBenchmark(u64_keys, allocator);
+
+    // TTL-style sweeps: collect + remove per key vs. one removeIf pass
+    try runSweepBenchmark(u64, Value4, u64_keys, allocator);
+    try runSweepBenchmark([]const u8, Value4, str_keys, allocator);
+
+    // Iterating full and churned (sparse) maps: one bucket per call vs. batches
+    try runIterBatchBenchmark(Value4, u64_keys, allocator);
+    try runIterBatchBenchmark(Value64, u64_keys, allocator);
+
+    // Aggregating a whole map: one iterator vs. parallelReduce over bucket ranges
+    try runParallelScanBenchmark(Value4, u64_keys, allocator);
+    try runParallelScanBenchmark(Value64, u64_keys, allocator);
+
+    try runGrowthBenchmark([]const u8, void, SIZE_1M, str_keys, allocator);
+    try runGrowthBenchmark([]const u8, Value4, SIZE_1M, str_keys, allocator);
+
+    // Memory vs. speed of caching the full hash, per key type
+    const composite_keys = try allocator.alloc(CompositeKey, SIZE_1M);
+    defer allocator.free(composite_keys);
+    for (composite_keys, u64_keys) |*c, k| c.* = CompositeKey.fromU64(k);
+
+    inline for (.{ void, Value64 }) |V| {
+        try runStoredHashBenchmark(u64, V, verztable.autoHash(u64), verztable.autoEql(u64), "u64", u64_keys, u64_order, allocator);
+        try runStoredHashBenchmark([]const u8, V, verztable.autoHash([]const u8), verztable.autoEql([]const u8), "string", str_keys, u64_order, allocator);
+        try runStoredHashBenchmark(CompositeKey, V, CompositeKey.hash, CompositeKey.eql, "composite", composite_keys, u64_order, allocator);
+    }
+
+    // Tail latency of growth: one stop-the-world rehash vs. migration spread over inserts
+    try runIncrementalResizeBenchmark(u64, Value4, "u64", u64_keys, allocator);
+    try runIncrementalResizeBenchmark([]const u8, Value4, "string", str_keys, allocator);
+
+    // Peak memory while doubling: copy into a fresh allocation vs. remap and redistribute in place
+    try runGrowInPlaceBenchmark(u64, Value64, "u64", u64_keys);
+    try runGrowInPlaceBenchmark([]const u8, Value4, "string", str_keys);
+
+    // Adversarially clustered keys: 400 keys sharing one home bucket among 1M random ones.
+    // Without a stash the chain overflows DISPLACEMENT_MASK and forces doublings at low load.
+    const cluster_size = 400;
+    const clustered_keys = try allocator.alloc(u64, SIZE_1M);
+    defer allocator.free(clustered_keys);
+    for (clustered_keys, u64_keys, 0..) |*c, k, i| {
+        c.* = if (i % (SIZE_1M / cluster_size) == 0) (@as(u64, 1) << 63) | i else k >> 1;
+    }
+    const clustered_miss = try allocator.alloc(u64, SIZE_100K);
+    defer allocator.free(clustered_miss);
+    // Half the misses probe the clustered chain, half land anywhere (paying only the stash scan)
+    for (clustered_miss, 0..) |*m, i| {
+        m.* = if (i % 2 == 0) (@as(u64, 1) << 63) | (SIZE_1M + i) else (@as(u64, 1) << 62) | i;
+    }
+
+    try runStashBenchmark(void, clustered_keys, clustered_miss, u64_order, allocator);
+    try runStashBenchmark(Value64, clustered_keys, clustered_miss, u64_order, allocator);
+
+    // Large values out of the way of chain walks and misses
+    const u64_miss = try allocator.alloc(u64, SIZE_100K);
+    defer allocator.free(u64_miss);
+    rng = makeRng(54321);
+    for (u64_miss) |*m| m.* = rng.random().int(u64);
+
+    try runSeparateValuesBenchmark(Value4, u64_keys, u64_miss, u64_order, allocator);
+    try runSeparateValuesBenchmark(Value64, u64_keys, u64_miss, u64_order, allocator);
+
+    // Whole-map passes over large values: contiguous value array vs. scanning sparse buckets
+    try runDenseValuesBenchmark(Value64, u64_keys, u64_order, allocator);
+    try runDenseValuesBenchmark(Value256, u64_keys, u64_order, allocator);
+}
+
+// ============================================================================
+// Metadata Layout Sweep (`zig build benchmark -Dmeta-sweep -- meta`)
+// ============================================================================
+
+/// A metadata word width and hash fragment width to run the `BenchOp` suite with.
+const MetaConfig = struct { meta_bits: u16, frag_bits: u16 };
+
+/// Integer keys: from compact 8-bit metadata up to wide fragments in 32 bits.
+const int_meta_configs = [_]MetaConfig{
+    .{ .meta_bits = 8, .frag_bits = 1 },
+    .{ .meta_bits = 8, .frag_bits = 2 },
+    .{ .meta_bits = 16, .frag_bits = 2 },
+    .{ .meta_bits = 16, .frag_bits = 4 },
+    .{ .meta_bits = 16, .frag_bits = 8 },
+    .{ .meta_bits = 32, .frag_bits = 12 },
+};
+
+/// String keys: wider fragments, since every fragment collision costs a key compare.
+const string_meta_configs = [_]MetaConfig{
+    .{ .meta_bits = 16, .frag_bits = 4 },
+    .{ .meta_bits = 16, .frag_bits = 6 },
+    .{ .meta_bits = 16, .frag_bits = 8 },
+    .{ .meta_bits = 16, .frag_bits = 10 },
+    .{ .meta_bits = 32, .frag_bits = 12 },
+    .{ .meta_bits = 32, .frag_bits = 16 },
+};
+
+fn metaConfigs(comptime K: type) []const MetaConfig {
+    return if (K == []const u8) &string_meta_configs else &int_meta_configs;
+}
+
+fn printSweepRule(left: []const u8, mid: []const u8, right: []const u8, columns: usize) void {
+    std.debug.print("  {s}────────────────", .{left});
+    for (0..columns) |_| std.debug.print("{s}──────────", .{mid});
+    std.debug.print("{s}\n", .{right});
+}
+
+/// Run every `BenchOp` once per metadata layout in `metaConfigs(K)`; one column per layout.
+fn runMetaSweep(
+    comptime K: type,
+    comptime V: type,
+    comptime size: usize,
+    keys: []const K,
+    miss_keys: []const K,
+    lookup_order: []const usize,
+    allocator: std.mem.Allocator,
+) !void {
+    const configs = comptime metaConfigs(K);
+    const workloads = try Workloads(K).init(size, keys, miss_keys, allocator);
+    defer workloads.deinit(allocator);
+
+    std.debug.print("\n  Metadata sweep, {s} key → {s}, {s} elements (u<meta bits>/<fragment bits>):\n", .{ keyTypeName(K), valueTypeName(V), comptime formatSize(size) });
+    printSweepRule("┌", "┬", "┐", configs.len);
+    std.debug.print("  │ Operation      │", .{});
+    inline for (configs) |c| {
+        std.debug.print(" {s:<8} │", .{comptime std.fmt.comptimePrint("u{d}/{d}", .{ c.meta_bits, c.frag_bits })});
+    }
+    std.debug.print("\n", .{});
+    printSweepRule("├", "┼", "┤", configs.len);
+
+    const runOp = struct {
+        fn run(comptime op: BenchOp, name: []const u8, k: []const K, extra: anytype, alloc: std.mem.Allocator, comptime s: usize) !void {
+            const B = Benchmarks(K, V);
+            const divisor = if (op == .high_load) (s * 95) / 100 else s;
+            std.debug.print("  │ {s:<14} │", .{name});
+            inline for (comptime metaConfigs(K)) |c| {
+                const Map = HashMapWithOptions(K, V, verztable.autoHash(K), verztable.autoEql(K), .{
+                    .meta_bits = c.meta_bits,
+                    .hash_frag_bits = c.frag_bits,
+                });
+                printTime(perOpStats(try B.benchMap(Map, op, s, k, extra, alloc), divisor).mean);
+                std.debug.print(" │", .{});
+            }
+            std.debug.print("\n", .{});
+        }
+    }.run;
+
+    try runOp(.insert, "Rand. Insert", keys, {}, allocator, size);
+    try runOp(.insert_seq, "Seq. Insert", keys, {}, allocator, size);
+    try runOp(.insert_reserved, "Reserved Ins.", keys, {}, allocator, size);
+    try runOp(.update, "Update", keys, {}, allocator, size);
+    try runOp(.lookup, "Rand. Lookup", keys, lookup_order, allocator, size);
+    try runOp(.high_load, "High Load", keys, lookup_order, allocator, size);
+    try runOp(.miss, "Lookup Miss", keys, miss_keys, allocator, size);
+    try runOp(.tombstone, "Tombstone", keys, miss_keys, allocator, size);
+    try runOp(.delete, "Delete", keys, {}, allocator, size);
+    try runOp(.iter, "Iteration", keys, {}, allocator, size);
+    try runOp(.churn, "Churn", keys, {}, allocator, size);
+    try runOp(.mixed, "Mixed", keys, &workloads.mixed, allocator, size);
+    try runOp(.read_heavy, "Read-Heavy", keys, &workloads.read_heavy, allocator, size);
+    try runOp(.write_heavy, "Write-Heavy", keys, &workloads.write_heavy, allocator, size);
+    try runOp(.update_heavy, "Update-Heavy", keys, &workloads.update_heavy, allocator, size);
+    try runOp(.zipfian, "Zipfian", keys, &workloads.zipfian, allocator, size);
+
+    printSweepRule("└", "┴", "┘", configs.len);
+}
+
+fn runMetaSweeps(allocator: std.mem.Allocator) !void {
+    std.debug.print("\n╔══════════════════════════════════════════════════════════════════════════════╗\n", .{});
+    std.debug.print("║                         Metadata Layout Sweep                                ║\n", .{});
+    std.debug.print("╚══════════════════════════════════════════════════════════════════════════════╝\n", .{});
+
+    const u32_keys = try allocator.alloc(u32, SIZE_100K);
+    defer allocator.free(u32_keys);
+    const u32_miss = try allocator.alloc(u32, SIZE_100K);
+    defer allocator.free(u32_miss);
+    const u64_keys = try allocator.alloc(u64, SIZE_100K);
+    defer allocator.free(u64_keys);
+    const u64_miss = try allocator.alloc(u64, SIZE_100K);
+    defer allocator.free(u64_miss);
+    const order = try allocator.alloc(usize, SIZE_100K);
+    defer allocator.free(order);
+
+    var rng = makeRng(12345);
+    var miss_rng = makeRng(99999);
+    for (0..SIZE_100K) |i| {
+        u32_keys[i] = rng.random().int(u32);
+        u32_miss[i] = miss_rng.random().int(u32) | (1 << 31);
+        u64_keys[i] = rng.random().int(u64);
+        u64_miss[i] = miss_rng.random().int(u64) | (1 << 63);
+        order[i] = i;
+    }
+    rng.random().shuffle(usize, order);
+
+    const key_storage = try allocator.alloc([80]u8, SIZE_100K);
+    defer allocator.free(key_storage);
+    const miss_storage = try allocator.alloc([80]u8, SIZE_100K);
+    defer allocator.free(miss_storage);
+    const str_keys = try allocator.alloc([]const u8, SIZE_100K);
+    defer allocator.free(str_keys);
+    const str_miss = try allocator.alloc([]const u8, SIZE_100K);
+    defer allocator.free(str_miss);
+
+    for (0..SIZE_100K) |i| {
+        const len = 8 + (rng.random().int(usize) % 57);
+        for (0..len) |j| key_storage[i][j] = @truncate(32 + (rng.random().int(u8) % 95));
+        str_keys[i] = key_storage[i][0..len];
+
+        const miss_len = 8 + (rng.random().int(usize) % 57);
+        for (0..miss_len) |j| miss_storage[i][j] = @truncate(32 + (rng.random().int(u8) % 95));
+        miss_storage[i][0] = '~';
+        str_miss[i] = miss_storage[i][0..miss_len];
+    }
+
+    // Sets are where narrow metadata matters most; Value64 shows the large-bucket end
+    try runMetaSweep(u32, void, SIZE_100K, u32_keys, u32_miss, order, allocator);
+    try runMetaSweep(u64, Value64, SIZE_100K, u64_keys, u64_miss, order, allocator);
+    try runMetaSweep([]const u8, Value4, SIZE_100K, str_keys, str_miss, order, allocator);
+}
+
+/// Benchmark sections selectable on the command line,
+/// e.g. `zig build benchmark -- features`. No arguments runs everything.
+/// `meta` is only built with `-Dmeta-sweep`, as it instantiates the suite once per layout.
+const Section = enum { comparison, memory, features, meta };
+
 pub fn main() !void {
     const allocator = std.heap.c_allocator;
 
@@ -1609,6 +3160,22 @@ pub fn main() !void {
     std.debug.print("  - Benchmark iterations: {d}\n", .{BENCHMARK_ITERATIONS});
     std.debug.print("  - Test sizes:           100, 3K, 100K (timing), 1K-1M (memory)\n\n", .{});
 
+    var sections = std.EnumSet(Section).initEmpty();
+    var args = try std.process.argsWithAllocator(allocator);
+    defer args.deinit();
+    _ = args.skip();
+    while (args.next()) |arg| {
+        const section = std.meta.stringToEnum(Section, arg) orelse {
+            std.debug.print("Unknown benchmark section '{s}' (expected comparison, memory, features or meta)\n", .{arg});
+            return error.InvalidArgument;
+        };
+        sections.insert(section);
+    }
+    if (sections.count() == 0) {
+        sections = std.EnumSet(Section).initFull();
+        if (!bench_options.meta_sweep) sections.remove(.meta);
+    }
+
     std.debug.print("Warming up...\n", .{});
     for (0..WARMUP_ITERATIONS) |_| {
         var map = HashMap(u64, u64).init(allocator);
@@ -1616,17 +3183,27 @@ pub fn main() !void {
         for (0..SIZE_100K) |i| try map.put(i, i);
     }
 
-    try runBenchmarks(allocator);
+    if (sections.contains(.comparison)) {
+        try runBenchmarks(allocator);
 
-    // Print key-type average tables
-    std.debug.print("\n╔══════════════════════════════════════════════════════════════════════════════╗\n", .{});
-    std.debug.print("║                         AVERAGE BY KEY TYPE                                  ║\n", .{});
-    std.debug.print("╚══════════════════════════════════════════════════════════════════════════════╝\n", .{});
+        // Print key-type average tables
+        std.debug.print("\n╔══════════════════════════════════════════════════════════════════════════════╗\n", .{});
+        std.debug.print("║                         AVERAGE BY KEY TYPE                                  ║\n", .{});
+        std.debug.print("╚══════════════════════════════════════════════════════════════════════════════╝\n", .{});
 
-    g_acc_u32.printTable("u32");
-    g_acc_u64.printTable("u64");
-    g_acc_string.printTable("string");
+        g_acc_u32.printTable("u32");
+        g_acc_u64.printTable("u64");
+        g_acc_string.printTable("string");
+    }
 
-    try runMemoryBenchmarks(allocator);
+    if (sections.contains(.memory)) try runMemoryBenchmarks(allocator);
+    if (sections.contains(.features)) try runFeatureBenchmarks(allocator);
+    if (sections.contains(.meta)) {
+        if (bench_options.meta_sweep) {
+            try runMetaSweeps(allocator);
+        } else {
+            std.debug.print("\nThe metadata sweep is not built in; rerun with `zig build benchmark -Dmeta-sweep -- meta`\n", .{});
+        }
+    }
     std.debug.print("\nBenchmark complete.\n", .{});
 }
@@ -14,34 +14,34 @@
 //! Open-addressing with linear probing and linked chains per home bucket.
 //! Linear probing provides excellent cache locality while chains enable tombstone-free deletion.
 //! Each bucket has 16-bit metadata: 4-bit hash fragment | 1-bit home flag | 11-bit displacement.
+//! The metadata width and fragment bits can be chosen per table type (see `MetaLayout`).
 
 const std = @import("std");
+const builtin = @import("builtin");
 const Allocator = std.mem.Allocator;
 const math = std.math;
+const posix = std.posix;
 
 // ============================================================================
 // Metadata Constants
 // ============================================================================
 
-/// Metadata type - u16 is compact and cache-efficient
-const MetaType = u16;
-const META_BITS = 16;
-
-/// Empty bucket marker
-const EMPTY: MetaType = 0x0000;
-
 /// User-configurable trade-off: number of hash fragment bits.
 /// Higher values → better collision filtering (fewer expensive key equality checks, especially good for string keys)
 /// Lower values → longer possible chains (fewer premature rehashes, better for large values or small tables)
 /// Recommended range: 4–10
+/// This is the default for 16-bit metadata; `Options.hash_frag_bits` overrides it per table type.
 pub const HASH_FRAG_SIZE_BITS: usize = 4; // Change this single value to tune!
 
-/// Derived metadata masks (do not edit these directly)
-pub const HASH_FRAG_MASK: MetaType = @as(MetaType, ((@as(u32, 1) << HASH_FRAG_SIZE_BITS) - 1) << (META_BITS - HASH_FRAG_SIZE_BITS));
+/// Bit layout of the default 16-bit metadata (see `MetaLayout`).
+const DefaultMeta = MetaLayout(u16, HASH_FRAG_SIZE_BITS);
 
-pub const IN_HOME_BUCKET_MASK: MetaType = @as(MetaType, 1) << (META_BITS - 1 - HASH_FRAG_SIZE_BITS);
+/// Derived metadata masks of the default layout (do not edit these directly)
+pub const HASH_FRAG_MASK: u16 = DefaultMeta.HASH_FRAG_MASK;
 
-pub const DISPLACEMENT_MASK: MetaType = (@as(MetaType, 1) << (META_BITS - 1 - HASH_FRAG_SIZE_BITS)) - 1;
+pub const IN_HOME_BUCKET_MASK: u16 = DefaultMeta.IN_HOME_BUCKET_MASK;
+
+pub const DISPLACEMENT_MASK: u16 = DefaultMeta.DISPLACEMENT_MASK;
 
 /// Minimum non-zero bucket count (must be power of two)
 const MIN_NONZERO_BUCKET_COUNT: usize = 16;
@@ -49,6 +49,301 @@ const MIN_NONZERO_BUCKET_COUNT: usize = 16;
 /// Default maximum load factor (87.5% - matches Abseil/Swiss Tables)
 const DEFAULT_MAX_LOAD: f32 = 0.875;
 
+/// Number of keys kept in flight by `getMany`/`containsMany`.
+/// Deep enough to overlap DRAM misses on large tables, small enough that the
+/// per-group hash array stays in registers/L1.
+pub const DEFAULT_LOOKUP_BATCH_SIZE: usize = 16;
+
+/// Fewest partitions `fromSlices` and parallel rehash insert in parallel; smaller tables use plain inserts.
+/// Partitions run in three rounds and at least DISPLACEMENT_MASK buckets each, so fewer
+/// would leave at most one partition per round.
+const MIN_PARALLEL_BUILD_PARTITIONS: usize = 8;
+
+/// Partitions per worker thread in `fromSlices` and parallel rehash, to even out uneven partitions.
+const BUILD_PARTITIONS_PER_WORKER: usize = 16;
+
+/// Bucket ranges per worker thread in `parallelForEach`/`parallelReduce`.
+const SCAN_RANGES_PER_WORKER: usize = 4;
+
+/// Fewest buckets per range in `parallelForEach`/`parallelReduce`, so small tables aren't
+/// split into more ranges than they are worth.
+const MIN_SCAN_RANGE_BUCKETS: usize = 1 << 14;
+
+/// Fewest keys rehashed on the pool with `Options.parallel_rehash`; below this, spawning
+/// and partitioning cost more than the rehash itself.
+pub const MIN_PARALLEL_REHASH_KEYS: usize = 1 << 16;
+
+/// Storage blocks at least this large are mapped directly with `Options.huge_pages`;
+/// also the alignment and size granularity of such mappings (the x86-64/arm64 huge page).
+pub const HUGE_PAGE_SIZE: usize = 2 << 20;
+
+// ============================================================================
+// Huge-Page Storage
+// ============================================================================
+
+/// Map an anonymous block of at least `len` bytes on huge pages. Tries MAP_HUGETLB first, which
+/// only succeeds when huge pages are reserved (vm.nr_hugepages); otherwise maps normal pages on a
+/// huge page boundary and asks for transparent huge pages with MADV_HUGEPAGE. The block comes
+/// zeroed from the kernel.
+fn mapHugeBlock(len: usize) error{OutOfMemory}![]u8 {
+    const mapped_len = std.mem.alignForward(usize, len, HUGE_PAGE_SIZE);
+    const prot = posix.PROT.READ | posix.PROT.WRITE;
+    if (posix.mmap(null, mapped_len, prot, .{ .TYPE = .PRIVATE, .ANONYMOUS = true, .HUGETLB = true }, -1, 0)) |block| {
+        return block[0..len];
+    } else |_| {}
+
+    // Over-map by a huge page and trim, so the block starts on a huge page boundary
+    const raw = posix.mmap(null, mapped_len + HUGE_PAGE_SIZE, prot, .{ .TYPE = .PRIVATE, .ANONYMOUS = true }, -1, 0) catch return error.OutOfMemory;
+    const head = std.mem.alignForward(usize, @intFromPtr(raw.ptr), HUGE_PAGE_SIZE) - @intFromPtr(raw.ptr);
+    if (head != 0) posix.munmap(raw[0..head]);
+    posix.munmap(@alignCast(raw[head + mapped_len ..]));
+    const block: []align(std.heap.page_size_min) u8 = @alignCast(raw[head..][0..mapped_len]);
+    posix.madvise(block.ptr, block.len, posix.MADV.HUGEPAGE) catch {};
+    return block[0..len];
+}
+
+/// Unmap a block from `mapHugeBlock`.
+fn unmapHugeBlock(block: []u8) void {
+    const mapped: []align(std.heap.page_size_min) u8 = @alignCast(block.ptr[0..std.mem.alignForward(usize, block.len, HUGE_PAGE_SIZE)]);
+    posix.munmap(mapped);
+}
+
+/// Touch every page of `block` with a read and write of the same byte, so none faults later.
+fn prefaultBlock(block: []u8) void {
+    const page_size = std.heap.pageSize();
+    var offset: usize = 0;
+    while (offset < block.len) : (offset += page_size) {
+        const byte: *volatile u8 = &block[offset];
+        byte.* = byte.*;
+    }
+}
+
+// ============================================================================
+// Persistent Format
+// ============================================================================
+
+/// First bytes of a file written by `writeMapped`.
+pub const MAPPED_MAGIC = [8]u8{ 'V', 'Z', 'T', 'A', 'B', 'L', 'E', 0 };
+
+/// Bumped whenever the layout of mapped files changes; `Mapped.fromBytes` rejects other versions.
+pub const MAPPED_FORMAT_VERSION: u32 = 1;
+
+/// Alignment of the header and of each section of a mapped file. Mappings are page aligned,
+/// buffers handed to `Mapped.fromBytes` must be aligned to this.
+pub const MAPPED_ALIGNMENT: usize = 64;
+
+/// A string key in a mapped file: a byte range of the file's string section.
+pub const StringRef = extern struct {
+    offset: u64,
+    len: u64,
+};
+
+/// Header of a mapped file. The layout fields describe the table type that wrote the file
+/// and must match the type that maps it; the offsets locate the sections, each aligned to
+/// `MAPPED_ALIGNMENT`. Native endian, like everything else in the file.
+pub const MappedHeader = extern struct {
+    magic: [8]u8 = MAPPED_MAGIC,
+    version: u32 = MAPPED_FORMAT_VERSION,
+    bucket_size: u32,
+    key_size: u32,
+    value_size: u32,
+    /// Offsets of the key, value and hash fields in a bucket and the bucket alignment, 16 bits each
+    bucket_layout: u64,
+    meta_bits: u8,
+    frag_bits: u8,
+    /// `MAPPED_FLAG_*`
+    flags: u8,
+    big_endian: u8 = @intFromBool(builtin.cpu.arch.endian() == .big),
+    max_load: f32 = 0,
+    bucket_count: u64 = 0,
+    /// Keys in the bucket array; stash entries are counted separately
+    key_count: u64 = 0,
+    stash_count: u64 = 0,
+    /// Bucket array, value array (with `Options.separate_values`) and metadata, laid out as in memory
+    storage_offset: u64 = 0,
+    /// Stash entries as buckets, followed by their values with `Options.separate_values`
+    stash_offset: u64 = 0,
+    /// Bytes of string keys, referenced by `StringRef`s
+    strings_offset: u64 = 0,
+    strings_len: u64 = 0,
+    reserved: [5]u64 = .{0} ** 5,
+
+    /// Whether `a` and `b` were written by the same table layout.
+    fn sameLayout(a: *const MappedHeader, b: *const MappedHeader) bool {
+        return a.bucket_size == b.bucket_size and a.key_size == b.key_size and
+            a.value_size == b.value_size and a.bucket_layout == b.bucket_layout and
+            a.meta_bits == b.meta_bits and a.frag_bits == b.frag_bits and
+            a.flags == b.flags and a.big_endian == b.big_endian;
+    }
+};
+
+pub const MAPPED_FLAG_STORE_HASH: u8 = 1 << 0;
+pub const MAPPED_FLAG_SEPARATE_VALUES: u8 = 1 << 1;
+pub const MAPPED_FLAG_STRING_KEYS: u8 = 1 << 2;
+
+comptime {
+    std.debug.assert(@sizeOf(MappedHeader) == 128);
+}
+
+/// Whether values of `T` hold pointers, which can't be written to a file.
+fn containsPointers(comptime T: type) bool {
+    return switch (@typeInfo(T)) {
+        .pointer, .@"fn", .@"opaque", .@"anyframe", .frame => true,
+        .array => |info| containsPointers(info.child),
+        .vector => |info| containsPointers(info.child),
+        .optional => |info| containsPointers(info.child),
+        .error_union => |info| containsPointers(info.payload),
+        .@"struct" => |info| blk: {
+            inline for (info.fields) |field| {
+                if (containsPointers(field.type)) break :blk true;
+            }
+            break :blk false;
+        },
+        .@"union" => |info| blk: {
+            inline for (info.fields) |field| {
+                if (containsPointers(field.type)) break :blk true;
+            }
+            break :blk false;
+        },
+        else => false,
+    };
+}
+
+// ============================================================================
+// Shared Tables
+// ============================================================================
+
+/// First bytes of a shared table region (see `Shared`).
+pub const SHARED_MAGIC = [8]u8{ 'V', 'Z', 'S', 'H', 'A', 'R', 'E', 'D' };
+
+/// Control block at the start of a shared table region, followed by a table image in the
+/// mapped format at `image_offset`.
+pub const SharedControl = extern struct {
+    magic: [8]u8 = SHARED_MAGIC,
+    /// Seqlock: incremented before and after every change, so it is odd while the writer is
+    /// changing the table
+    sequence: u64 = 0,
+    image_offset: u64,
+    region_len: u64,
+};
+
+/// Offset of the table image in a shared region.
+const SHARED_IMAGE_OFFSET: usize = MAPPED_ALIGNMENT;
+
+/// Unit of the atomic copies of a `T`: as wide as its alignment allows, up to a machine word.
+fn AtomicWord(comptime T: type) type {
+    return std.meta.Int(.unsigned, 8 * @min(@alignOf(T), @sizeOf(usize)));
+}
+
+/// Copy a `T` word by word with acquire loads, so none of them can be reordered after the
+/// closing sequence check of a seqlock read.
+fn acquireCopy(comptime T: type, dest: *T, src: *const T) void {
+    const Word = AtomicWord(T);
+    const n = @sizeOf(T) / @sizeOf(Word);
+    const from: *const [n]Word = @ptrCast(@alignCast(src));
+    const to: *[n]Word = @ptrCast(@alignCast(dest));
+    for (to, from) |*word, *source| word.* = @atomicLoad(Word, source, .acquire);
+}
+
+/// Copy a `T` word by word with release stores, the writer's half of `acquireCopy`: a reader
+/// whose acquire load sees one of these words also sees the odd sequence written before it.
+fn releaseCopy(comptime T: type, dest: *T, src: *const T) void {
+    const Word = AtomicWord(T);
+    const n = @sizeOf(T) / @sizeOf(Word);
+    const from: *const [n]Word = @ptrCast(@alignCast(src));
+    const to: *[n]Word = @ptrCast(@alignCast(dest));
+    for (to, from) |*word, source| @atomicStore(Word, word, source, .release);
+}
+
+// ============================================================================
+// Change Journal
+// ============================================================================
+
+/// Kind of a journal record.
+pub const JournalOp = enum(u8) {
+    /// Key and value (nothing for sets) inserted or updated
+    put = 1,
+    /// Key removed
+    remove = 2,
+    /// All keys removed
+    clear = 3,
+};
+
+/// Records the changes made to a table with `Options.journal`, for `replay` into another table
+/// (e.g. a replica in another process). Attach one with `setJournal`; ship `bytes.items` and
+/// `reset` whenever convenient.
+///
+/// Each record is a `JournalOp` byte followed by the key and, for `put` records of maps, the
+/// value. Keys and values are their native-endian bytes. String keys are a ULEB128 length and
+/// the key bytes. Recording never fails the table operation: if appending runs out of memory,
+/// `overflowed` is set and nothing more is recorded until `reset`. A replica then has to be
+/// resynchronised from a full snapshot.
+pub const Journal = struct {
+    bytes: std.ArrayList(u8) = .empty,
+    allocator: Allocator,
+    /// Number of records in `bytes`
+    entries: usize = 0,
+    overflowed: bool = false,
+
+    pub fn init(allocator: Allocator) Journal {
+        return .{ .allocator = allocator };
+    }
+
+    pub fn deinit(self: *Journal) void {
+        self.bytes.deinit(self.allocator);
+        self.* = undefined;
+    }
+
+    /// Drop the recorded changes (keeping the buffer) and the overflow flag.
+    pub fn reset(self: *Journal) void {
+        self.bytes.clearRetainingCapacity();
+        self.entries = 0;
+        self.overflowed = false;
+    }
+
+    /// Append one record made of `parts`, all or nothing.
+    fn append(self: *Journal, parts: []const []const u8) void {
+        if (self.overflowed) return;
+        var len: usize = 0;
+        for (parts) |part| len += part.len;
+        self.bytes.ensureUnusedCapacity(self.allocator, len) catch {
+            self.overflowed = true;
+            return;
+        };
+        for (parts) |part| self.bytes.appendSliceAssumeCapacity(part);
+        self.entries += 1;
+    }
+};
+
+/// Encode `value` as ULEB128 into `buf`, returning the bytes used.
+fn encodeVarint(buf: *[10]u8, value: u64) []const u8 {
+    var rest = value;
+    var len: usize = 0;
+    while (true) {
+        const byte: u8 = @truncate(rest & 0x7F);
+        rest >>= 7;
+        if (rest == 0) {
+            buf[len] = byte;
+            return buf[0 .. len + 1];
+        }
+        buf[len] = byte | 0x80;
+        len += 1;
+    }
+}
+
+/// Decode a ULEB128 value at `pos.*` in `bytes` and advance past it.
+fn decodeVarint(bytes: []const u8, pos: *usize) error{InvalidJournal}!u64 {
+    var value: u64 = 0;
+    var shift: u32 = 0;
+    while (pos.* < bytes.len and shift < 64) : (shift += 7) {
+        const byte = bytes[pos.*];
+        pos.* += 1;
+        value |= @as(u64, byte & 0x7F) << @intCast(shift);
+        if (byte & 0x80 == 0) return value;
+    }
+    return error.InvalidJournal;
+}
+
 // ============================================================================
 // Hash Functions
 // ============================================================================
@@ -183,6 +478,16 @@ fn hashString(key: []const u8) u64 {
     return wyhash(key);
 }
 
+/// The hash function `HashMap` picks for `K`; useful with `HashMapWithOptions`.
+pub fn autoHash(comptime K: type) fn (K) u64 {
+    return AutoHashFn(K).hash;
+}
+
+/// The equality function `HashMap` picks for `K`; useful with `HashMapWithOptions`.
+pub fn autoEql(comptime K: type) fn (K, K) bool {
+    return AutoEqlFn(K).eql;
+}
+
 fn AutoEqlFn(comptime K: type) type {
     return struct {
         fn eql(a: K, b: K) bool {
@@ -201,37 +506,75 @@ fn AutoEqlFn(comptime K: type) type {
 }
 
 // ============================================================================
-// Metadata Helpers
+// Metadata Layout
 // ============================================================================
 
-/// Extracts the high HASH_FRAG_SIZE_BITS bits of the hash and places them into the fragment position.
-inline fn hashFrag(hash: u64) MetaType {
-    return @as(MetaType, @truncate(hash >> (64 - HASH_FRAG_SIZE_BITS))) << (16 - HASH_FRAG_SIZE_BITS);
+/// Per-bucket metadata word of `Word` (u8, u16 or u32) bits:
+/// `frag_bits`-bit hash fragment | 1-bit home flag | displacement in the remaining bits.
+/// Wider fragments filter more key comparisons; a wider displacement allows longer chains
+/// before an insert overflows and forces the table to grow.
+pub fn MetaLayout(comptime Word: type, comptime frag_bits: usize) type {
+    const bits = @bitSizeOf(Word);
+
+    comptime {
+        if (Word != u8 and Word != u16 and Word != u32) @compileError("Metadata must be u8, u16 or u32, not " ++ @typeName(Word));
+        if (frag_bits < 1) @compileError("Metadata needs at least one hash fragment bit");
+        // At least 3 displacement bits, so an empty bucket up to 6 slots past home can still be linked
+        if (frag_bits + 1 + 3 > bits) @compileError("Too many hash fragment bits for the metadata width");
+    }
+
+    return struct {
+        pub const Type = Word;
+        pub const BITS = bits;
+        pub const FRAG_BITS = frag_bits;
+
+        /// Empty bucket marker
+        pub const EMPTY: Word = 0;
+
+        pub const HASH_FRAG_MASK: Word = @as(Word, @truncate(((@as(u64, 1) << frag_bits) - 1) << (bits - frag_bits)));
+
+        pub const IN_HOME_BUCKET_MASK: Word = @as(Word, 1) << (bits - 1 - frag_bits);
+
+        pub const DISPLACEMENT_MASK: Word = (@as(Word, 1) << (bits - 1 - frag_bits)) - 1;
+
+        /// Marks an entry that in-place growth has not redistributed yet: occupied, but in no chain.
+        /// Chains never link with displacement 0, so this can't collide with a live entry.
+        pub const PENDING: Word = HASH_FRAG_MASK;
+
+        /// Metadata entries per 64-bit word read by the iterator.
+        pub const PER_U64 = 64 / bits;
+
+        /// Extracts the high `frag_bits` bits of the hash and places them into the fragment position.
+        pub inline fn hashFrag(hash: u64) Word {
+            return @as(Word, @truncate(hash >> (64 - frag_bits))) << (bits - frag_bits);
+        }
+
+        /// Find the first non-zero entry in a group of `PER_U64` (64 bits, little endian).
+        /// Used for fast iteration over metadata.
+        pub inline fn firstNonZero(val: u64) u32 {
+            if (val == 0) return PER_U64;
+            return @ctz(val) / bits;
+        }
+
+        /// Metadata entries per `occupiedMask` vector compare (a cache line of 16-bit metadata).
+        pub const GROUP = 32;
+
+        /// Bit i is set when `metadata[i]` is occupied, for `GROUP` entries.
+        /// Used by the iterator to skip empty runs and to batch up occupied buckets.
+        pub inline fn occupiedMask(metadata: [*]const Word) u32 {
+            const vec: @Vector(GROUP, Word) = metadata[0..GROUP].*;
+            const zero: @Vector(GROUP, Word) = @splat(EMPTY);
+            return @bitCast(vec != zero);
+        }
+    };
 }
 
 /// Linear probing - displacement IS the offset.
 /// Better cache locality than quadratic, and with chain-based design we avoid clustering issues.
-inline fn probeOffset(displacement: MetaType) usize {
+inline fn probeOffset(displacement: anytype) usize {
     return displacement;
 }
 
-/// Find the first non-zero u16 in a group of 4 (64 bits).
-/// Used for fast iteration over metadata.
-inline fn firstNonZeroMeta(val: u64) u32 {
-    if (val == 0) return 4;
-    return @ctz(val) / 16;
-}
-
-/// SIMD-accelerated version: find first non-zero u16 in 8 metadata entries
-inline fn firstNonZeroMetax8(metadata: [*]const MetaType) u32 {
-    const vec: @Vector(8, MetaType) = metadata[0..8].*;
-    const zero: @Vector(8, MetaType) = @splat(0);
-    const mask = vec != zero;
-    const bits = @as(u8, @bitCast(mask));
-    if (bits == 0) return 8;
-    return @ctz(bits);
-}
-
 // ============================================================================
 // HashMap
 // ============================================================================
@@ -266,76 +609,394 @@ pub fn HashMapWithFns(
     comptime V: type,
     comptime hashFn: fn (K) u64,
     comptime eqlFn: fn (K, K) bool,
+) type {
+    return HashMapWithOptions(K, V, hashFn, eqlFn, .{});
+}
+
+/// Compile-time configuration for `HashMapWithOptions`.
+/// The defaults reproduce `HashMap`/`HashMapWithFns`.
+pub const Options = struct {
+    /// Store each key's full 64-bit hash in its bucket (+8 bytes per bucket).
+    /// Rehash, eviction and erasure then never call `hashFn`, and lookups/inserts reject
+    /// fragment collisions with a hash compare before calling `eqlFn`.
+    /// Worth it when `hashFn` or `eqlFn` is expensive (strings, composite keys).
+    /// `null` picks the default: enabled for `[]const u8` keys only.
+    store_hash: ?bool = null,
+
+    /// Grow incrementally instead of stop-the-world.
+    /// When the table needs to grow, the new allocation is created and the old one is kept
+    /// alongside it; every insert and remove then moves the keys of `resize_step` old home
+    /// buckets across until the old allocation is empty and freed. This bounds the work of
+    /// any single insert, at the cost of lookups checking both allocations while a resize is
+    /// in progress and both allocations being live at once.
+    /// `reserve`, `shrink` and `rehash`-style operations still complete the resize in one go.
+    incremental_resize: bool = false,
+
+    /// Grow by extending the existing allocation with `Allocator.remap` (mremap on Linux with
+    /// the page or C allocator) and redistributing keys inside it, instead of copying into a
+    /// fresh allocation. Peak memory while doubling drops from about 3x to 2x the old table.
+    /// A block for the fallback on displacement overflow is reserved for the duration but not
+    /// touched unless needed, so with mmap-backed allocators it costs address space, not memory.
+    /// Falls back to a regular rehash when the allocator can't remap.
+    grow_in_place: bool = false,
+
+    /// Old home buckets migrated per insert/remove during an incremental resize.
+    /// Larger values finish the resize sooner; if the new allocation fills up before the old
+    /// one is drained, the remainder is migrated in one go.
+    resize_step: usize = 32,
+
+    /// Size of the overflow stash (0 disables it).
+    /// A key that can't be placed within `DISPLACEMENT_MASK` of its home bucket (clustered
+    /// hashes, or a small displacement field from many fragment bits) normally forces the
+    /// table to double regardless of load. With a stash, up to this many such keys are kept
+    /// in a small array inside the table struct instead, so growth is driven by `max_load`
+    /// alone until the stash itself fills up. Lookups only scan the stash on a miss, and
+    /// only while it is non-empty.
+    stash_capacity: usize = 0,
+
+    /// Let rehashes run on a `std.Thread.Pool` set with `setRehashPool`. Rehashes of tables with
+    /// at least `MIN_PARALLEL_REHASH_KEYS` keys - growth, `reserve`, `shrink` - then split the old
+    /// buckets into contiguous ranges, hash them on the pool and insert the keys partition by
+    /// partition, like `fromSlices`. Costs scratch memory of about 16 bytes per old bucket during
+    /// the rehash and a pointer in the table struct.
+    parallel_rehash: bool = false,
+
+    /// Store values in their own array, behind the key array in the same allocation, instead of
+    /// next to each key. Chain walks and misses then only touch key (and hash) cache lines and a
+    /// hit loads a single value line at the end, which pays off for large values. Buckets then
+    /// hold no `val`: iterate with `Iterator.nextEntry` or `valueIterator`. No effect on sets.
+    separate_values: bool = false,
+
+    /// Keep values densely packed in insertion order in a separate growable array, with each
+    /// bucket holding only the key and a u32 index into it. Rehashing then moves small buckets
+    /// instead of values, and `valueIterator`/`denseValues` walk a contiguous array instead of
+    /// scanning sparse buckets. Costs an index indirection per lookup hit and, on remove, one
+    /// extra lookup to repoint the entry moved into the freed slot. No effect on sets; can't be
+    /// combined with `separate_values`.
+    dense_values: bool = false,
+
+    /// Map storage blocks of at least `HUGE_PAGE_SIZE` directly on huge pages instead of taking
+    /// them from the allocator: MAP_HUGETLB when huge pages are reserved, otherwise a huge-page
+    /// aligned mapping with MADV_HUGEPAGE for transparent huge pages. Random lookups into tables
+    /// of hundreds of MB then miss the TLB far less often. Fresh mappings come zeroed from the
+    /// kernel, so their metadata isn't cleared on allocation, and pages are faulted in on first
+    /// touch unless the table is `prefault`ed. Mapped tables don't grow in place. Linux only;
+    /// elsewhere the allocator is used as usual.
+    huge_pages: bool = false,
+
+    /// Record inserts, removals and clears in a `Journal` attached with `setJournal`, for
+    /// `replay` into a replica. Values set through a `getOrPut` pointer are recorded at the
+    /// next change or `syncJournal`; other writes through value pointers are not recorded.
+    journal: bool = false,
+
+    /// Keep a flag per 4 KiB page of metadata that is set when a key is placed in it, so that
+    /// `clear` only resets the pages written since the last clear. A large table that is
+    /// cleared and refilled with a few keys over and over (a reused scratch set) then pays for
+    /// the keys it held instead of its capacity. Costs a byte store per insert and a byte per
+    /// page in the allocation.
+    track_dirty_pages: bool = false,
+
+    /// Write buckets and metadata with word-sized atomic release stores, so that readers in
+    /// other threads or processes can copy them under a seqlock while the table changes. The
+    /// writer of a `Shared` table uses it; there is no reason to set it otherwise. Can't be
+    /// combined with `incremental_resize`, `stash_capacity`, `dense_values` or `track_dirty_pages`.
+    atomic_stores: bool = false,
+
+    /// Width of each bucket's metadata word in bits: 8, 16 or 32 (see `MetaLayout`).
+    /// 8-bit metadata halves the metadata bandwidth of lookups and iteration but leaves room for
+    /// only short chains: at high load they overflow the displacement limit often enough to cost
+    /// extra doublings, so it pays off with a lower `setMaxLoadFactor` or a stash. 32-bit
+    /// metadata allows wide fragments and very long chains. `null` picks the default, 16.
+    meta_bits: ?u16 = null,
+
+    /// Hash fragment bits in the metadata word; the displacement gets the rest minus the home flag.
+    /// `null` picks the default: 6 for string keys, `HASH_FRAG_SIZE_BITS` for other keys with
+    /// 16-bit metadata, 1 with 8-bit and 12 with 32-bit metadata.
+    hash_frag_bits: ?u16 = null,
+};
+
+/// Create a hash table with custom hash/equality functions and compile-time `Options`.
+///
+/// ## Example
+/// ```zig
+/// // Composite key with a costly hash: cache it in the bucket
+/// const Map = HashMapWithOptions(Key, u32, Key.hash, Key.eql, .{ .store_hash = true });
+/// ```
+pub fn HashMapWithOptions(
+    comptime K: type,
+    comptime V: type,
+    comptime hashFn: fn (K) u64,
+    comptime eqlFn: fn (K, K) bool,
+    comptime options: Options,
 ) type {
     const is_set = V == void;
 
     return struct {
         const Self = @This();
 
-        // For string keys, store full hash to avoid expensive comparisons
+        // For string keys, store full hash by default to avoid expensive comparisons
         const is_string = @typeInfo(K) == .pointer and @typeInfo(K).pointer.size == .slice and @typeInfo(K).pointer.child == u8;
+        const store_hash = options.store_hash orelse is_string;
+        const incremental = options.incremental_resize;
+        const stash_enabled = options.stash_capacity > 0;
+        const separate_values = options.separate_values and !is_set;
+        const dense_values = options.dense_values and !is_set;
+
+        const meta_bits = options.meta_bits orelse 16;
+        const frag_bits = options.hash_frag_bits orelse switch (meta_bits) {
+            8 => 1,
+            32 => 12,
+            else => if (is_string) 6 else HASH_FRAG_SIZE_BITS,
+        };
+
+        /// This table type's metadata layout.
+        pub const Meta = MetaLayout(std.meta.Int(.unsigned, meta_bits), frag_bits);
+        pub const MetaType = Meta.Type;
+        pub const HASH_FRAG_MASK = Meta.HASH_FRAG_MASK;
+        pub const IN_HOME_BUCKET_MASK = Meta.IN_HOME_BUCKET_MASK;
+        pub const DISPLACEMENT_MASK = Meta.DISPLACEMENT_MASK;
+        const EMPTY = Meta.EMPTY;
+        const PENDING = Meta.PENDING;
+        const hashFrag = Meta.hashFrag;
+
+        const track_dirty = options.track_dirty_pages;
+        const journaling = options.journal;
+        const atomic_stores = options.atomic_stores;
+        const huge_pages = options.huge_pages and builtin.os.tag == .linux;
+        /// Buckets per `Options.track_dirty_pages` page: 4 KiB of metadata.
+        const DIRTY_PAGE_BUCKETS = 4096 / @sizeOf(MetaType);
+
+        comptime {
+            if (incremental and options.resize_step == 0) @compileError("Options.resize_step must be at least 1");
+            if (incremental and options.grow_in_place) @compileError("Options.incremental_resize and Options.grow_in_place are mutually exclusive");
+            if (options.separate_values and options.dense_values) @compileError("Options.separate_values and Options.dense_values are mutually exclusive");
+            if (atomic_stores and (incremental or stash_enabled or dense_values or track_dirty)) @compileError("Options.atomic_stores doesn't support incremental_resize, stash_capacity, dense_values or track_dirty_pages");
+        }
 
-        /// Bucket contains key and optionally value
-        pub const Bucket = if (is_set) struct {
+        /// Bucket contains key and optionally value (kept apart with `Options.separate_values`,
+        /// or replaced by an index into the dense value array with `Options.dense_values`)
+        pub const Bucket = if (dense_values) struct {
+            key: K,
+            // Index of the key's entry in `dense`
+            idx: u32,
+            full_hash: if (store_hash) u64 else void = if (store_hash) 0 else {},
+        } else if (is_set or separate_values) struct {
             key: K,
-            // Store full hash for string keys to avoid expensive memcmp
-            full_hash: if (is_string) u64 else void = if (is_string) 0 else {},
+            // Cached full hash (see `Options.store_hash`)
+            full_hash: if (store_hash) u64 else void = if (store_hash) 0 else {},
         } else struct {
             key: K,
             val: V,
-            full_hash: if (is_string) u64 else void = if (is_string) 0 else {},
+            full_hash: if (store_hash) u64 else void = if (store_hash) 0 else {},
         };
 
         /// Iterator for traversing the table using SIMD-accelerated scanning.
+        /// Visits the buckets, then the old allocation during an incremental resize, then the stash.
         pub const Iterator = struct {
             table: *const Self,
             index: usize,
             end_index: usize,
+            segment: Segment = .buckets,
+            /// Bucket range of an `iteratorRange`. Only the range that reaches the end of the
+            /// bucket array goes on to the draining allocation and the stash.
+            range_begin: usize = 0,
+            range_end: usize = math.maxInt(usize),
+
+            const Segment = enum { buckets, draining, stash };
 
             pub fn next(self: *Iterator) ?*const Bucket {
-                if (self.index >= self.end_index) return null;
+                const i = self.advance() orelse return null;
+                return self.bucketAt(i);
+            }
+
+            /// Mutable iterator for modifying values
+            pub fn nextMut(self: *Iterator, table: *Self) ?*Bucket {
+                std.debug.assert(self.table == table);
+                const i = self.advance() orelse return null;
+                return self.bucketAt(i);
+            }
+
+            /// Next key and value, whatever the bucket layout (see `Options.separate_values`).
+            pub fn nextEntry(self: *Iterator) ?Entry {
+                if (is_set) @compileError("Sets don't have values");
+                const i = self.advance() orelse return null;
+                return .{ .key_ptr = &self.bucketAt(i).key, .value_ptr = self.slotValue(i) };
+            }
 
-                // Fast-forward to next non-empty bucket using SIMD
-                self.fastForward();
+            /// Move to the next occupied slot and return its index within the current segment.
+            inline fn advance(self: *Iterator) ?usize {
+                while (true) {
+                    if (self.index < self.end_index) {
+                        if (stash_enabled) {
+                            if (self.segment == .stash) {
+                                self.index += 1;
+                                return self.index - 1;
+                            }
+                        }
 
-                if (self.index >= self.end_index) return null;
+                        // Fast-forward to next non-empty bucket using SIMD
+                        self.fastForward();
 
-                const i = self.index;
-                self.index += 1;
-                return &self.table.buckets[i];
+                        if (self.index < self.end_index) {
+                            self.index += 1;
+                            return self.index - 1;
+                        }
+                    }
+
+                    if (!self.nextSegment()) return null;
+                }
             }
 
-            /// Mutable iterator for modifying values
-            pub fn nextMut(self: *Iterator, table: *Self) ?*Bucket {
-                if (self.index >= self.end_index) return null;
+            inline fn bucketAt(self: *const Iterator, i: usize) *Bucket {
+                if (stash_enabled) {
+                    // Stash entries live in the table struct; only `nextMut` hands them out mutably
+                    if (self.segment == .stash) return @constCast(&self.table.stash.entries[i]);
+                }
+                return &self.segmentBuckets()[i];
+            }
+
+            inline fn slotValue(self: *const Iterator, i: usize) *V {
+                if (stash_enabled) {
+                    if (self.segment == .stash) return self.table.stashValue(i);
+                }
+                if (incremental) {
+                    if (self.segment == .draining) return self.table.drainingView().valueAt(i);
+                }
+                return self.table.valueAt(i);
+            }
+
+            fn nextSegment(self: *Iterator) bool {
+                if (self.range_end < self.table.bucketCount()) return false;
+                if (incremental) {
+                    if (self.segment == .buckets) {
+                        if (self.table.draining) |old| {
+                            self.segment = .draining;
+                            self.index = 0;
+                            self.end_index = old.buckets_mask + 1;
+                            return true;
+                        }
+                    }
+                }
+                if (stash_enabled) {
+                    if (self.segment != .stash) {
+                        self.segment = .stash;
+                        self.index = 0;
+                        self.end_index = self.table.stash.len;
+                        return true;
+                    }
+                }
+                return false;
+            }
 
-                // Fast-forward to next non-empty bucket using SIMD
-                self.fastForward();
+            inline fn segmentBuckets(self: *const Iterator) [*]Bucket {
+                if (incremental) {
+                    if (self.segment == .draining) return self.table.draining.?.buckets;
+                }
+                return self.table.buckets;
+            }
 
-                if (self.index >= self.end_index) return null;
+            inline fn segmentMetadata(self: *const Iterator) [*]const MetaType {
+                if (incremental) {
+                    if (self.segment == .draining) return self.table.draining.?.metadata;
+                }
+                return self.table.metadata;
+            }
 
-                const i = self.index;
-                self.index += 1;
-                return &table.buckets[i];
+            /// Fill `out` with the next occupied buckets and return the filled part, which is
+            /// shorter than `out` only once the iterator is exhausted. Finds occupied buckets
+            /// `Meta.GROUP` at a time with one vector compare and prefetches all of a group's
+            /// occupied buckets before handing out the first, so sparse tables and consumers that
+            /// touch every bucket wait on a group's lines together instead of one at a time. The
+            /// next group isn't prefetched until the batch reaches it.
+            pub fn nextBatch(self: *Iterator, out: []*const Bucket) []*const Bucket {
+                return self.fillBatch(*const Bucket, out, batchBucket);
+            }
+
+            /// `nextBatch` yielding keys and values, whatever the bucket layout (see `nextEntry`).
+            pub fn nextEntryBatch(self: *Iterator, out: []Entry) []Entry {
+                if (is_set) @compileError("Sets don't have values");
+                return self.fillBatch(Entry, out, batchEntry);
+            }
+
+            fn batchBucket(self: *const Iterator, i: usize) *const Bucket {
+                return self.bucketAt(i);
+            }
+
+            fn batchEntry(self: *const Iterator, i: usize) Entry {
+                return .{ .key_ptr = &self.bucketAt(i).key, .value_ptr = self.slotValue(i) };
+            }
+
+            inline fn fillBatch(self: *Iterator, comptime T: type, out: []T, comptime item: fn (*const Iterator, usize) T) []T {
+                var n: usize = 0;
+                while (n < out.len) {
+                    if (self.index >= self.end_index) {
+                        if (!self.nextSegment()) break;
+                        continue;
+                    }
+                    if (stash_enabled) {
+                        if (self.segment == .stash) {
+                            out[n] = item(self, self.index);
+                            n += 1;
+                            self.index += 1;
+                            continue;
+                        }
+                    }
+
+                    if (self.index + Meta.GROUP <= self.end_index) {
+                        var mask = Meta.occupiedMask(self.segmentMetadata() + self.index);
+                        if (mask == 0) {
+                            self.index += Meta.GROUP;
+                            continue;
+                        }
+                        // Start loading the whole group before the caller touches the first bucket
+                        const buckets = self.segmentBuckets() + self.index;
+                        var ahead = mask;
+                        while (ahead != 0) : (ahead &= ahead - 1) @prefetch(&buckets[@ctz(ahead)], .{});
+
+                        while (mask != 0 and n < out.len) : (mask &= mask - 1) {
+                            out[n] = item(self, self.index + @ctz(mask));
+                            n += 1;
+                        }
+                        // Resume at the first bucket not handed out, if the batch filled mid-group
+                        self.index += if (mask == 0) Meta.GROUP else @ctz(mask);
+                    } else {
+                        if (self.segmentMetadata()[self.index] != EMPTY) {
+                            out[n] = item(self, self.index);
+                            n += 1;
+                        }
+                        self.index += 1;
+                    }
+                }
+                return out[0..n];
             }
 
             /// Fast scan for next occupied bucket.
-            /// Scans 4 metadata entries at a time using u64 reads for efficiency.
+            /// Skips `Meta.GROUP` metadata entries per vector compare, then the rest of the
+            /// segment `Meta.PER_U64` at a time using u64 reads.
             inline fn fastForward(self: *Iterator) void {
-                const metadata = self.table.metadata;
+                const metadata = self.segmentMetadata();
                 const end = self.end_index;
 
-                // Scan 4 buckets at a time using u64 reads
-                while (self.index + 4 <= end) {
+                while (self.index + Meta.GROUP <= end) {
+                    const mask = Meta.occupiedMask(metadata + self.index);
+                    if (mask != 0) {
+                        self.index += @ctz(mask);
+                        return;
+                    }
+                    self.index += Meta.GROUP;
+                }
+
+                // Scan a u64 worth of buckets at a time (4 with 16-bit metadata)
+                while (self.index + Meta.PER_U64 <= end) {
                     const ptr: [*]const u8 = @ptrCast(metadata + self.index);
                     // Use unaligned read to avoid alignment issues
                     const group: u64 = std.mem.readInt(u64, ptr[0..8], .little);
-                    const offset = firstNonZeroMeta(group);
-                    if (offset < 4) {
+                    const offset = Meta.firstNonZero(group);
+                    if (offset < Meta.PER_U64) {
                         self.index += offset;
                         return;
                     }
-                    self.index += 4;
+                    self.index += Meta.PER_U64;
                 }
 
                 // Scan remaining buckets one at a time
@@ -345,19 +1006,70 @@ pub fn HashMapWithFns(
                 }
             }
 
-            /// Reset iterator to beginning
+            /// Reset iterator to beginning (of its range)
             pub fn reset(self: *Iterator) void {
-                self.index = 0;
+                self.index = self.range_begin;
+                self.end_index = @min(self.range_end, self.table.bucketCount());
+                self.segment = .buckets;
             }
         };
 
+        /// The previous allocation while an incremental resize drains it.
+        /// Keys whose old home bucket is below `migrate_index` have all been moved out.
+        const DrainingTable = struct {
+            buckets: [*]Bucket,
+            values: Values,
+            metadata: [*]MetaType,
+            buckets_mask: usize,
+            key_count: usize,
+            migrate_index: usize,
+        };
+
+        /// Keys that didn't fit within `DISPLACEMENT_MASK` of their home (see `Options.stash_capacity`).
+        const Stash = if (stash_enabled) struct {
+            len: usize = 0,
+            entries: [options.stash_capacity]Bucket = undefined,
+            values: if (separate_values) [options.stash_capacity]V else void = undefined,
+        } else void;
+
+        /// The value array with `Options.separate_values`, behind the buckets in the same allocation.
+        const Values = if (separate_values) [*]V else void;
+
+        /// Key/value entries in insertion order (modulo removals) with `Options.dense_values`.
+        /// The key copy lets a remove find the bucket of the entry it moves into the freed slot.
+        const Dense = if (dense_values) std.MultiArrayList(struct { key: K, value: V }) else void;
+
+        /// The thread pool for rehashes with `Options.parallel_rehash`.
+        const RehashPool = if (options.parallel_rehash) ?*std.Thread.Pool else void;
+
+        /// The attached journal with `Options.journal`, and the key of the last non-replacing
+        /// insert, whose value the caller fills in after the insert returns.
+        const JournalState = if (journaling) struct {
+            log: ?*Journal = null,
+            pending: ?K = null,
+            pending_hash: u64 = 0,
+        } else void;
+
+        /// What an insert stores in the bucket besides the key: the value, or with
+        /// `Options.dense_values` the index of the value in `dense`.
+        const Payload = if (dense_values) u32 else V;
+
+        /// Stands in for the value of a set entry, so lookups can hand out a value pointer either way.
+        var set_value: void = {};
+
         // Fields
         key_count: usize,
         buckets_mask: usize, // bucket_count - 1 (for fast masking), or 0 if empty
         buckets: [*]Bucket,
+        values: Values,
         metadata: [*]MetaType,
         allocator: Allocator,
         max_load: f32,
+        draining: if (incremental) ?DrainingTable else void,
+        stash: Stash,
+        dense: Dense,
+        rehash_pool: RehashPool,
+        journal: JournalState,
 
         // Placeholder for empty tables (avoids null checks)
         var empty_placeholder: [1]MetaType = .{EMPTY};
@@ -368,20 +1080,40 @@ pub fn HashMapWithFns(
                 .key_count = 0,
                 .buckets_mask = 0,
                 .buckets = undefined,
+                .values = undefined,
                 .metadata = &empty_placeholder,
                 .allocator = allocator,
                 .max_load = DEFAULT_MAX_LOAD,
+                .draining = if (incremental) null else {},
+                .stash = if (stash_enabled) .{} else {},
+                .dense = if (dense_values) .{} else {},
+                .rehash_pool = if (options.parallel_rehash) null else {},
+                .journal = if (journaling) .{} else {},
             };
         }
 
         /// Deinitialize and free all memory.
         pub fn deinit(self: *Self) void {
+            if (incremental) self.freeDraining();
+            if (dense_values) self.dense.deinit(self.allocator);
+            self.freeStorage();
+            self.* = Self.init(self.allocator);
+        }
+
+        /// Touch every page of the table's storage now, so that inserts and lookups in a
+        /// latency-critical phase don't take page faults. Mostly useful with
+        /// `Options.huge_pages`, where storage is only faulted in on first touch.
+        pub fn prefault(self: *const Self) void {
             if (self.buckets_mask != 0) {
-                const alloc_size = self.totalAllocSize();
-                const ptr: [*]u8 = @ptrCast(self.buckets);
-                self.allocator.free(ptr[0..alloc_size]);
+                const base: [*]u8 = @ptrCast(self.buckets);
+                prefaultBlock(base[0..self.totalAllocSize()]);
+            }
+            if (incremental) {
+                if (self.draining) |old| {
+                    const old_base: [*]u8 = @ptrCast(old.buckets);
+                    prefaultBlock(old_base[0..self.totalAllocSizeForCount(old.buckets_mask + 1)]);
+                }
             }
-            self.* = Self.init(self.allocator);
         }
 
         /// Set the maximum load factor (0.0 to 1.0).
@@ -392,7 +1124,10 @@ pub fn HashMapWithFns(
 
         /// Returns the number of keys in the table.
         pub fn count(self: *const Self) usize {
-            return self.key_count;
+            if (incremental) {
+                if (self.draining) |old| return self.key_count + old.key_count + self.stashLen();
+            }
+            return self.key_count + self.stashLen();
         }
 
         /// Returns the current bucket count.
@@ -423,18 +1158,28 @@ pub fn HashMapWithFns(
             return result.inserted;
         }
 
+        /// `put` for a table with room for the key, e.g. after `ensureUnusedCapacity`.
+        /// Skips the load check and the growth retry loop. Capacity bounds the load, not the
+        /// length of chains, so a key that overflows the displacement limit (and the stash, if
+        /// any) still doubles the table: the one case in which this allocates, and panics only
+        /// if that allocation fails.
+        pub fn putAssumeCapacity(self: *Self, key: K, value: V) void {
+            if (is_set) @compileError("Use addAssumeCapacity() for sets");
+            _ = self.insertAssumeCapacity(key, hashFn(key), value, true);
+        }
+
         /// Get the value associated with a key, or null if not found.
         pub fn get(self: *const Self, key: K) ?V {
             if (is_set) @compileError("Use contains() for sets");
-            const bucket = self.getBucket(key) orelse return null;
-            return bucket.val;
+            const slot = self.getSlot(key) orelse return null;
+            return slot.val.*;
         }
 
         /// Get a pointer to the value for modification.
         pub fn getPtr(self: *Self, key: K) ?*V {
             if (is_set) @compileError("Use contains() for sets");
-            const bucket = self.getBucketMut(key) orelse return null;
-            return &bucket.val;
+            const slot = self.getSlot(key) orelse return null;
+            return slot.val;
         }
 
         /// Get or insert - returns a pointer to the value, inserting a default if not present.
@@ -443,7 +1188,17 @@ pub fn HashMapWithFns(
             if (is_set) @compileError("Use add() for sets");
             const result = try self.insertInternal(key, undefined, false, false);
             return .{
-                .value_ptr = &self.buckets[result.bucket_idx].val,
+                .value_ptr = result.val,
+                .found_existing = !result.inserted,
+            };
+        }
+
+        /// `getOrPut` for a table with room for the key; see `putAssumeCapacity`.
+        pub fn getOrPutAssumeCapacity(self: *Self, key: K) GetOrPutResult {
+            if (is_set) @compileError("Use addAssumeCapacity() for sets");
+            const result = self.insertAssumeCapacity(key, hashFn(key), undefined, false);
+            return .{
+                .value_ptr = result.val,
                 .found_existing = !result.inserted,
             };
         }
@@ -457,8 +1212,8 @@ pub fn HashMapWithFns(
         /// Get the key-value entry, or null if not found.
         pub fn getEntry(self: *const Self, key: K) ?Entry {
             if (is_set) @compileError("Use contains() for sets");
-            const bucket = self.getBucket(key) orelse return null;
-            return .{ .key_ptr = &bucket.key, .value_ptr = &bucket.val };
+            const slot = self.getSlot(key) orelse return null;
+            return .{ .key_ptr = &slot.bucket.key, .value_ptr = slot.val };
         }
 
         /// Entry type containing pointers to both key and value
@@ -467,6 +1222,41 @@ pub fn HashMapWithFns(
             value_ptr: *const V,
         };
 
+        /// Look up many keys at once, writing `get(keys[i])` into `values_out[i]`.
+        /// Returns the number of keys found. `values_out.len` must be >= `keys.len`.
+        ///
+        /// Keys are processed in groups of `DEFAULT_LOOKUP_BATCH_SIZE`: every key in a group is
+        /// hashed and its home bucket prefetched before any chain is walked, so the cache misses
+        /// of independent keys overlap instead of serializing. Pays off once the table is larger
+        /// than the last-level cache; for small tables plain `get` is just as fast.
+        pub fn getMany(self: *const Self, keys: []const K, values_out: []?V) usize {
+            return self.getManyBatched(DEFAULT_LOOKUP_BATCH_SIZE, keys, values_out);
+        }
+
+        /// Like `getMany`, with an explicit number of keys in flight per group.
+        pub fn getManyBatched(self: *const Self, comptime batch_size: usize, keys: []const K, values_out: []?V) usize {
+            if (is_set) @compileError("Use containsMany() for sets");
+            std.debug.assert(values_out.len >= keys.len);
+
+            var found: usize = 0;
+            var start: usize = 0;
+            while (start < keys.len) : (start += batch_size) {
+                const group = keys[start..@min(start + batch_size, keys.len)];
+                var found_slots: [batch_size]?Slot = undefined;
+                self.findBatch(batch_size, group, &found_slots);
+
+                for (found_slots[0..group.len], values_out[start..][0..group.len]) |maybe_slot, *out| {
+                    if (maybe_slot) |slot| {
+                        out.* = slot.val.*;
+                        found += 1;
+                    } else {
+                        out.* = null;
+                    }
+                }
+            }
+            return found;
+        }
+
         // ====================================================================
         // Set operations (when V == void)
         // ====================================================================
@@ -477,9 +1267,124 @@ pub fn HashMapWithFns(
             _ = try self.insertInternal(key, {}, false, true);
         }
 
+        /// `add` for a set with room for the key; see `putAssumeCapacity`.
+        pub fn addAssumeCapacity(self: *Self, key: K) void {
+            if (!is_set) @compileError("Use putAssumeCapacity() for maps");
+            _ = self.insertAssumeCapacity(key, hashFn(key), {}, true);
+        }
+
         /// Check if a key exists in the set.
         pub fn contains(self: *const Self, key: K) bool {
-            return self.getBucket(key) != null;
+            return self.getSlot(key) != null;
+        }
+
+        /// Check many keys at once, writing `contains(keys[i])` into `found_out[i]`.
+        /// Returns the number of keys found. `found_out.len` must be >= `keys.len`.
+        /// Uses the same group prefetching as `getMany`.
+        pub fn containsMany(self: *const Self, keys: []const K, found_out: []bool) usize {
+            return self.containsManyBatched(DEFAULT_LOOKUP_BATCH_SIZE, keys, found_out);
+        }
+
+        /// Like `containsMany`, with an explicit number of keys in flight per group.
+        pub fn containsManyBatched(self: *const Self, comptime batch_size: usize, keys: []const K, found_out: []bool) usize {
+            std.debug.assert(found_out.len >= keys.len);
+
+            var found: usize = 0;
+            var start: usize = 0;
+            while (start < keys.len) : (start += batch_size) {
+                const group = keys[start..@min(start + batch_size, keys.len)];
+                var found_slots: [batch_size]?Slot = undefined;
+                self.findBatch(batch_size, group, &found_slots);
+
+                for (found_slots[0..group.len], found_out[start..][0..group.len]) |maybe_slot, *out| {
+                    out.* = maybe_slot != null;
+                    found += @intFromBool(maybe_slot != null);
+                }
+            }
+            return found;
+        }
+
+        // ====================================================================
+        // Precomputed-hash operations
+        // ====================================================================
+        //
+        // Each `*WithHash` function behaves exactly like its plain counterpart but takes
+        // `hash == hashKey(key)` from the caller instead of computing it. This lets a key be
+        // hashed once and probed against several tables of the same type, or be hashed ahead
+        // of time alongside `prefetch` in a caller-side pipeline.
+        // Passing a hash that differs from `hashKey(key)` is checked in Debug builds only (it
+        // rehashes the key, which ReleaseSafe callers are using these functions to avoid) and
+        // otherwise leaves the table in an unspecified (but memory-safe) state.
+
+        /// The hash this table type uses for `key`.
+        pub fn hashKey(key: K) u64 {
+            return hashFn(key);
+        }
+
+        /// Hint the CPU to start loading the metadata and home bucket for `hash`.
+        /// Issue a few lookups ahead of the corresponding `*WithHash` call to hide memory latency.
+        pub fn prefetch(self: *const Self, hash: u64) void {
+            if (self.buckets_mask == 0) return;
+            const home_bucket = hash & self.buckets_mask;
+            @prefetch(&self.metadata[home_bucket], .{ .rw = .read });
+            @prefetch(&self.buckets[home_bucket], .{ .rw = .read });
+        }
+
+        /// `get` with a precomputed hash.
+        pub fn getWithHash(self: *const Self, key: K, hash: u64) ?V {
+            if (is_set) @compileError("Use containsWithHash() for sets");
+            checkHash(key, hash);
+            const slot = self.findHashed(key, hash) orelse return null;
+            return slot.val.*;
+        }
+
+        /// `getPtr` with a precomputed hash.
+        pub fn getPtrWithHash(self: *Self, key: K, hash: u64) ?*V {
+            if (is_set) @compileError("Use containsWithHash() for sets");
+            checkHash(key, hash);
+            const slot = self.findHashed(key, hash) orelse return null;
+            return slot.val;
+        }
+
+        /// `contains` with a precomputed hash.
+        pub fn containsWithHash(self: *const Self, key: K, hash: u64) bool {
+            checkHash(key, hash);
+            return self.findHashed(key, hash) != null;
+        }
+
+        /// `put` with a precomputed hash.
+        pub fn putWithHash(self: *Self, key: K, value: V, hash: u64) !void {
+            if (is_set) @compileError("Use addWithHash() for sets");
+            checkHash(key, hash);
+            _ = try self.insertInternalHashed(key, hash, value, false, true);
+        }
+
+        /// `add` with a precomputed hash.
+        pub fn addWithHash(self: *Self, key: K, hash: u64) !void {
+            if (!is_set) @compileError("Use putWithHash() for maps");
+            checkHash(key, hash);
+            _ = try self.insertInternalHashed(key, hash, {}, false, true);
+        }
+
+        /// `getOrPut` with a precomputed hash.
+        pub fn getOrPutWithHash(self: *Self, key: K, hash: u64) !GetOrPutResult {
+            if (is_set) @compileError("Use addWithHash() for sets");
+            checkHash(key, hash);
+            const result = try self.insertInternalHashed(key, hash, undefined, false, false);
+            return .{
+                .value_ptr = result.val,
+                .found_existing = !result.inserted,
+            };
+        }
+
+        /// `remove` with a precomputed hash.
+        pub fn removeWithHash(self: *Self, key: K, hash: u64) bool {
+            checkHash(key, hash);
+            return self.removeHashed(key, hash);
+        }
+
+        inline fn checkHash(key: K, hash: u64) void {
+            if (builtin.mode == .Debug) std.debug.assert(hash == hashFn(key));
         }
 
         // ====================================================================
@@ -488,27 +1393,72 @@ pub fn HashMapWithFns(
 
         /// Remove a key from the table. Returns true if the key was found and removed.
         pub fn remove(self: *Self, key: K) bool {
-            const result = self.getInternal(key);
-            if (result.bucket_idx == null) return false;
-            self.eraseAtIndex(result.bucket_idx.?, result.home_bucket);
-            return true;
+            if (self.buckets_mask == 0) return false;
+            return self.removeHashed(key, hashFn(key));
         }
 
         /// Remove all keys from the table without deallocating.
+        /// An in-progress incremental resize is abandoned and its old allocation freed.
         pub fn clear(self: *Self) void {
+            if (journaling) {
+                self.journal.pending = null;
+                if (self.journal.log) |log| log.append(&.{&[_]u8{@intFromEnum(JournalOp.clear)}});
+            }
+            if (incremental) self.freeDraining();
+            if (stash_enabled) self.stash.len = 0;
+            if (dense_values) self.dense.clearRetainingCapacity();
             if (self.key_count == 0) return;
             const bucket_count = self.bucketCount();
-            for (0..bucket_count) |i| {
-                self.metadata[i] = EMPTY;
+            if (track_dirty) {
+                const dirty = self.dirtyPages();
+                for (dirty[0..dirtyPageCount(bucket_count)], 0..) |*flag, page| {
+                    if (flag.* == 0) continue;
+                    const start = page * DIRTY_PAGE_BUCKETS;
+                    @memset(self.metadata[start..@min(start + DIRTY_PAGE_BUCKETS, bucket_count)], EMPTY);
+                    flag.* = 0;
+                }
+            } else if (atomic_stores) {
+                for (0..bucket_count) |i| self.setMeta(i, EMPTY);
+            } else {
+                @memset(self.metadata[0..bucket_count], EMPTY);
             }
             self.key_count = 0;
         }
 
+        /// Keep only the entries for which `keep(context, key_ptr, value_ptr)` returns true, in one
+        /// pass over the table, and return the number removed. `value_ptr` is `*V` (`*void` for
+        /// sets), so kept values can be updated on the way. `keep` is called exactly once per
+        /// entry: chain by chain in bucket order, then the entries of a draining incremental
+        /// resize, then the stash. It must not modify the table.
+        ///
+        /// Each chain is compacted in place: kept entries slide towards the home bucket, keeping
+        /// their order, and the chain is cut after the last of them. Entries never move to
+        /// another chain, so none is skipped or visited twice, and nothing is looked up again as
+        /// with `remove` per key.
+        pub fn retain(self: *Self, context: anytype, comptime keep: anytype) usize {
+            return self.retainInternal(context, keep, false);
+        }
+
+        /// Remove the entries for which `pred(context, key_ptr, value_ptr)` returns true and
+        /// return their number; see `retain`.
+        pub fn removeIf(self: *Self, context: anytype, comptime pred: anytype) usize {
+            return self.retainInternal(context, pred, true);
+        }
+
         /// Returns an iterator over the table's buckets.
         pub fn iterator(self: *const Self) Iterator {
             return .{ .table = self, .index = 0, .end_index = self.bucketCount() };
         }
 
+        /// Iterator over buckets `begin..end` (at most `bucketCount()`), e.g. one slice of the table
+        /// per thread. A range ending at `bucketCount()` also yields the entries outside the bucket
+        /// array (a draining incremental resize and the stash), so ranges that tile
+        /// `0..bucketCount()` visit every entry exactly once.
+        pub fn iteratorRange(self: *const Self, begin: usize, end: usize) Iterator {
+            std.debug.assert(begin <= end and end <= self.bucketCount());
+            return .{ .table = self, .index = begin, .end_index = end, .range_begin = begin, .range_end = end };
+        }
+
         /// Returns an iterator over the keys.
         pub fn keyIterator(self: *const Self) KeyIterator {
             return .{ .inner = self.iterator() };
@@ -517,7 +1467,20 @@ pub fn HashMapWithFns(
         /// Returns an iterator over the values (only for maps).
         pub fn valueIterator(self: *const Self) ValueIterator {
             if (is_set) @compileError("Sets don't have values");
-            return .{ .inner = self.iterator() };
+            return if (dense_values) .{ .values = self.dense.items(.value) } else .{ .inner = self.iterator() };
+        }
+
+        /// All values as one contiguous slice, in no particular order (`Options.dense_values` only).
+        /// Invalidated by any insert or remove.
+        pub fn denseValues(self: *Self) []V {
+            if (!dense_values) @compileError("denseValues() requires Options.dense_values");
+            return self.dense.items(.value);
+        }
+
+        /// The keys matching `denseValues()` index for index (`Options.dense_values` only).
+        pub fn denseKeys(self: *const Self) []const K {
+            if (!dense_values) @compileError("denseKeys() requires Options.dense_values");
+            return self.dense.items(.key);
         }
 
         /// Iterator over keys only
@@ -537,12 +1500,26 @@ pub fn HashMapWithFns(
         };
 
         /// Iterator over values only (for maps)
-        pub const ValueIterator = if (is_set) void else struct {
+        pub const ValueIterator = if (is_set) void else if (dense_values) struct {
+            // A linear walk over the dense value array
+            values: []const V,
+            index: usize = 0,
+
+            pub fn next(self: *ValueIterator) ?V {
+                if (self.index == self.values.len) return null;
+                self.index += 1;
+                return self.values[self.index - 1];
+            }
+
+            pub fn reset(self: *ValueIterator) void {
+                self.index = 0;
+            }
+        } else struct {
             inner: Iterator,
 
             pub fn next(self: *ValueIterator) ?V {
-                if (self.inner.next()) |bucket| {
-                    return bucket.val;
+                if (self.inner.nextEntry()) |entry| {
+                    return entry.value_ptr.*;
                 }
                 return null;
             }
@@ -553,7 +1530,10 @@ pub fn HashMapWithFns(
         };
 
         /// Ensure capacity for at least `size` keys without rehashing.
+        /// Completes an in-progress incremental resize, so that the `*AssumeCapacity` inserts can follow.
         pub fn reserve(self: *Self, size: usize) !void {
+            if (incremental) try self.finishResize();
+            if (dense_values) try self.dense.ensureTotalCapacity(self.allocator, size);
             const min_buckets = self.minBucketCountForSize(size);
             if (min_buckets > self.bucketCount()) {
                 try self.rehash(min_buckets);
@@ -570,12 +1550,12 @@ pub fn HashMapWithFns(
         /// Pre-allocate capacity for `additional_count` more keys beyond current count.
         /// This is useful when you know how many more items you'll add.
         pub fn ensureUnusedCapacity(self: *Self, additional_count: usize) !void {
-            try self.reserve(self.key_count + additional_count);
+            try self.reserve(self.count() + additional_count);
         }
 
         /// Shrink the table to fit the current number of keys.
         pub fn shrink(self: *Self) !void {
-            const min_buckets = self.minBucketCountForSize(self.key_count);
+            const min_buckets = self.minBucketCountForSize(self.count());
             if (min_buckets < self.bucketCount()) {
                 if (min_buckets == 0) {
                     self.deinit();
@@ -591,863 +1571,4813 @@ pub fn HashMapWithFns(
                 return Self.init(self.allocator);
             }
 
-            const alloc_size = self.totalAllocSize();
-            const new_mem = try self.allocator.alloc(u8, alloc_size);
-            const src_ptr: [*]const u8 = @ptrCast(self.buckets);
-            @memcpy(new_mem, src_ptr[0..alloc_size]);
+            const new_mem = try self.dupeStorage(self.buckets, self.bucketCount());
 
             var result = self.*;
+            // The copy has its own history: it starts without a journal
+            if (journaling) result.journal = .{};
             result.buckets = @ptrCast(@alignCast(new_mem.ptr));
+            result.values = self.valuesIn(new_mem.ptr, self.bucketCount());
             result.metadata = @ptrCast(@alignCast(new_mem.ptr + self.metadataOffset()));
-            return result;
-        }
 
-        // ====================================================================
-        // Internal Implementation
-        // ====================================================================
+            if (incremental) {
+                if (self.draining) |old| {
+                    errdefer self.freeBlock(new_mem);
+                    const old_count = old.buckets_mask + 1;
+                    const old_mem = try self.dupeStorage(old.buckets, old_count);
+                    result.draining.?.buckets = @ptrCast(@alignCast(old_mem.ptr));
+                    result.draining.?.values = self.valuesIn(old_mem.ptr, old_count);
+                    result.draining.?.metadata = @ptrCast(@alignCast(old_mem.ptr + self.metadataOffsetForCount(old_count)));
+                }
+            }
 
-        const InsertResult = struct {
-            bucket_idx: usize,
-            inserted: bool,
+            if (dense_values) {
+                result.dense = self.dense.clone(self.allocator) catch |err| {
+                    if (incremental) result.freeDraining();
+                    result.freeStorage();
+                    return err;
+                };
+            }
+            return result;
+        }
+
+        fn dupeStorage(self: *const Self, buckets: [*]Bucket, bucket_count: usize) ![]u8 {
+            const alloc_size = self.totalAllocSizeForCount(bucket_count);
+            const new_mem = try self.allocBlock(alloc_size);
+            const src_ptr: [*]const u8 = @ptrCast(buckets);
+            @memcpy(new_mem, src_ptr[0..alloc_size]);
+            return new_mem;
+        }
+
+        // ====================================================================
+        // Persistent format
+        // ====================================================================
+        //
+        // `writeMapped` writes the table in a relocatable format that `Mapped` queries in place,
+        // typically from a read-only mmap of the file: a `MappedHeader`, the bucket array,
+        // values and metadata laid out as in memory (empty slots zeroed), the stash, and for string
+        // keys the key bytes, with buckets holding a `StringRef` into them instead of a slice.
+        // Keys other than `[]const u8` and values must not contain pointers.
+
+        /// Bucket of a mapped file: `Bucket` itself, or with string keys `Bucket` with the
+        /// slice replaced by an offset and length into the string section.
+        pub const MappedBucket = if (!is_string or dense_values)
+            Bucket
+        else if (is_set or separate_values) struct {
+            key: StringRef,
+            full_hash: if (store_hash) u64 else void = if (store_hash) 0 else {},
+        } else struct {
+            key: StringRef,
+            val: V,
+            full_hash: if (store_hash) u64 else void = if (store_hash) 0 else {},
         };
 
-        inline fn insertInternal(self: *Self, key: K, value: V, unique: bool, replace: bool) !InsertResult {
-            while (true) {
-                if (self.insertRaw(key, value, unique, replace)) |r| {
-                    return r;
-                } else {
-                    // Need to grow and rehash - unlikely path
-                    @branchHint(.unlikely);
-                    const new_count = if (self.buckets_mask != 0)
-                        self.bucketCount() * 2
-                    else
-                        MIN_NONZERO_BUCKET_COUNT;
-                    try self.rehash(new_count);
-                }
-            }
+        fn assertMappable() void {
+            if (dense_values) @compileError("Options.dense_values tables can't be written in the mapped format");
+            if (!is_string and containsPointers(K)) @compileError("mapped keys must be []const u8 or contain no pointers");
+            if (containsPointers(V)) @compileError("mapped values must not contain pointers");
+            if (@alignOf(MappedBucket) > MAPPED_ALIGNMENT or @alignOf(V) > MAPPED_ALIGNMENT) @compileError("mapped buckets and values must be aligned to at most MAPPED_ALIGNMENT");
         }
 
-        inline fn insertRaw(self: *Self, key: K, value: V, unique: bool, replace: bool) ?InsertResult {
-            // Empty table - trigger allocation
-            if (self.buckets_mask == 0) return null;
+        /// The header of a file written by this table type, without the table's counts and offsets.
+        fn mappedHeader() MappedHeader {
+            const no_field: u64 = 0xFFFF;
+            const val_offset: u64 = if (@hasField(MappedBucket, "val")) @offsetOf(MappedBucket, "val") else no_field;
+            const hash_offset: u64 = if (store_hash) @offsetOf(MappedBucket, "full_hash") else no_field;
+            return .{
+                .bucket_size = @sizeOf(MappedBucket),
+                .key_size = @sizeOf(K),
+                .value_size = @sizeOf(V),
+                .bucket_layout = @offsetOf(MappedBucket, "key") | val_offset << 16 | hash_offset << 32 | @as(u64, @alignOf(MappedBucket)) << 48,
+                .meta_bits = meta_bits,
+                .frag_bits = frag_bits,
+                .flags = (if (store_hash) MAPPED_FLAG_STORE_HASH else 0) |
+                    (if (separate_values) MAPPED_FLAG_SEPARATE_VALUES else 0) |
+                    (if (is_string) MAPPED_FLAG_STRING_KEYS else 0),
+            };
+        }
 
-            const hash = hashFn(key);
-            const frag = hashFrag(hash);
-            const home_bucket = hash & self.buckets_mask;
+        fn mappedValuesOffset(bucket_count: usize) usize {
+            return std.mem.alignForward(usize, bucket_count * @sizeOf(MappedBucket), @alignOf(V));
+        }
 
-            // Prefetch bucket data while we check metadata (hides memory latency)
-            @prefetch(&self.buckets[home_bucket], .{});
+        fn mappedMetadataOffset(bucket_count: usize) usize {
+            const end = if (separate_values)
+                mappedValuesOffset(bucket_count) + bucket_count * @sizeOf(V)
+            else
+                bucket_count * @sizeOf(MappedBucket);
+            return std.mem.alignForward(usize, end, @alignOf(MetaType));
+        }
 
-            // Case 1: Home bucket is empty or occupied by non-belonging key
-            if ((self.metadata[home_bucket] & IN_HOME_BUCKET_MASK) == 0) {
-                // Load factor check - unlikely to trigger during normal operation
-                if (self.key_count + 1 > self.capacity()) {
-                    @branchHint(.unlikely);
-                    return null;
-                }
+        fn mappedStorageSize(bucket_count: usize) usize {
+            return if (bucket_count == 0) 0 else mappedMetadataOffset(bucket_count) + (bucket_count + 4) * @sizeOf(MetaType);
+        }
 
-                // Evict if occupied by non-belonging key
-                if (self.metadata[home_bucket] != EMPTY) {
-                    if (!self.evict(home_bucket)) {
-                        @branchHint(.unlikely);
-                        return null;
-                    }
-                }
+        /// Stash buckets, then with `Options.separate_values` their values; the same shape as the storage.
+        fn mappedStashSize(stash_count: usize) usize {
+            return if (separate_values) mappedValuesOffset(stash_count) + stash_count * @sizeOf(V) else stash_count * @sizeOf(MappedBucket);
+        }
 
-                self.buckets[home_bucket].key = key;
-                if (!is_set) {
-                    self.buckets[home_bucket].val = value;
-                }
-                if (is_string) {
-                    self.buckets[home_bucket].full_hash = hash;
-                }
-                self.metadata[home_bucket] = frag | IN_HOME_BUCKET_MASK | DISPLACEMENT_MASK;
-                self.key_count += 1;
+        /// Write the table in the mapped format (see `Mapped`). The bucket array and metadata are
+        /// written in their in-memory layout, with empty buckets and their values zeroed, so this
+        /// costs about as much as copying the table once and the output depends only on the
+        /// table's contents and history, never on stale memory. Fails with
+        /// `error.ResizeInProgress` during an incremental resize; call `finishResize` first.
+        pub fn writeMapped(self: *const Self, writer: *std.Io.Writer) !void {
+            comptime assertMappable();
+            if (incremental and self.draining != null) return error.ResizeInProgress;
 
-                return .{ .bucket_idx = home_bucket, .inserted = true };
+            const bucket_count = self.bucketCount();
+            const stash_len = self.stashLen();
+            var header = mappedHeader();
+            header.max_load = self.max_load;
+            header.bucket_count = bucket_count;
+            header.key_count = self.key_count;
+            header.stash_count = stash_len;
+            header.storage_offset = std.mem.alignForward(u64, @sizeOf(MappedHeader), MAPPED_ALIGNMENT);
+            header.stash_offset = std.mem.alignForward(u64, header.storage_offset + mappedStorageSize(bucket_count), MAPPED_ALIGNMENT);
+            header.strings_offset = std.mem.alignForward(u64, header.stash_offset + mappedStashSize(stash_len), MAPPED_ALIGNMENT);
+            if (is_string) {
+                var it = self.keyIterator();
+                while (it.next()) |key| header.strings_len += key.len;
             }
 
-            // Case 2: Home bucket contains beginning of a chain
-            // Search the chain for existing key (unless unique)
-            if (!unique) {
-                var bucket = home_bucket;
-                while (true) {
-                    // For strings: compare full hash first (much cheaper than memcmp)
-                    const hash_match = if (is_string)
-                        self.buckets[bucket].full_hash == hash
-                    else
-                        (self.metadata[bucket] & HASH_FRAG_MASK) == frag;
-
-                    if (hash_match and eqlFn(self.buckets[bucket].key, key)) {
-                        if (replace) {
-                            self.buckets[bucket].key = key;
-                            if (!is_set) {
-                                self.buckets[bucket].val = value;
-                            }
-                        }
-                        return .{ .bucket_idx = bucket, .inserted = false };
+            try writer.writeAll(std.mem.asBytes(&header));
+            var pos: u64 = @sizeOf(MappedHeader);
+
+            // Storage
+            try writer.splatByteAll(0, header.storage_offset - pos);
+            pos = header.storage_offset;
+            var string_offset: u64 = 0;
+            if (bucket_count != 0) {
+                // Slot by slot: empty buckets and values hold whatever the allocation last did
+                const metadata_offset = mappedMetadataOffset(bucket_count);
+                for (self.buckets[0..bucket_count], self.metadata[0..bucket_count]) |*bucket, meta| {
+                    string_offset = try writeMappedBucket(writer, bucket, meta != EMPTY, string_offset);
+                }
+                var end = bucket_count * @sizeOf(MappedBucket);
+                if (separate_values) {
+                    try writer.splatByteAll(0, mappedValuesOffset(bucket_count) - end);
+                    for (self.values[0..bucket_count], self.metadata[0..bucket_count]) |*value, meta| {
+                        if (meta != EMPTY) try writer.writeAll(std.mem.asBytes(value)) else try writer.splatByteAll(0, @sizeOf(V));
                     }
-
-                    const displacement = self.metadata[bucket] & DISPLACEMENT_MASK;
-                    if (displacement == DISPLACEMENT_MASK) break;
-                    bucket = (home_bucket + probeOffset(displacement)) & self.buckets_mask;
+                    end = mappedValuesOffset(bucket_count) + bucket_count * @sizeOf(V);
                 }
+                try writer.splatByteAll(0, metadata_offset - end);
+                try writer.writeAll(std.mem.sliceAsBytes(self.metadata[0 .. bucket_count + 4]));
+                pos += mappedStorageSize(bucket_count);
             }
 
-            // Load factor check - unlikely to trigger during normal operation
-            if (self.key_count + 1 > self.capacity()) {
-                @branchHint(.unlikely);
-                return null;
+            // Stash
+            try writer.splatByteAll(0, header.stash_offset - pos);
+            pos = header.stash_offset;
+            if (stash_enabled) {
+                for (self.stash.entries[0..stash_len]) |*bucket| {
+                    string_offset = try writeMappedBucket(writer, bucket, true, string_offset);
+                }
+                if (separate_values) {
+                    try writer.splatByteAll(0, mappedValuesOffset(stash_len) - stash_len * @sizeOf(MappedBucket));
+                    try writer.writeAll(std.mem.sliceAsBytes(self.stash.values[0..stash_len]));
+                }
+                pos += mappedStashSize(stash_len);
             }
 
-            // Find empty bucket - unlikely to fail
-            const empty_result = self.findFirstEmpty(home_bucket) orelse {
-                @branchHint(.unlikely);
-                return null;
-            };
-            const empty = empty_result.index;
-            const displacement = empty_result.displacement;
-
-            // Find insert location in chain
-            const prev = self.findInsertLocationInChain(home_bucket, displacement);
-
-            // Insert
-            self.buckets[empty].key = key;
-            if (!is_set) {
-                self.buckets[empty].val = value;
-            }
+            // Key bytes, in the order their `StringRef`s were handed out
+            try writer.splatByteAll(0, header.strings_offset - pos);
             if (is_string) {
-                self.buckets[empty].full_hash = hash;
+                for (self.buckets[0..bucket_count], self.metadata[0..bucket_count]) |*bucket, meta| {
+                    if (meta != EMPTY) try writer.writeAll(bucket.key);
+                }
+                if (stash_enabled) {
+                    for (self.stash.entries[0..stash_len]) |*bucket| try writer.writeAll(bucket.key);
+                }
             }
-            self.metadata[empty] = frag | (self.metadata[prev] & DISPLACEMENT_MASK);
-            self.metadata[prev] = (self.metadata[prev] & ~DISPLACEMENT_MASK) | displacement;
-            self.key_count += 1;
-
-            return .{ .bucket_idx = empty, .inserted = true };
         }
 
-        fn getBucket(self: *const Self, key: K) ?*const Bucket {
-            const result = self.getInternal(key);
-            if (result.bucket_idx) |idx| {
-                return &self.buckets[idx];
-            }
-            return null;
+        /// Write the table in the mapped format to a new file at `sub_path`, replacing any existing file.
+        pub fn writeMappedFile(self: *const Self, dir: std.fs.Dir, sub_path: []const u8) !void {
+            const file = try dir.createFile(sub_path, .{});
+            defer file.close();
+            var buffer: [64 * 1024]u8 = undefined;
+            var file_writer = file.writer(&buffer);
+            try self.writeMapped(&file_writer.interface);
+            try file_writer.interface.flush();
         }
 
-        fn getBucketMut(self: *Self, key: K) ?*Bucket {
-            const result = self.getInternal(key);
-            if (result.bucket_idx) |idx| {
-                return &self.buckets[idx];
+        /// Write `bucket` field by field over zeroes, so padding is zero too (or only zeroes if the
+        /// bucket is empty). A string key is replaced by a reference to `string_offset`.
+        /// Returns the offset of the next key.
+        fn writeMappedBucket(writer: *std.Io.Writer, bucket: *const Bucket, occupied: bool, string_offset: u64) !u64 {
+            var out: MappedBucket = undefined;
+            @memset(std.mem.asBytes(&out), 0);
+            if (!occupied) {
+                try writer.writeAll(std.mem.asBytes(&out));
+                return string_offset;
             }
-            return null;
+            if (is_string) out.key = .{ .offset = string_offset, .len = bucket.key.len } else out.key = bucket.key;
+            if (@hasField(MappedBucket, "val")) out.val = bucket.val;
+            if (store_hash) out.full_hash = bucket.full_hash;
+            try writer.writeAll(std.mem.asBytes(&out));
+            return if (is_string) string_offset + bucket.key.len else string_offset;
         }
 
-        const GetResult = struct {
-            bucket_idx: ?usize,
-            home_bucket: usize,
-        };
+        /// A read-only table over the bytes of a file written by `writeMapped`, queried in place
+        /// with no deserialization: opening a file maps it and reads the header, and lookups page
+        /// in the buckets they touch. String keys are returned as slices of the mapping.
+        ///
+        /// `fromBytes` checks the header, the layout against this table type and the section
+        /// bounds, but not the buckets themselves, so only map files written by this program
+        /// (or a build with the same layout and hash function).
+        pub const Mapped = struct {
+            key_count: usize,
+            buckets_mask: usize,
+            buckets: [*]const MappedBucket,
+            values: if (separate_values) [*]const V else void,
+            metadata: [*]const MetaType,
+            stash: []const MappedBucket,
+            stash_values: if (separate_values) [*]const V else void,
+            strings: if (is_string) []const u8 else void,
+            max_load: f32,
+            /// The file mapping created by `open`, unmapped by `close`
+            mapping: ?[]align(std.heap.page_size_min) const u8 = null,
+
+            pub const Error = error{ InvalidFormat, UnsupportedVersion, LayoutMismatch, Misaligned };
+
+            /// Map the file at `sub_path` read-only and open it. Readahead is requested for the
+            /// whole file, so it pages in in the background while the first lookups run.
+            pub fn open(dir: std.fs.Dir, sub_path: []const u8) !Mapped {
+                const file = try dir.openFile(sub_path, .{});
+                defer file.close();
+                const len = std.math.cast(usize, try file.getEndPos()) orelse return error.InvalidFormat;
+                if (len < @sizeOf(MappedHeader)) return error.InvalidFormat;
+
+                const mapping = try posix.mmap(null, len, posix.PROT.READ, .{ .TYPE = .SHARED }, file.handle, 0);
+                errdefer posix.munmap(mapping);
+                posix.madvise(mapping.ptr, mapping.len, posix.MADV.WILLNEED) catch {};
+
+                var mapped = try fromBytes(mapping);
+                mapped.mapping = mapping;
+                return mapped;
+            }
 
-        inline fn getInternal(self: *const Self, key: K) GetResult {
-            // Empty table - not found
-            if (self.buckets_mask == 0) {
-                return .{ .bucket_idx = null, .home_bucket = 0 };
+            /// Unmap the file of a `Mapped` from `open`. Keys and value pointers obtained from it
+            /// become invalid.
+            pub fn close(self: *Mapped) void {
+                if (self.mapping) |mapping| posix.munmap(mapping);
+                self.* = undefined;
             }
 
-            const hash = hashFn(key);
-            const home_bucket = hash & self.buckets_mask;
+            /// Interpret `bytes`, aligned to `MAPPED_ALIGNMENT`, as a file written by `writeMapped`.
+            /// The result points into `bytes`, which must outlive it.
+            pub fn fromBytes(bytes: []const u8) Error!Mapped {
+                comptime assertMappable();
+                if (bytes.len < @sizeOf(MappedHeader)) return error.InvalidFormat;
+                if (!std.mem.isAligned(@intFromPtr(bytes.ptr), MAPPED_ALIGNMENT)) return error.Misaligned;
+
+                const header: *const MappedHeader = @ptrCast(@alignCast(bytes.ptr));
+                if (!std.mem.eql(u8, &header.magic, &MAPPED_MAGIC)) return error.InvalidFormat;
+                if (header.version != MAPPED_FORMAT_VERSION) return error.UnsupportedVersion;
+                if (!header.sameLayout(&mappedHeader())) return error.LayoutMismatch;
+
+                // Section bounds; counts are checked against the length first so the sizes can't overflow
+                const len: u64 = bytes.len;
+                const bucket_count = header.bucket_count;
+                if (bucket_count > len or bucket_count & (bucket_count -% 1) != 0) return error.InvalidFormat;
+                if (bucket_count != 0 and bucket_count < MIN_NONZERO_BUCKET_COUNT) return error.InvalidFormat;
+                if (header.key_count > bucket_count or header.stash_count > len) return error.InvalidFormat;
+                if (!inSection(header.storage_offset, mappedStorageSize(@intCast(bucket_count)), len) or
+                    !inSection(header.stash_offset, mappedStashSize(@intCast(header.stash_count)), len) or
+                    !inSection(header.strings_offset, header.strings_len, len))
+                    return error.InvalidFormat;
+
+                const storage = bytes.ptr + @as(usize, @intCast(header.storage_offset));
+                const stash = bytes.ptr + @as(usize, @intCast(header.stash_offset));
+                const stash_count: usize = @intCast(header.stash_count);
+                return .{
+                    .key_count = @intCast(header.key_count),
+                    .buckets_mask = if (bucket_count == 0) 0 else @intCast(bucket_count - 1),
+                    .buckets = @ptrCast(@alignCast(storage)),
+                    .values = if (separate_values) @ptrCast(@alignCast(storage + mappedValuesOffset(@intCast(bucket_count)))) else {},
+                    .metadata = if (bucket_count == 0) &empty_placeholder else @ptrCast(@alignCast(storage + mappedMetadataOffset(@intCast(bucket_count)))),
+                    .stash = @as([*]const MappedBucket, @ptrCast(@alignCast(stash)))[0..stash_count],
+                    .stash_values = if (separate_values) @ptrCast(@alignCast(stash + mappedValuesOffset(stash_count))) else {},
+                    .strings = if (is_string) bytes[@intCast(header.strings_offset)..][0..@intCast(header.strings_len)] else {},
+                    .max_load = header.max_load,
+                };
+            }
 
-            // Prefetch the home bucket (we will definitely access it)
-            @prefetch(&self.buckets[home_bucket], .{ .rw = .read });
+            fn inSection(offset: u64, size: u64, len: u64) bool {
+                return offset % MAPPED_ALIGNMENT == 0 and offset <= len and size <= len - offset;
+            }
 
-            // If home bucket is empty or contains a non-home key, miss
-            if ((self.metadata[home_bucket] & IN_HOME_BUCKET_MASK) == 0) {
-                @branchHint(.unlikely);
-                return .{ .bucket_idx = null, .home_bucket = home_bucket };
+            /// Number of entries.
+            pub fn count(self: *const Mapped) usize {
+                return self.key_count + self.stash.len;
             }
 
-            const frag = hashFrag(hash);
-            var bucket = home_bucket;
+            /// Number of buckets of the table that was written.
+            pub fn bucketCount(self: *const Mapped) usize {
+                return if (self.buckets_mask == 0) 0 else self.buckets_mask + 1;
+            }
 
-            while (true) {
-                // Check current bucket for match
-                // For strings: compare full hash first (much cheaper than memcmp)
-                const hash_match = if (is_string)
-                    self.buckets[bucket].full_hash == hash
-                else
-                    (self.metadata[bucket] & HASH_FRAG_MASK) == frag;
+            /// Get the value for `key`, or null if not found.
+            pub fn get(self: *const Mapped, key: K) ?V {
+                if (is_set) @compileError("Use contains() for sets");
+                const ptr = self.getPtr(key) orelse return null;
+                return ptr.*;
+            }
 
-                if (hash_match and eqlFn(self.buckets[bucket].key, key)) {
-                    return .{ .bucket_idx = bucket, .home_bucket = home_bucket };
-                }
+            /// Get a pointer into the mapping to the value for `key`, or null if not found.
+            pub fn getPtr(self: *const Mapped, key: K) ?*const V {
+                return self.getPtrWithHash(key, hashFn(key));
+            }
 
-                // Get displacement of current bucket
-                const displacement = self.metadata[bucket] & DISPLACEMENT_MASK;
+            /// Check whether `key` is present.
+            pub fn contains(self: *const Mapped, key: K) bool {
+                return self.getPtrWithHash(key, hashFn(key)) != null;
+            }
 
-                // End of chain?
-                if (displacement == DISPLACEMENT_MASK) {
-                    @branchHint(.unlikely);
-                    return .{ .bucket_idx = null, .home_bucket = home_bucket };
+            /// `getPtr` with a precomputed `hash` (must equal `hashFn(key)`).
+            pub fn getPtrWithHash(self: *const Mapped, key: K, hash: u64) ?*const V {
+                if (self.buckets_mask != 0) {
+                    const home_bucket = hash & self.buckets_mask;
+                    if ((self.metadata[home_bucket] & IN_HOME_BUCKET_MASK) != 0) {
+                        const frag = hashFrag(hash);
+                        var bucket = home_bucket;
+                        while (true) {
+                            const hash_match = if (store_hash)
+                                self.buckets[bucket].full_hash == hash
+                            else
+                                (self.metadata[bucket] & HASH_FRAG_MASK) == frag;
+                            if (hash_match and eqlFn(self.keyOf(&self.buckets[bucket]), key)) return self.valueAt(bucket);
+
+                            const displacement = self.metadata[bucket] & DISPLACEMENT_MASK;
+                            if (displacement == DISPLACEMENT_MASK) break;
+                            bucket = (home_bucket + probeOffset(displacement)) & self.buckets_mask;
+                        }
+                    }
                 }
-
-                // Compute the *next* bucket in the chain
-                const next_bucket = (home_bucket + probeOffset(displacement)) & self.buckets_mask;
-
-                // Prefetch the next bucket (we will access it next iteration)
-                @prefetch(&self.buckets[next_bucket], .{ .rw = .read, .locality = 1 });
-
-                // Advance to next bucket
-                bucket = next_bucket;
+                for (self.stash, 0..) |*bucket, i| {
+                    const hash_match = if (store_hash) bucket.full_hash == hash else true;
+                    if (hash_match and eqlFn(self.keyOf(bucket), key)) return self.stashValueAt(i);
+                }
+                return null;
             }
-        }
 
-        fn eraseAtIndex(self: *Self, bucket_idx: usize, home_bucket: usize) void {
-            self.key_count -= 1;
+            /// The key of `bucket`; string keys are slices of the mapping.
+            inline fn keyOf(self: *const Mapped, bucket: *const MappedBucket) K {
+                return if (is_string) self.strings[@intCast(bucket.key.offset)..][0..@intCast(bucket.key.len)] else bucket.key;
+            }
 
-            // Case 1: Only key in chain
-            if ((self.metadata[bucket_idx] & IN_HOME_BUCKET_MASK) != 0 and
-                (self.metadata[bucket_idx] & DISPLACEMENT_MASK) == DISPLACEMENT_MASK)
-            {
-                self.metadata[bucket_idx] = EMPTY;
-                return;
+            inline fn valueAt(self: *const Mapped, idx: usize) *const V {
+                return if (is_set) &set_value else if (separate_values) &self.values[idx] else &self.buckets[idx].val;
             }
 
-            // Determine home bucket if not in home position
-            var home = home_bucket;
-            if ((self.metadata[bucket_idx] & IN_HOME_BUCKET_MASK) == 0) {
-                home = hashFn(self.buckets[bucket_idx].key) & self.buckets_mask;
+            inline fn stashValueAt(self: *const Mapped, i: usize) *const V {
+                return if (is_set) &set_value else if (separate_values) &self.stash_values[i] else &self.stash[i].val;
             }
 
-            // Case 2: Last key in multi-key chain
-            if ((self.metadata[bucket_idx] & DISPLACEMENT_MASK) == DISPLACEMENT_MASK) {
-                // Find penultimate key
-                var bucket = home;
-                while (true) {
-                    const displacement = self.metadata[bucket] & DISPLACEMENT_MASK;
-                    const next = (home + probeOffset(displacement)) & self.buckets_mask;
-                    if (next == bucket_idx) {
-                        self.metadata[bucket] |= DISPLACEMENT_MASK;
-                        self.metadata[bucket_idx] = EMPTY;
-                        return;
-                    }
-                    bucket = next;
-                }
+            pub fn iterator(self: *const Mapped) Iterator {
+                return .{ .mapped = self };
             }
 
-            // Case 3: Not the last key - swap with last and remove last
-            var bucket = bucket_idx;
-            while (true) {
-                const displacement = self.metadata[bucket] & DISPLACEMENT_MASK;
-                const prev = bucket;
-                bucket = (home + probeOffset(displacement)) & self.buckets_mask;
+            /// Entry of a mapped table: the key by value (a slice of the mapping for strings)
+            /// and a pointer to the value in the mapping.
+            pub const Entry = struct {
+                key: K,
+                value_ptr: *const V,
+            };
 
-                if ((self.metadata[bucket] & DISPLACEMENT_MASK) == DISPLACEMENT_MASK) {
-                    // Found last - swap it to bucket_idx
-                    self.buckets[bucket_idx] = self.buckets[bucket];
-                    self.metadata[bucket_idx] = (self.metadata[bucket_idx] & ~HASH_FRAG_MASK) |
-                        (self.metadata[bucket] & HASH_FRAG_MASK);
-                    self.metadata[prev] |= DISPLACEMENT_MASK;
-                    self.metadata[bucket] = EMPTY;
-                    return;
+            /// Visits the buckets in order, then the stash.
+            pub const Iterator = struct {
+                mapped: *const Mapped,
+                idx: usize = 0,
+
+                pub fn next(it: *Iterator) ?Entry {
+                    const mapped = it.mapped;
+                    const bucket_count = mapped.bucketCount();
+                    while (it.idx < bucket_count) {
+                        const idx = it.idx;
+                        it.idx += 1;
+                        if (mapped.metadata[idx] != EMPTY) return .{ .key = mapped.keyOf(&mapped.buckets[idx]), .value_ptr = mapped.valueAt(idx) };
+                    }
+                    const i = it.idx - bucket_count;
+                    if (i >= mapped.stash.len) return null;
+                    it.idx += 1;
+                    return .{ .key = mapped.keyOf(&mapped.stash[i]), .value_ptr = mapped.stashValueAt(i) };
                 }
-            }
+            };
+        };
+
+        /// Write the table for `readFrom`. Snapshots are the mapped format, so the same file can be
+        /// mapped with `Mapped.open` or loaded into a mutable table with `readFrom`.
+        pub fn writeTo(self: *const Self, writer: *std.Io.Writer) !void {
+            return self.writeMapped(writer);
         }
 
-        const FindEmptyResult = struct {
-            index: usize,
-            displacement: MetaType,
+        /// A table loaded by `readFrom`, with the key bytes its string keys point into.
+        /// For other key types `key_bytes` is empty and `map` can be used on its own.
+        pub const Snapshot = struct {
+            map: Self,
+            key_bytes: []u8,
+
+            pub fn deinit(self: *Snapshot) void {
+                self.map.allocator.free(self.key_bytes);
+                self.map.deinit();
+                self.* = undefined;
+            }
         };
 
-        inline fn findFirstEmpty(self: *Self, home_bucket: usize) ?FindEmptyResult {
-            // Linear probing: check consecutive slots for cache efficiency
-            var displacement: MetaType = 1;
+        /// Load a table written by `writeTo` or `writeMapped` into fresh storage. The bucket array,
+        /// values and metadata are read straight into the new allocation (string keys are
+        /// repointed at `key_bytes` bucket by bucket), so loading is one sequential read with no
+        /// hashing or probing. The keys must have been written by a table of this exact type.
+        pub fn readFrom(allocator: Allocator, reader: *std.Io.Reader) !Snapshot {
+            comptime assertMappable();
+            var header: MappedHeader = undefined;
+            try reader.readSliceAll(std.mem.asBytes(&header));
+            if (!std.mem.eql(u8, &header.magic, &MAPPED_MAGIC)) return error.InvalidFormat;
+            if (header.version != MAPPED_FORMAT_VERSION) return error.UnsupportedVersion;
+            if (!header.sameLayout(&mappedHeader())) return error.LayoutMismatch;
+
+            // Sections must follow each other in order to be streamed
+            const bucket_count = math.cast(usize, header.bucket_count) orelse return error.InvalidFormat;
+            const stash_count = math.cast(usize, header.stash_count) orelse return error.InvalidFormat;
+            if (bucket_count & (bucket_count -% 1) != 0 or (bucket_count != 0 and bucket_count < MIN_NONZERO_BUCKET_COUNT)) return error.InvalidFormat;
+            if (bucket_count > math.maxInt(usize) / 2 / @sizeOf(MappedBucket)) return error.InvalidFormat;
+            if (header.key_count > bucket_count or stash_count > options.stash_capacity) return error.InvalidFormat;
+            // Sizes the table on the next insert or `reserve`: NaN, 0 or a tiny factor would never
+            // fit any count. A table only ever writes what `setMaxLoadFactor` lets it hold.
+            if (!(header.max_load >= 0.1 and header.max_load <= 0.99)) return error.InvalidFormat;
+            if (header.storage_offset < @sizeOf(MappedHeader) or
+                header.stash_offset < header.storage_offset +| mappedStorageSize(bucket_count) or
+                header.strings_offset < header.stash_offset +| mappedStashSize(stash_count))
+                return error.InvalidFormat;
+            const strings_len = math.cast(usize, header.strings_len) orelse return error.InvalidFormat;
+
+            var snapshot: Snapshot = .{
+                .map = Self.init(allocator),
+                .key_bytes = try allocator.alloc(u8, if (is_string) strings_len else 0),
+            };
+            errdefer snapshot.deinit();
+            snapshot.map.max_load = header.max_load;
+            var pos: u64 = @sizeOf(MappedHeader);
+
+            // Storage
+            try reader.discardAll(@intCast(header.storage_offset - pos));
+            pos = header.storage_offset;
+            if (bucket_count != 0) {
+                const map = try snapshot.map.emptyTableForCount(bucket_count);
+                snapshot.map = map;
+                if (is_string) {
+                    try readMappedBuckets(reader, map.buckets[0..bucket_count], snapshot.key_bytes);
+                    var end = bucket_count * @sizeOf(MappedBucket);
+                    if (separate_values) {
+                        try reader.discardAll(mappedValuesOffset(bucket_count) - end);
+                        try reader.readSliceAll(std.mem.sliceAsBytes(map.values[0..bucket_count]));
+                        end = mappedValuesOffset(bucket_count) + bucket_count * @sizeOf(V);
+                    }
+                    try reader.discardAll(mappedMetadataOffset(bucket_count) - end);
+                    try reader.readSliceAll(std.mem.sliceAsBytes(map.metadata[0 .. bucket_count + 4]));
+                } else {
+                    // `MappedBucket` is `Bucket`: the section is the allocation up to the end of the metadata
+                    const base: [*]u8 = @ptrCast(map.buckets);
+                    try reader.readSliceAll(base[0..mappedStorageSize(bucket_count)]);
+                }
+                // Any page may hold keys now
+                if (track_dirty) @memset(map.dirtyPages()[0..dirtyPageCount(bucket_count)], 1);
+                snapshot.map.key_count = @intCast(header.key_count);
+                pos += mappedStorageSize(bucket_count);
+            }
 
-            while (displacement < DISPLACEMENT_MASK) {
-                const empty = (home_bucket +% displacement) & self.buckets_mask;
-                if (self.metadata[empty] == EMPTY) {
-                    return .{ .index = empty, .displacement = displacement };
+            // Stash
+            try reader.discardAll(@intCast(header.stash_offset - pos));
+            pos = header.stash_offset;
+            if (stash_enabled) {
+                const entries = snapshot.map.stash.entries[0..stash_count];
+                if (is_string) {
+                    try readMappedBuckets(reader, entries, snapshot.key_bytes);
+                } else {
+                    try reader.readSliceAll(std.mem.sliceAsBytes(entries));
                 }
-                displacement += 1;
+                if (separate_values) {
+                    try reader.discardAll(mappedValuesOffset(stash_count) - stash_count * @sizeOf(MappedBucket));
+                    try reader.readSliceAll(std.mem.sliceAsBytes(snapshot.map.stash.values[0..stash_count]));
+                }
+                snapshot.map.stash.len = stash_count;
+                pos += mappedStashSize(stash_count);
             }
 
-            // Displacement limit reached - extremely rare, triggers rehash
-            return null;
+            // Key bytes
+            try reader.discardAll(@intCast(header.strings_offset - pos));
+            if (is_string) try reader.readSliceAll(snapshot.key_bytes);
+            return snapshot;
         }
 
-        inline fn findInsertLocationInChain(self: *Self, home_bucket: usize, displacement_to_empty: MetaType) usize {
-            var candidate = home_bucket;
-            while (true) {
-                const displacement = self.metadata[candidate] & DISPLACEMENT_MASK;
-                if (displacement > displacement_to_empty) {
-                    return candidate;
+        /// Read `out.len` buckets with `StringRef` keys and point their keys into `key_bytes`,
+        /// which is filled in later.
+        fn readMappedBuckets(reader: *std.Io.Reader, out: []Bucket, key_bytes: []const u8) !void {
+            var chunk: [256]MappedBucket = undefined;
+            var done: usize = 0;
+            while (done < out.len) {
+                const n = @min(chunk.len, out.len - done);
+                try reader.readSliceAll(std.mem.sliceAsBytes(chunk[0..n]));
+                for (chunk[0..n], out[done..][0..n]) |*in, *bucket| {
+                    if (in.key.offset > key_bytes.len or in.key.len > key_bytes.len - in.key.offset) return error.InvalidFormat;
+                    bucket.key = key_bytes[@intCast(in.key.offset)..][0..@intCast(in.key.len)];
+                    if (@hasField(MappedBucket, "val")) bucket.val = in.val;
+                    if (store_hash) bucket.full_hash = in.full_hash;
                 }
-                candidate = (home_bucket + probeOffset(displacement)) & self.buckets_mask;
+                done += n;
             }
         }
 
-        inline fn evict(self: *Self, bucket: usize) bool {
-            // Find home bucket of occupying key
-            const home_bucket = hashFn(self.buckets[bucket].key) & self.buckets_mask;
+        // ====================================================================
+        // Shared tables
+        // ====================================================================
 
-            // Find previous key in chain
-            var prev = home_bucket;
-            while (true) {
-                const displacement = self.metadata[prev] & DISPLACEMENT_MASK;
-                const next = (home_bucket + probeOffset(displacement)) & self.buckets_mask;
-                if (next == bucket) break;
-                prev = next;
+        /// A table in a shared memory region (a memfd or `shm_open` object) that one writer
+        /// process changes in place while reader processes on the same host look keys up with
+        /// no copy. The region holds a `SharedControl` block and the table in the mapped format,
+        /// so it contains offsets only and each process can map it anywhere.
+        ///
+        /// The table's size is fixed when it is created: inserts beyond `max_keys` fail with
+        /// `error.OutOfCapacity` instead of growing. So does an insert whose chain would run past
+        /// the displacement limit, which heavily clustered hashes (or a narrow displacement field)
+        /// can cause before `max_keys` is reached; size `max_keys` with headroom for such keys.
+        ///
+        /// Readers synchronise with the writer through the seqlock in `SharedControl`. A lookup
+        /// reads the sequence, walks the chain, and retries if the writer was active or finished a
+        /// change in the meantime, so readers never block the writer (a writer that dies
+        /// mid-change leaves readers spinning). The writer stores buckets and metadata with
+        /// word-sized release stores (see `Options.atomic_stores`) and readers copy them with
+        /// word-sized acquire loads: a reader that sees any word of a change also sees the odd
+        /// sequence before it, so its re-check catches the change. Keys must not contain
+        /// pointers (strings are not supported), and the table type must not use
+        /// `incremental_resize`, `stash_capacity`, `dense_values` or `track_dirty_pages`.
+        pub const Shared = struct {
+            fn assertShareable() void {
+                assertMappable();
+                if (is_string) @compileError("shared tables don't support string keys");
+                if (incremental or stash_enabled or track_dirty) @compileError("shared tables don't support incremental_resize, stash_capacity or track_dirty_pages");
             }
 
-            // Disconnect from chain
-            self.metadata[prev] = (self.metadata[prev] & ~DISPLACEMENT_MASK) |
-                (self.metadata[bucket] & DISPLACEMENT_MASK);
+            /// The writer's table: this layout, written with release stores for the readers
+            const WriterMap = HashMapWithOptions(K, V, hashFn, eqlFn, writer_options: {
+                var writer_options = options;
+                writer_options.atomic_stores = true;
+                break :writer_options writer_options;
+            });
+
+            /// Lay out an empty table for up to `max_keys` keys in the memory object `fd`, which
+            /// must be empty, and map it for writing. Readers can `open` the object once this returns.
+            pub fn create(fd: posix.fd_t, max_keys: usize) !Writer {
+                comptime assertShareable();
+                var map = WriterMap.init(Allocator.failing);
+                const bucket_count = @max(map.minBucketCountForSize(max_keys), MIN_NONZERO_BUCKET_COUNT);
+
+                var header = mappedHeader();
+                header.max_load = map.max_load;
+                header.bucket_count = bucket_count;
+                header.storage_offset = std.mem.alignForward(u64, @sizeOf(MappedHeader), MAPPED_ALIGNMENT);
+                header.stash_offset = std.mem.alignForward(u64, header.storage_offset + mappedStorageSize(bucket_count), MAPPED_ALIGNMENT);
+                header.strings_offset = header.stash_offset;
+                const region_len = SHARED_IMAGE_OFFSET + @as(usize, @intCast(header.strings_offset));
+
+                try posix.ftruncate(fd, region_len);
+                const region = try posix.mmap(null, region_len, posix.PROT.READ | posix.PROT.WRITE, .{ .TYPE = .SHARED }, fd, 0);
+                errdefer posix.munmap(region);
+
+                const image = region[SHARED_IMAGE_OFFSET..];
+                const storage = image.ptr + @as(usize, @intCast(header.storage_offset));
+                map.buckets_mask = bucket_count - 1;
+                map.buckets = @ptrCast(@alignCast(storage));
+                map.values = if (separate_values) @ptrCast(@alignCast(storage + mappedValuesOffset(bucket_count))) else {};
+                map.metadata = @ptrCast(@alignCast(storage + mappedMetadataOffset(bucket_count)));
+                @memset(map.metadata[0 .. bucket_count + 4], EMPTY);
+                map.metadata[bucket_count] = 0x01;
+
+                const image_header: *MappedHeader = @ptrCast(@alignCast(image.ptr));
+                image_header.* = header;
+                const control: *SharedControl = @ptrCast(@alignCast(region.ptr));
+                control.* = .{ .image_offset = SHARED_IMAGE_OFFSET, .region_len = region_len };
+                return .{ .region = region, .control = control, .header = image_header, .map = map };
+            }
 
-            // Find new empty bucket
-            const empty_result = self.findFirstEmpty(home_bucket) orelse return false;
-            const empty = empty_result.index;
-            const displacement = empty_result.displacement;
+            /// Map the shared table in `fd` read-only.
+            pub fn open(fd: posix.fd_t) !Reader {
+                comptime assertShareable();
+                const len = std.math.cast(usize, (try posix.fstat(fd)).size) orelse return error.InvalidFormat;
+                if (len < SHARED_IMAGE_OFFSET) return error.InvalidFormat;
+                const region = try posix.mmap(null, len, posix.PROT.READ, .{ .TYPE = .SHARED }, fd, 0);
+                errdefer posix.munmap(region);
+
+                const control: *const SharedControl = @ptrCast(@alignCast(region.ptr));
+                if (!std.mem.eql(u8, &control.magic, &SHARED_MAGIC)) return error.InvalidFormat;
+                if (control.image_offset != SHARED_IMAGE_OFFSET or control.region_len != len) return error.InvalidFormat;
+                const view = try Mapped.fromBytes(region[SHARED_IMAGE_OFFSET..]);
+                return .{ .region = region, .control = control, .view = view };
+            }
 
-            // Find insert location
-            prev = self.findInsertLocationInChain(home_bucket, displacement);
+            /// The writing side, in the one process that changes the table.
+            pub const Writer = struct {
+                region: []align(std.heap.page_size_min) u8,
+                control: *SharedControl,
+                header: *MappedHeader,
+                /// The table, over the region's storage; never allocates
+                map: WriterMap,
+
+                /// Insert or update. Fails past `max_keys` or the displacement limit (see `Shared`).
+                pub fn put(self: *Writer, key: K, value: V) error{OutOfCapacity}!void {
+                    if (is_set) @compileError("Use add() for sets");
+                    return self.insert(key, value);
+                }
 
-            // Move key/value
-            self.buckets[empty] = self.buckets[bucket];
+                /// Add a key to a set.
+                pub fn add(self: *Writer, key: K) error{OutOfCapacity}!void {
+                    if (!is_set) @compileError("Use put() for maps");
+                    return self.insert(key, {});
+                }
 
-            // Re-link
-            self.metadata[empty] = (self.metadata[bucket] & HASH_FRAG_MASK) |
-                (self.metadata[prev] & DISPLACEMENT_MASK);
-            self.metadata[prev] = (self.metadata[prev] & ~DISPLACEMENT_MASK) | displacement;
+                fn insert(self: *Writer, key: K, value: V) error{OutOfCapacity}!void {
+                    const hash = hashFn(key);
+                    self.beginWrite();
+                    defer self.endWrite();
+                    _ = self.map.insertRaw(key, hash, value, false, true, true) orelse return error.OutOfCapacity;
+                }
 
-            return true;
-        }
+                /// Remove a key. Returns true if it was present.
+                pub fn remove(self: *Writer, key: K) bool {
+                    self.beginWrite();
+                    defer self.endWrite();
+                    return self.map.remove(key);
+                }
 
-        fn rehash(self: *Self, bucket_count: usize) !void {
-            var new_count = bucket_count;
-            while (true) {
-                var new_table = Self{
-                    .key_count = 0,
-                    .buckets_mask = new_count - 1,
-                    .buckets = undefined,
-                    .metadata = undefined,
-                    .allocator = self.allocator,
-                    .max_load = self.max_load,
-                };
+                /// Remove all keys.
+                pub fn clear(self: *Writer) void {
+                    self.beginWrite();
+                    defer self.endWrite();
+                    self.map.clear();
+                }
 
-                const alloc_size = new_table.totalAllocSizeForCount(new_count);
-                const new_mem = try self.allocator.alloc(u8, alloc_size);
-                errdefer self.allocator.free(new_mem);
+                /// Get the value for `key`; the writer never races with itself.
+                pub fn get(self: *const Writer, key: K) ?V {
+                    return self.map.get(key);
+                }
 
-                new_table.buckets = @ptrCast(@alignCast(new_mem.ptr));
-                new_table.metadata = @ptrCast(@alignCast(new_mem.ptr + new_table.metadataOffsetForCount(new_count)));
+                pub fn contains(self: *const Writer, key: K) bool {
+                    return self.map.contains(key);
+                }
 
-                // Initialize metadata to empty
-                @memset(new_table.metadata[0 .. new_count + 4], EMPTY);
-                // Iteration stopper
-                new_table.metadata[new_count] = 0x01;
+                pub fn count(self: *const Writer) usize {
+                    return self.map.count();
+                }
 
-                // Rehash all keys
-                var success = true;
-                if (self.buckets_mask != 0) {
-                    for (0..self.bucketCount()) |i| {
-                        if (self.metadata[i] != EMPTY) {
-                            const value = if (is_set) {} else self.buckets[i].val;
-                            const result = new_table.insertRaw(self.buckets[i].key, value, true, false);
-                            if (result == null) {
-                                success = false;
-                                break;
+                /// Keys the table takes before inserts fail.
+                pub fn capacity(self: *const Writer) usize {
+                    return self.map.capacity();
+                }
+
+                /// Unmap the region. The table stays in the memory object for readers.
+                pub fn close(self: *Writer) void {
+                    posix.munmap(self.region);
+                    self.* = undefined;
+                }
+
+                fn beginWrite(self: *Writer) void {
+                    // Odd from here on; the acquire half keeps the table writes below after it
+                    _ = @atomicRmw(u64, &self.control.sequence, .Add, 1, .acq_rel);
+                }
+
+                fn endWrite(self: *Writer) void {
+                    @atomicStore(u64, &self.header.key_count, self.map.key_count, .monotonic);
+                    const sequence = @atomicLoad(u64, &self.control.sequence, .monotonic);
+                    @atomicStore(u64, &self.control.sequence, sequence + 1, .release);
+                }
+            };
+
+            /// The reading side, in any number of processes.
+            pub const Reader = struct {
+                region: []align(std.heap.page_size_min) const u8,
+                control: *const SharedControl,
+                view: Mapped,
+
+                /// Get a copy of the value for `key`, or null if not found.
+                pub fn get(self: *const Reader, key: K) ?V {
+                    if (is_set) @compileError("Use contains() for sets");
+                    return self.lookup(key);
+                }
+
+                /// Check whether `key` is present.
+                pub fn contains(self: *const Reader, key: K) bool {
+                    return self.lookup(key) != null;
+                }
+
+                /// Number of keys as of the last finished change.
+                pub fn count(self: *const Reader) usize {
+                    const header: *const MappedHeader = @ptrCast(@alignCast(self.region.ptr + SHARED_IMAGE_OFFSET));
+                    return @intCast(@atomicLoad(u64, &header.key_count, .monotonic));
+                }
+
+                pub fn close(self: *Reader) void {
+                    posix.munmap(self.region);
+                    self.* = undefined;
+                }
+
+                fn lookup(self: *const Reader, key: K) ?V {
+                    const hash = hashFn(key);
+                    while (true) {
+                        const begin = @atomicLoad(u64, &self.control.sequence, .acquire);
+                        if (begin & 1 != 0) {
+                            std.atomic.spinLoopHint();
+                            continue;
+                        }
+                        const found = self.find(key, hash);
+                        if (@atomicLoad(u64, &self.control.sequence, .acquire) == begin) return found;
+                    }
+                }
+
+                /// One lookup attempt. Everything read may be mid-change: all loads are acquire
+                /// loads and the walk is bounded, and `lookup` discards the result on a change.
+                fn find(self: *const Reader, key: K, hash: u64) ?V {
+                    const view = &self.view;
+                    const home_bucket = hash & view.buckets_mask;
+                    var meta = @atomicLoad(MetaType, &view.metadata[home_bucket], .acquire);
+                    if ((meta & IN_HOME_BUCKET_MASK) == 0) return null;
+                    const frag = hashFrag(hash);
+                    var bucket = home_bucket;
+                    for (0..@as(usize, DISPLACEMENT_MASK) + 1) |_| {
+                        if (store_hash or (meta & HASH_FRAG_MASK) == frag) {
+                            var candidate: Bucket = undefined;
+                            acquireCopy(Bucket, &candidate, @ptrCast(&view.buckets[bucket]));
+                            const hash_match = if (store_hash) candidate.full_hash == hash else true;
+                            if (hash_match and eqlFn(candidate.key, key)) {
+                                return if (is_set) {} else if (separate_values) copy: {
+                                    var value: V = undefined;
+                                    acquireCopy(V, &value, &view.values[bucket]);
+                                    break :copy value;
+                                } else candidate.val;
                             }
                         }
+                        const displacement = meta & DISPLACEMENT_MASK;
+                        if (displacement == DISPLACEMENT_MASK) return null;
+                        bucket = (home_bucket + probeOffset(displacement)) & view.buckets_mask;
+                        meta = @atomicLoad(MetaType, &view.metadata[bucket], .acquire);
                     }
+                    return null;
                 }
+            };
+        };
 
-                if (!success) {
-                    // Displacement limit hit - double and retry
-                    self.allocator.free(new_mem);
-                    new_count = new_count * 2;
-                    continue;
+        // ====================================================================
+        // Change journal
+        // ====================================================================
+
+        fn assertJournalable() void {
+            if (!is_string and containsPointers(K)) @compileError("journaled keys must be []const u8 or contain no pointers");
+            if (containsPointers(V)) @compileError("journaled values must not contain pointers");
+        }
+
+        /// Record every following insert, removal and clear in `journal` (`Options.journal`),
+        /// or stop recording with `null`. Clones start without a journal.
+        pub fn setJournal(self: *Self, journal: ?*Journal) void {
+            if (!journaling) @compileError("setJournal requires Options.journal");
+            comptime assertJournalable();
+            self.syncJournal();
+            self.journal.log = journal;
+        }
+
+        /// Record the value of the last key inserted by `getOrPut` (or `putNoClobber`), which is
+        /// only known once the caller has written it. Happens on the next change to the table;
+        /// call this before shipping the journal so the last insert isn't missing.
+        pub fn syncJournal(self: *Self) void {
+            if (!journaling) @compileError("syncJournal requires Options.journal");
+            const key = self.journal.pending orelse return;
+            self.journal.pending = null;
+            const slot = self.findHashed(key, self.journal.pending_hash) orelse return;
+            self.journalRecord(.put, key, if (is_set) null else slot.val);
+        }
+
+        /// Record an insert through the public API: a replacing insert (`put`, `add`) is recorded
+        /// with its value, any other new key is left pending until `syncJournal`.
+        inline fn journalInsert(self: *Self, key: K, hash: u64, result: InsertResult, replace: bool) void {
+            if (self.journal.log == null) return;
+            if (replace) {
+                self.journalRecord(.put, key, if (is_set) null else result.val);
+            } else if (result.inserted) {
+                self.journal.pending = key;
+                self.journal.pending_hash = hash;
+            }
+        }
+
+        fn journalRecord(self: *Self, op: JournalOp, key: K, value: ?*const V) void {
+            const log = self.journal.log orelse return;
+            var len_buf: [10]u8 = undefined;
+            const key_len: []const u8 = if (is_string) encodeVarint(&len_buf, key.len) else &.{};
+            const key_bytes: []const u8 = if (is_string) key else std.mem.asBytes(&key);
+            const value_bytes: []const u8 = if (value) |ptr| std.mem.asBytes(ptr) else &.{};
+            log.append(&.{ &[_]u8{@intFromEnum(op)}, key_len, key_bytes, value_bytes });
+        }
+
+        /// Apply the records of a journal (`Journal.bytes.items` from a table of the same type) in
+        /// order. Records are decoded in groups of `DEFAULT_LOOKUP_BATCH_SIZE`, whose keys are all
+        /// hashed and prefetched before the group is applied. String keys point into `records`,
+        /// which has to stay alive while they are in the table. Returns the number of records
+        /// applied. A truncated or unknown record fails with `error.InvalidJournal` after the
+        /// groups before its own have been applied.
+        pub fn replay(self: *Self, records: []const u8) !usize {
+            comptime assertJournalable();
+            const batch_size = DEFAULT_LOOKUP_BATCH_SIZE;
+            var ops: [batch_size]JournalOp = undefined;
+            var keys: [batch_size]K = undefined;
+            var values: [batch_size]V = undefined;
+            var hashes: [batch_size]u64 = undefined;
+
+            var pos: usize = 0;
+            var applied: usize = 0;
+            while (pos < records.len) {
+                // Decode and prefetch a group; a clear ends it, so it is applied in order
+                var n: usize = 0;
+                while (n < batch_size and pos < records.len) {
+                    const op = std.meta.intToEnum(JournalOp, records[pos]) catch return error.InvalidJournal;
+                    if (op == .clear) {
+                        if (n != 0) break;
+                        pos += 1;
+                        self.clear();
+                        applied += 1;
+                        continue;
+                    }
+                    var next = pos + 1;
+                    keys[n] = try decodeJournalKey(records, &next);
+                    if (!is_set) {
+                        if (op == .put) values[n] = try decodeJournalValue(V, records, &next);
+                    }
+                    pos = next;
+                    ops[n] = op;
+                    hashes[n] = hashFn(keys[n]);
+                    self.prefetch(hashes[n]);
+                    n += 1;
                 }
 
-                // Free old allocation
-                if (self.buckets_mask != 0) {
-                    const old_size = self.totalAllocSize();
-                    const old_ptr: [*]u8 = @ptrCast(self.buckets);
-                    self.allocator.free(old_ptr[0..old_size]);
+                for (ops[0..n], keys[0..n], values[0..n], hashes[0..n]) |op, key, value, hash| {
+                    switch (op) {
+                        .put => if (is_set) try self.addWithHash(key, hash) else try self.putWithHash(key, value, hash),
+                        .remove => _ = self.removeWithHash(key, hash),
+                        .clear => unreachable,
+                    }
                 }
+                applied += n;
+            }
+            return applied;
+        }
 
-                self.* = new_table;
-                return;
+        fn decodeJournalKey(records: []const u8, pos: *usize) error{InvalidJournal}!K {
+            if (is_string) {
+                const len = try decodeVarint(records, pos);
+                if (len > records.len - pos.*) return error.InvalidJournal;
+                const key = records[pos.*..][0..@intCast(len)];
+                pos.* += @intCast(len);
+                return key;
             }
+            return decodeJournalValue(K, records, pos);
         }
 
-        fn metadataOffset(self: *const Self) usize {
-            return self.metadataOffsetForCount(self.bucketCount());
+        fn decodeJournalValue(comptime T: type, records: []const u8, pos: *usize) error{InvalidJournal}!T {
+            if (@sizeOf(T) > records.len - pos.*) return error.InvalidJournal;
+            const value = std.mem.bytesToValue(T, records[pos.*..][0..@sizeOf(T)]);
+            pos.* += @sizeOf(T);
+            return value;
         }
 
-        fn metadataOffsetForCount(self: *const Self, bucket_count: usize) usize {
-            _ = self;
-            const bucket_size = bucket_count * @sizeOf(Bucket);
-            // Align to MetaType
-            return std.mem.alignForward(usize, bucket_size, @alignOf(MetaType));
+        // ====================================================================
+        // Parallel construction and rehash
+        // ====================================================================
+        //
+        // `fromSlices` and the pool-driven rehash hash their input in parallel, radix-partition it
+        // by the high bits of the home bucket, and insert each partition into its own range of a
+        // pre-sized table. Inserting a key only touches buckets within DISPLACEMENT_MASK of its
+        // home bucket: its chain, the search for an empty slot and, when evicting, the evicted
+        // key's chain. With partitions at least that large, inserting partition p stays within
+        // partitions p - 1 to p + 1, so partitions three apart never share a bucket, and chains
+        // crossing a partition boundary are linked by whichever worker owns them at the time.
+        // Partitions are inserted in three rounds of `p % 3`, each worker with its own copy of
+        // the table header (key count and stash). Keys that overflow the displacement limit are
+        // inserted afterwards, one by one.
+
+        /// Build a table from `keys` and `values` (ignored for sets; pass `&.{}`), using the
+        /// threads of `pool` plus the calling thread. With duplicate keys, one of their values
+        /// is kept, not necessarily the last. Small tables, and `Options.dense_values` tables,
+        /// are built with plain inserts.
+        pub fn fromSlices(allocator: Allocator, pool: *std.Thread.Pool, keys: []const K, values: []const V) !Self {
+            if (!is_set) std.debug.assert(values.len == keys.len);
+
+            var table = Self.init(allocator);
+            errdefer table.deinit();
+            try table.reserve(keys.len);
+
+            if (!dense_values and table.partitionCount(pool) >= MIN_PARALLEL_BUILD_PARTITIONS) {
+                _ = try table.insertPartitioned(pool, SliceSource{ .keys = keys, .values = values }, true);
+                return table;
+            }
+            for (keys, 0..) |key, i| {
+                _ = try table.insertInternal(key, if (is_set) {} else values[i], false, true);
+            }
+            return table;
         }
 
-        fn totalAllocSize(self: *const Self) usize {
-            return self.totalAllocSizeForCount(self.bucketCount());
+        /// Use `pool` for rehashes of large tables (`Options.parallel_rehash`), or stop with `null`.
+        /// Covers growth, `reserve` and `shrink`; growth in place and the migration steps of an
+        /// incremental resize stay single-threaded. The pool must outlive its use by the table.
+        pub fn setRehashPool(self: *Self, pool: ?*std.Thread.Pool) void {
+            if (!options.parallel_rehash) @compileError("setRehashPool() requires Options.parallel_rehash");
+            self.rehash_pool = pool;
         }
 
-        fn totalAllocSizeForCount(self: *const Self, bucket_count: usize) usize {
-            return self.metadataOffsetForCount(bucket_count) + (bucket_count + 4) * @sizeOf(MetaType);
+        /// `fromSlices` input.
+        const SliceSource = struct {
+            keys: []const K,
+            values: []const V,
+
+            fn len(self: SliceSource) usize {
+                return self.keys.len;
+            }
+            fn occupied(_: SliceSource, _: usize) bool {
+                return true;
+            }
+            fn hash(self: SliceSource, i: usize) u64 {
+                return hashFn(self.keys[i]);
+            }
+            fn key(self: SliceSource, i: usize) K {
+                return self.keys[i];
+            }
+            fn payload(self: SliceSource, i: usize) Payload {
+                return if (is_set) {} else self.values[i];
+            }
+        };
+
+        /// The buckets of a table being rehashed (its stash is moved separately).
+        const TableSource = struct {
+            table: *const Self,
+
+            fn len(self: TableSource) usize {
+                return self.table.bucketCount();
+            }
+            fn occupied(self: TableSource, i: usize) bool {
+                return self.table.metadata[i] != EMPTY;
+            }
+            fn hash(self: TableSource, i: usize) u64 {
+                return self.table.bucketHash(i);
+            }
+            fn key(self: TableSource, i: usize) K {
+                return self.table.buckets[i].key;
+            }
+            fn payload(self: TableSource, i: usize) Payload {
+                return self.table.payloadAt(i);
+            }
+        };
+
+        /// Partitions for a parallel insert on `pool`: a power of two, each at least
+        /// DISPLACEMENT_MASK buckets.
+        fn partitionCount(self: *const Self, pool: *std.Thread.Pool) usize {
+            const workers = pool.threads.len + 1;
+            const min_size = math.ceilPowerOfTwoAssert(usize, @as(usize, DISPLACEMENT_MASK) + 1);
+            return @min(self.bucketCount() / min_size, math.ceilPowerOfTwoAssert(usize, workers * BUILD_PARTITIONS_PER_WORKER));
         }
 
-        fn minBucketCountForSize(self: *const Self, size: usize) usize {
-            if (size == 0) return 0;
-            var bucket_count: usize = MIN_NONZERO_BUCKET_COUNT;
-            while (size > @as(usize, @intFromFloat(@as(f32, @floatFromInt(bucket_count)) * self.max_load))) {
-                bucket_count *= 2;
+        /// Insert every occupied entry of `source` on `pool` (see above). The table must already
+        /// have room for all of them. Keys that overflow are inserted one by one at the end; with
+        /// `grow` the table may grow for them, otherwise this returns false if one doesn't fit.
+        fn insertPartitioned(self: *Self, pool: *std.Thread.Pool, source: anytype, comptime grow: bool) !bool {
+            const Source = @TypeOf(source);
+            const allocator = self.allocator;
+            const source_len = source.len();
+            const partition_count = self.partitionCount(pool);
+            const shift = math.log2_int(usize, self.bucketCount() / partition_count);
+
+            const hashes = try allocator.alloc(u64, source_len);
+            defer allocator.free(hashes);
+            const by_partition = try allocator.alloc(usize, source_len);
+            defer allocator.free(by_partition);
+            const partition_starts = try allocator.alloc(usize, partition_count + 1);
+            defer allocator.free(partition_starts);
+
+            // Each worker hashes a contiguous range of the source, counting its keys per partition
+            const chunk_count = (pool.threads.len + 1) * 4;
+            const offsets = try allocator.alloc(usize, chunk_count * partition_count);
+            defer allocator.free(offsets);
+            @memset(offsets, 0);
+
+            var wg: std.Thread.WaitGroup = .{};
+            for (0..chunk_count) |c| {
+                const chunk_offsets = offsets[c * partition_count ..][0..partition_count];
+                pool.spawnWg(&wg, hashChunk(Source), .{ source, hashes, chunk_offsets, chunkStart(source_len, chunk_count, c), chunkStart(source_len, chunk_count, c + 1), self.buckets_mask, shift });
             }
-            return bucket_count;
+            pool.waitAndWork(&wg);
+
+            // Turn the counts into write offsets: partitions in order, chunks in order within
+            // each, so every partition lists its keys in source order
+            var total: usize = 0;
+            for (0..partition_count) |p| {
+                partition_starts[p] = total;
+                for (0..chunk_count) |c| {
+                    const chunk_keys = offsets[c * partition_count + p];
+                    offsets[c * partition_count + p] = total;
+                    total += chunk_keys;
+                }
+            }
+            partition_starts[partition_count] = total;
+
+            wg.reset();
+            for (0..chunk_count) |c| {
+                const chunk_offsets = offsets[c * partition_count ..][0..partition_count];
+                pool.spawnWg(&wg, scatterChunk(Source), .{ source, hashes, by_partition, chunk_offsets, chunkStart(source_len, chunk_count, c), chunkStart(source_len, chunk_count, c + 1), self.buckets_mask, shift });
+            }
+            pool.waitAndWork(&wg);
+
+            const views = try allocator.alloc(Self, partition_count);
+            defer allocator.free(views);
+            const deferred = try allocator.alloc(usize, partition_count);
+            defer allocator.free(deferred);
+
+            const colored = partition_count - partition_count % 3;
+            for (0..3) |color| {
+                wg.reset();
+                var p = color;
+                while (p < colored) : (p += 3) {
+                    views[p] = self.partitionView();
+                    const part = by_partition[partition_starts[p]..partition_starts[p + 1]];
+                    pool.spawnWg(&wg, insertPartition(Source), .{ &views[p], source, hashes, part, &deferred[p] });
+                }
+                pool.waitAndWork(&wg);
+            }
+            // Any partitions past the last multiple of three border partition 0 across the wrap-around
+            for (colored..partition_count) |p| {
+                views[p] = self.partitionView();
+                insertPartition(Source)(&views[p], source, hashes, by_partition[partition_starts[p]..partition_starts[p + 1]], &deferred[p]);
+            }
+
+            for (views) |*view| self.key_count += view.key_count;
+            for (views, deferred, 0..) |*view, deferred_len, p| {
+                if (stash_enabled) {
+                    for (view.stash.entries[0..view.stash.len], 0..) |*bucket, i| {
+                        if (!try self.insertLeftover(bucket.key, entryHash(bucket), view.stashPayload(i), grow)) return false;
+                    }
+                }
+                for (by_partition[partition_starts[p]..][0..deferred_len]) |i| {
+                    if (!try self.insertLeftover(source.key(i), hashes[i], source.payload(i), grow)) return false;
+                }
+            }
+            return true;
         }
-    };
-}
 
-// ============================================================================
-// Tests
-// ============================================================================
+        inline fn insertLeftover(self: *Self, key: K, hash: u64, value: Payload, comptime grow: bool) !bool {
+            if (grow) {
+                // Only `fromSlices` grows, and it never has dense values
+                _ = try self.insertInternalHashed(key, hash, value, false, true);
+                return true;
+            }
+            return self.insertRaw(key, hash, value, true, false, true) != null;
+        }
 
-test "basic map operations" {
-    const allocator = std.testing.allocator;
-    var map = HashMap(u32, []const u8).init(allocator);
-    defer map.deinit();
+        fn chunkStart(len: usize, chunk_count: usize, chunk: usize) usize {
+            return len * chunk / chunk_count;
+        }
 
-    try map.put(1, "one");
-    try map.put(2, "two");
-    try map.put(3, "three");
+        fn hashChunk(comptime Source: type) fn (Source, []u64, []usize, usize, usize, usize, math.Log2Int(usize)) void {
+            return struct {
+                fn run(source: Source, hashes: []u64, partition_counts: []usize, start: usize, end: usize, mask: usize, shift: math.Log2Int(usize)) void {
+                    for (start..end) |i| {
+                        if (!source.occupied(i)) continue;
+                        hashes[i] = source.hash(i);
+                        partition_counts[(hashes[i] & mask) >> shift] += 1;
+                    }
+                }
+            }.run;
+        }
 
-    try std.testing.expectEqual(@as(usize, 3), map.count());
-    try std.testing.expectEqualStrings("one", map.get(1).?);
-    try std.testing.expectEqualStrings("two", map.get(2).?);
-    try std.testing.expectEqualStrings("three", map.get(3).?);
-    try std.testing.expect(map.get(4) == null);
+        fn scatterChunk(comptime Source: type) fn (Source, []const u64, []usize, []usize, usize, usize, usize, math.Log2Int(usize)) void {
+            return struct {
+                fn run(source: Source, hashes: []const u64, by_partition: []usize, partition_offsets: []usize, start: usize, end: usize, mask: usize, shift: math.Log2Int(usize)) void {
+                    for (start..end) |i| {
+                        if (!source.occupied(i)) continue;
+                        const p = (hashes[i] & mask) >> shift;
+                        by_partition[partition_offsets[p]] = i;
+                        partition_offsets[p] += 1;
+                    }
+                }
+            }.run;
+        }
 
-    // Update
-    try map.put(2, "TWO");
-    try std.testing.expectEqualStrings("TWO", map.get(2).?);
+        /// A worker's copy of the table header: shares the allocation, counts its own keys and
+        /// stashes into its own stash.
+        fn partitionView(self: *const Self) Self {
+            var view = self.*;
+            view.key_count = 0;
+            if (stash_enabled) view.stash = .{};
+            return view;
+        }
 
-    // Remove
-    try std.testing.expect(map.remove(2));
-    try std.testing.expect(map.get(2) == null);
-    try std.testing.expectEqual(@as(usize, 2), map.count());
+        /// Insert the entries of one partition (indices into `source`), skipping the load check:
+        /// the table was sized for all of them. Entries that don't fit are moved to the front of
+        /// `part` and counted in `deferred`.
+        fn insertPartition(comptime Source: type) fn (*Self, Source, []const u64, []usize, *usize) void {
+            return struct {
+                fn run(view: *Self, source: Source, hashes: []const u64, part: []usize, deferred: *usize) void {
+                    // Rehashed keys are known to be unique
+                    const unique = Source == TableSource;
+                    var kept: usize = 0;
+                    for (part) |i| {
+                        if (view.insertRaw(source.key(i), hashes[i], source.payload(i), unique, !unique, false) == null) {
+                            part[kept] = i;
+                            kept += 1;
+                        }
+                    }
+                    deferred.* = kept;
+                }
+            }.run;
+        }
+
+        // ====================================================================
+        // Parallel iteration
+        // ====================================================================
+        //
+        // `parallelForEach` and `parallelReduce` split the bucket array into contiguous ranges,
+        // aligned to a cache line of metadata, and walk each with an `iteratorRange` on the pool.
+        // The last range also covers the draining allocation and the stash, so the ranges see
+        // every entry exactly once.
+
+        /// Call `func(context, key_ptr, value_ptr)` for every entry, from the threads of `pool`
+        /// and the calling thread at once, in no particular order. `value_ptr` is `*const V`
+        /// (`*const void` for sets). The table must not be modified until this returns.
+        pub fn parallelForEach(self: *const Self, pool: *std.Thread.Pool, context: anytype, comptime func: anytype) void {
+            const range_count = self.scanRangeCount(pool);
+            var wg: std.Thread.WaitGroup = .{};
+            for (0..range_count) |r| {
+                pool.spawnWg(&wg, forEachRange(@TypeOf(context), func), .{ self, context, self.scanRangeStart(range_count, r), self.scanRangeStart(range_count, r + 1) });
+            }
+            pool.waitAndWork(&wg);
+        }
+
+        /// Fold every entry into an `Acc` on `pool`: each range starts from `identity` and folds
+        /// its entries with `accumulate(context, acc, key_ptr, value_ptr) Acc`; the per-range
+        /// results are then folded in range order with `combine(context, a, b) Acc` on the
+        /// calling thread. Entries within a range are visited in bucket order, but which range an
+        /// entry falls in depends on the table size, so `combine` should be associative and
+        /// commutative. The table must not be modified until this returns.
+        pub fn parallelReduce(
+            self: *const Self,
+            pool: *std.Thread.Pool,
+            comptime Acc: type,
+            identity: Acc,
+            context: anytype,
+            comptime accumulate: anytype,
+            comptime combine: anytype,
+        ) !Acc {
+            const range_count = self.scanRangeCount(pool);
+            const partials = try self.allocator.alloc(Acc, range_count);
+            defer self.allocator.free(partials);
+
+            var wg: std.Thread.WaitGroup = .{};
+            for (partials, 0..) |*partial, r| {
+                pool.spawnWg(&wg, reduceRange(Acc, @TypeOf(context), accumulate), .{ self, identity, context, self.scanRangeStart(range_count, r), self.scanRangeStart(range_count, r + 1), partial });
+            }
+            pool.waitAndWork(&wg);
+
+            var result = identity;
+            for (partials) |partial| result = combine(context, result, partial);
+            return result;
+        }
+
+        /// Ranges for a parallel scan on `pool`; 1 for tables too small to be worth splitting.
+        fn scanRangeCount(self: *const Self, pool: *std.Thread.Pool) usize {
+            const workers = pool.threads.len + 1;
+            return @max(1, @min(workers * SCAN_RANGES_PER_WORKER, self.bucketCount() / MIN_SCAN_RANGE_BUCKETS));
+        }
+
+        /// First bucket of scan range `r`; ranges start on a cache line of metadata.
+        fn scanRangeStart(self: *const Self, range_count: usize, r: usize) usize {
+            if (r == range_count) return self.bucketCount();
+            const per_line = 64 / @sizeOf(MetaType);
+            return std.mem.alignBackward(usize, chunkStart(self.bucketCount(), range_count, r), per_line);
+        }
+
+        fn forEachRange(comptime Context: type, comptime func: anytype) fn (*const Self, Context, usize, usize) void {
+            return struct {
+                fn run(table: *const Self, context: Context, begin: usize, end: usize) void {
+                    var it = table.iteratorRange(begin, end);
+                    while (it.advance()) |i| func(context, &it.bucketAt(i).key, it.slotValue(i));
+                }
+            }.run;
+        }
+
+        fn reduceRange(comptime Acc: type, comptime Context: type, comptime accumulate: anytype) fn (*const Self, Acc, Context, usize, usize, *Acc) void {
+            return struct {
+                fn run(table: *const Self, identity: Acc, context: Context, begin: usize, end: usize, out: *Acc) void {
+                    var acc = identity;
+                    var it = table.iteratorRange(begin, end);
+                    while (it.advance()) |i| acc = accumulate(context, acc, &it.bucketAt(i).key, it.slotValue(i));
+                    out.* = acc;
+                }
+            }.run;
+        }
+
+        // ====================================================================
+        // Incremental resize
+        // ====================================================================
+        //
+        // With `Options.incremental_resize`, growing allocates the new table and keeps the old one
+        // in `draining`. Every key lives in exactly one of the two: keys whose old home bucket is
+        // below `migrate_index` are in the new table, the rest may still be in the old one.
+        // Each insert and remove migrates `resize_step` more old home buckets (whole chains, so the
+        // invariant holds), and an insert first migrates its own key's old chain so that duplicate
+        // detection only needs to look at the new table. Lookups are read-only and check both.
+
+        /// Whether an incremental resize is in progress (always false without `incremental_resize`).
+        pub fn isResizing(self: *const Self) bool {
+            if (incremental) return self.draining != null;
+            return false;
+        }
+
+        /// Complete an in-progress incremental resize now, freeing the old allocation.
+        /// Useful before a latency-sensitive phase or to cap peak memory.
+        pub fn finishResize(self: *Self) !void {
+            if (incremental) {
+                if (self.draining == null) return;
+                if (!self.migrateStep(std.math.maxInt(usize))) {
+                    // The new table filled up before the old one drained; merge both into a fresh one
+                    try self.rehash(@max(self.bucketCount(), self.minBucketCountForSize(self.count())));
+                }
+            }
+        }
+
+        /// Start an incremental resize into a table of `bucket_count` buckets.
+        fn beginResize(self: *Self, bucket_count: usize) !void {
+            const new_table = try self.emptyTableForCount(bucket_count);
+            self.draining = .{
+                .buckets = self.buckets,
+                .values = self.values,
+                .metadata = self.metadata,
+                .buckets_mask = self.buckets_mask,
+                .key_count = self.key_count,
+                .migrate_index = 0,
+            };
+            self.key_count = 0;
+            self.buckets_mask = new_table.buckets_mask;
+            self.buckets = new_table.buckets;
+            self.values = new_table.values;
+            self.metadata = new_table.metadata;
+        }
+
+        /// A table value over the draining allocation, so the regular lookup and erase code can run on it.
+        /// Callers that erase through it must write `key_count` back.
+        inline fn drainingView(self: *const Self) Self {
+            const old = self.draining.?;
+            return .{
+                .key_count = old.key_count,
+                .buckets_mask = old.buckets_mask,
+                .buckets = old.buckets,
+                .values = old.values,
+                .metadata = old.metadata,
+                .allocator = self.allocator,
+                .max_load = self.max_load,
+                .draining = null,
+                .stash = if (stash_enabled) .{} else {},
+                .dense = self.dense,
+                .rehash_pool = self.rehash_pool,
+                .journal = self.journal,
+            };
+        }
+
+        /// Migrate the next `budget` old home buckets, plus the old chain `hash` belongs to, so
+        /// that an insert of that key only has to look at the new table.
+        /// Returns false if the new table ran out of room.
+        fn migrateFor(self: *Self, hash: u64, budget: usize) bool {
+            if (!self.migrateStep(budget)) return false;
+            if (self.draining) |old| {
+                const old_home = hash & old.buckets_mask;
+                if (old_home >= old.migrate_index) return self.migrateChain(old_home);
+            }
+            return true;
+        }
+
+        /// Migrate up to `budget` old home buckets; frees the old allocation once it is drained.
+        /// Returns false if the new table ran out of room (no key is lost either way).
+        fn migrateStep(self: *Self, budget: usize) bool {
+            const old = &self.draining.?;
+            const end = @min(old.migrate_index +| budget, old.buckets_mask + 1);
+            while (old.migrate_index < end) : (old.migrate_index += 1) {
+                if (!self.migrateChain(old.migrate_index)) return false;
+            }
+            if (old.migrate_index > old.buckets_mask) self.freeDraining();
+            return true;
+        }
+
+        /// Move every key whose home is old bucket `home` into the new table.
+        fn migrateChain(self: *Self, home: usize) bool {
+            var view = self.drainingView();
+            defer self.draining.?.key_count = view.key_count;
+
+            // Erasing the home entry pulls the chain's last entry into it, until the chain is empty
+            while ((view.metadata[home] & IN_HOME_BUCKET_MASK) != 0) {
+                if (self.insertRaw(view.buckets[home].key, view.bucketHash(home), view.payloadAt(home), true, false, true) == null) {
+                    @branchHint(.unlikely);
+                    return false;
+                }
+                view.eraseAtIndex(home, home);
+            }
+            return true;
+        }
+
+        fn freeDraining(self: *Self) void {
+            const old = self.draining orelse return;
+            const old_size = self.totalAllocSizeForCount(old.buckets_mask + 1);
+            const old_ptr: [*]u8 = @ptrCast(old.buckets);
+            self.freeBlock(old_ptr[0..old_size]);
+            self.draining = null;
+        }
+
+        // ====================================================================
+        // Internal Implementation
+        // ====================================================================
+
+        const InsertResult = struct {
+            bucket: *Bucket,
+            val: *V,
+            inserted: bool,
+        };
+
+        /// A key's bucket and its value, which live apart with `Options.separate_values`.
+        const Slot = struct {
+            bucket: *Bucket,
+            val: *V,
+        };
+
+        inline fn insertInternal(self: *Self, key: K, value: V, unique: bool, replace: bool) !InsertResult {
+            return self.insertInternalHashed(key, hashFn(key), value, unique, replace);
+        }
+
+        /// Insert with a precomputed `hash` (must equal `hashFn(key)`).
+        inline fn insertInternalHashed(self: *Self, key: K, hash: u64, value: V, unique: bool, replace: bool) !InsertResult {
+            if (journaling) self.syncJournal();
+            const result = if (dense_values) dense: {
+                // A new key takes the next dense slot; room for it is made up front so that the
+                // returned value pointer stays valid
+                try self.dense.ensureUnusedCapacity(self.allocator, 1);
+                const dense_result = try self.insertPayload(key, hash, @intCast(self.dense.len), unique, replace);
+                self.commitDense(dense_result, key, value, replace);
+                break :dense dense_result;
+            } else try self.insertPayload(key, hash, value, unique, replace);
+            if (journaling) self.journalInsert(key, hash, result, replace);
+            return result;
+        }
+
+        /// Insert into a table that already has room: no load check, growth or allocation.
+        inline fn insertAssumeCapacity(self: *Self, key: K, hash: u64, value: V, replace: bool) InsertResult {
+            std.debug.assert(self.buckets_mask != 0);
+            if (incremental) std.debug.assert(self.draining == null);
+            if (journaling) self.syncJournal();
+
+            const payload: Payload = if (dense_values) @intCast(self.dense.len) else value;
+            const result = while (true) {
+                if (self.insertRaw(key, hash, payload, false, replace, false)) |r| break r else {
+                    // Past the displacement limit and the stash: grow after all, stop-the-world
+                    // so no resize is left in progress
+                    @branchHint(.cold);
+                    self.rehash(self.bucketCount() * 2) catch @panic("out of memory growing a table past a displacement overflow");
+                }
+            };
+            std.debug.assert(self.key_count <= self.capacity());
+            if (dense_values) self.commitDense(result, key, value, replace);
+            if (journaling) self.journalInsert(key, hash, result, replace);
+            return result;
+        }
+
+        /// Record the dense entry of a key just inserted at payload `dense.len`, or replace the
+        /// existing one. The dense array must have room for one more entry.
+        inline fn commitDense(self: *Self, result: InsertResult, key: K, value: V, replace: bool) void {
+            if (result.inserted) {
+                self.dense.appendAssumeCapacity(.{ .key = key, .value = value });
+            } else if (replace) {
+                self.dense.set(result.bucket.idx, .{ .key = key, .value = value });
+            }
+        }
+
+        /// Insert loop: grows the table until `insertRaw` finds room.
+        inline fn insertPayload(self: *Self, key: K, hash: u64, value: Payload, unique: bool, replace: bool) !InsertResult {
+            while (true) {
+                if (incremental) {
+                    if (self.draining != null and !self.migrateFor(hash, options.resize_step)) {
+                        @branchHint(.unlikely);
+                        try self.finishResize();
+                    }
+                }
+
+                if (self.insertRaw(key, hash, value, unique, replace, true)) |r| {
+                    return r;
+                } else {
+                    // Need to grow and rehash - unlikely path
+                    @branchHint(.unlikely);
+                    if (incremental) {
+                        if (self.draining != null) {
+                            try self.finishResize();
+                            continue;
+                        }
+                        if (self.buckets_mask != 0) {
+                            try self.beginResize(self.bucketCount() * 2);
+                            continue;
+                        }
+                    }
+                    const new_count = if (self.buckets_mask != 0)
+                        self.bucketCount() * 2
+                    else
+                        MIN_NONZERO_BUCKET_COUNT;
+                    try self.rehash(new_count);
+                }
+            }
+        }
+
+        inline fn insertRaw(self: *Self, key: K, hash: u64, value: Payload, unique: bool, replace: bool, check_load: bool) ?InsertResult {
+            // Empty table - trigger allocation
+            if (self.buckets_mask == 0) return null;
+
+            // A stashed key has no chain to be found in
+            if (stash_enabled) {
+                if (!unique and self.stash.len != 0) {
+                    if (self.findInStash(key, hash)) |i| {
+                        @branchHint(.unlikely);
+                        const bucket = &self.stash.entries[i];
+                        if (replace) {
+                            bucket.key = key;
+                            // A dense value is replaced by the caller
+                            if (!is_set and !dense_values) {
+                                self.stashValue(i).* = value;
+                            }
+                        }
+                        return .{ .bucket = bucket, .val = self.stashValue(i), .inserted = false };
+                    }
+                }
+            }
+
+            const frag = hashFrag(hash);
+            const home_bucket = hash & self.buckets_mask;
+
+            // Prefetch bucket data while we check metadata (hides memory latency)
+            @prefetch(&self.buckets[home_bucket], .{});
+
+            // Case 1: Home bucket is empty or occupied by non-belonging key
+            if ((self.metadata[home_bucket] & IN_HOME_BUCKET_MASK) == 0) {
+                // Load factor check - unlikely to trigger during normal operation
+                if (check_load and self.key_count + 1 > self.capacity()) {
+                    @branchHint(.unlikely);
+                    return null;
+                }
+
+                // Evict if occupied by non-belonging key
+                if (self.metadata[home_bucket] != EMPTY) {
+                    if (!self.evict(home_bucket)) {
+                        @branchHint(.unlikely);
+                        return self.stashInsert(key, hash, value);
+                    }
+                }
+
+                self.storeEntry(home_bucket, key, hash, value);
+                self.setMeta(home_bucket, frag | IN_HOME_BUCKET_MASK | DISPLACEMENT_MASK);
+                self.markDirty(home_bucket);
+                self.key_count += 1;
+
+                return .{ .bucket = &self.buckets[home_bucket], .val = self.valueAt(home_bucket), .inserted = true };
+            }
+
+            // Case 2: Home bucket contains beginning of a chain
+            // Search the chain for existing key (unless unique)
+            if (!unique) {
+                var bucket = home_bucket;
+                while (true) {
+                    // With stored hashes: compare full hash first (much cheaper than eqlFn)
+                    const hash_match = if (store_hash)
+                        self.buckets[bucket].full_hash == hash
+                    else
+                        (self.metadata[bucket] & HASH_FRAG_MASK) == frag;
+
+                    if (hash_match and eqlFn(self.buckets[bucket].key, key)) {
+                        if (replace) {
+                            if (atomic_stores) {
+                                self.storeEntry(bucket, key, hash, value);
+                            } else {
+                                self.buckets[bucket].key = key;
+                                if (!is_set and !dense_values) {
+                                    self.valueAt(bucket).* = value;
+                                }
+                            }
+                        }
+                        return .{ .bucket = &self.buckets[bucket], .val = self.valueAt(bucket), .inserted = false };
+                    }
+
+                    const displacement = self.metadata[bucket] & DISPLACEMENT_MASK;
+                    if (displacement == DISPLACEMENT_MASK) break;
+                    bucket = (home_bucket + probeOffset(displacement)) & self.buckets_mask;
+                }
+            }
+
+            // Load factor check - unlikely to trigger during normal operation
+            if (check_load and self.key_count + 1 > self.capacity()) {
+                @branchHint(.unlikely);
+                return null;
+            }
+
+            // Find empty bucket - unlikely to fail
+            const empty_result = self.findFirstEmpty(home_bucket) orelse {
+                @branchHint(.unlikely);
+                return self.stashInsert(key, hash, value);
+            };
+            const empty = empty_result.index;
+            const displacement = empty_result.displacement;
+
+            // Find insert location in chain
+            const prev = self.findInsertLocationInChain(home_bucket, displacement);
+
+            // Insert
+            self.storeEntry(empty, key, hash, value);
+            self.setMeta(empty, frag | (self.metadata[prev] & DISPLACEMENT_MASK));
+            self.markDirty(empty);
+            self.setMeta(prev, (self.metadata[prev] & ~DISPLACEMENT_MASK) | displacement);
+            self.key_count += 1;
+
+            return .{ .bucket = &self.buckets[empty], .val = self.valueAt(empty), .inserted = true };
+        }
+
+        /// Put a key that exceeded the displacement limit into the stash.
+        /// Returns null (grow the table) when there is no stash or it is full.
+        fn stashInsert(self: *Self, key: K, hash: u64, value: Payload) ?InsertResult {
+            if (stash_enabled) {
+                if (self.stash.len == options.stash_capacity) return null;
+
+                const i = self.stash.len;
+                const bucket = &self.stash.entries[i];
+                bucket.key = key;
+                if (dense_values) {
+                    bucket.idx = value;
+                } else if (!is_set) {
+                    self.stashValue(i).* = value;
+                }
+                if (store_hash) {
+                    bucket.full_hash = hash;
+                }
+                self.stash.len += 1;
+                return .{ .bucket = bucket, .val = self.stashValue(i), .inserted = true };
+            }
+            return null;
+        }
+
+        /// Linear scan of the stash; only reached once the table proper has missed.
+        /// Returns the index of the key's stash entry.
+        fn findInStash(self: *const Self, key: K, hash: u64) ?usize {
+            for (self.stash.entries[0..self.stash.len], 0..) |*bucket, i| {
+                const hash_match = if (store_hash) bucket.full_hash == hash else true;
+                if (hash_match and eqlFn(bucket.key, key)) return i;
+            }
+            return null;
+        }
+
+        /// Bucket and value of stash entry `i`.
+        /// Same mutability as the bucket array: callers holding a *Self may write through them.
+        inline fn stashSlot(self: *const Self, i: usize) Slot {
+            return .{ .bucket = @constCast(&self.stash.entries[i]), .val = self.stashValue(i) };
+        }
+
+        inline fn stashValue(self: *const Self, i: usize) *V {
+            return if (is_set)
+                &set_value
+            else if (dense_values)
+                &self.dense.items(.value).ptr[self.stash.entries[i].idx]
+            else if (separate_values)
+                @constCast(&self.stash.values[i])
+            else
+                @constCast(&self.stash.entries[i].val);
+        }
+
+        /// Value of bucket `idx`, wherever the layout keeps it (a placeholder for sets).
+        inline fn valueAt(self: *const Self, idx: usize) *V {
+            return if (is_set)
+                &set_value
+            else if (dense_values)
+                // Through `ptr`: a just-inserted key's entry is only appended after `insertRaw`
+                &self.dense.items(.value).ptr[self.buckets[idx].idx]
+            else if (separate_values)
+                &self.values[idx]
+            else
+                &self.buckets[idx].val;
+        }
+
+        /// What moving bucket `idx` into another table carries along (see `Payload`).
+        inline fn payloadAt(self: *const Self, idx: usize) Payload {
+            return if (dense_values) self.buckets[idx].idx else self.valueAt(idx).*;
+        }
+
+        inline fn stashPayload(self: *const Self, i: usize) Payload {
+            return if (dense_values) self.stash.entries[i].idx else self.stashValue(i).*;
+        }
+
+        inline fn storePayload(self: *Self, idx: usize, value: Payload) void {
+            if (dense_values) {
+                self.buckets[idx].idx = value;
+            } else if (!is_set) {
+                self.valueAt(idx).* = value;
+            }
+        }
+
+        /// Write `key`, its hash (when stored) and `value` into bucket `idx`.
+        inline fn storeEntry(self: *Self, idx: usize, key: K, hash: u64, value: Payload) void {
+            if (atomic_stores) {
+                var bucket = self.buckets[idx];
+                bucket.key = key;
+                if (store_hash) bucket.full_hash = hash;
+                if (!is_set and !separate_values) bucket.val = value;
+                self.setBucket(idx, bucket);
+                if (separate_values) self.setValue(idx, value);
+                return;
+            }
+            self.buckets[idx].key = key;
+            self.storePayload(idx, value);
+            if (store_hash) {
+                self.buckets[idx].full_hash = hash;
+            }
+        }
+
+        // Stores into the bucket arrays that readers may be copying (see `Options.atomic_stores`)
+
+        inline fn setMeta(self: *Self, idx: usize, meta: MetaType) void {
+            if (atomic_stores) @atomicStore(MetaType, &self.metadata[idx], meta, .release) else self.metadata[idx] = meta;
+        }
+
+        inline fn setBucket(self: *Self, idx: usize, bucket: Bucket) void {
+            if (atomic_stores) releaseCopy(Bucket, &self.buckets[idx], &bucket) else self.buckets[idx] = bucket;
+        }
+
+        inline fn setValue(self: *Self, idx: usize, value: V) void {
+            if (atomic_stores) releaseCopy(V, &self.values[idx], &value) else self.values[idx] = value;
+        }
+
+        /// Swap-remove dense entry `idx`, repointing the bucket of the entry moved into its place.
+        fn denseRemove(self: *Self, idx: u32) void {
+            const last = self.dense.len - 1;
+            if (idx != last) {
+                const moved_key = self.dense.items(.key)[last];
+                const moved = self.findHashed(moved_key, hashFn(moved_key)).?;
+                moved.bucket.idx = idx;
+            }
+            self.dense.swapRemove(idx);
+        }
+
+        inline fn slotAt(self: *const Self, idx: usize) Slot {
+            return .{ .bucket = &self.buckets[idx], .val = self.valueAt(idx) };
+        }
+
+        inline fn stashLen(self: *const Self) usize {
+            return if (stash_enabled) self.stash.len else 0;
+        }
+
+        fn getSlot(self: *const Self, key: K) ?Slot {
+            if (self.buckets_mask == 0) return null;
+            return self.findHashed(key, hashFn(key));
+        }
+
+        /// Find the slot holding `key`, in the draining allocation too during an incremental resize.
+        inline fn findHashed(self: *const Self, key: K, hash: u64) ?Slot {
+            if (self.getInternalHashed(key, hash).bucket_idx) |idx| {
+                return self.slotAt(idx);
+            }
+            if (incremental) {
+                if (self.draining) |old| {
+                    if ((hash & old.buckets_mask) >= old.migrate_index) {
+                        @branchHint(.unlikely);
+                        const view = self.drainingView();
+                        if (view.getInternalHashed(key, hash).bucket_idx) |idx| {
+                            return view.slotAt(idx);
+                        }
+                    }
+                }
+            }
+            if (stash_enabled) {
+                if (self.stash.len != 0) {
+                    @branchHint(.unlikely);
+                    const i = self.findInStash(key, hash) orelse return null;
+                    return self.stashSlot(i);
+                }
+            }
+            return null;
+        }
+
+        fn removeHashed(self: *Self, key: K, hash: u64) bool {
+            if (journaling) {
+                self.syncJournal();
+                const removed = self.eraseHashed(key, hash);
+                if (removed) self.journalRecord(.remove, key, null);
+                return removed;
+            }
+            return self.eraseHashed(key, hash);
+        }
+
+        fn eraseHashed(self: *Self, key: K, hash: u64) bool {
+            if (incremental) {
+                // A failed step leaves the remaining keys in the old table; the next insert deals with it
+                if (self.draining != null) _ = self.migrateStep(options.resize_step);
+            }
+
+            const result = self.getInternalHashed(key, hash);
+            if (result.bucket_idx) |idx| {
+                if (dense_values) self.denseRemove(self.buckets[idx].idx);
+                self.eraseAtIndex(idx, result.home_bucket);
+                return true;
+            }
+
+            if (incremental) {
+                if (self.draining) |old| {
+                    if ((hash & old.buckets_mask) >= old.migrate_index) {
+                        var view = self.drainingView();
+                        const old_result = view.getInternalHashed(key, hash);
+                        if (old_result.bucket_idx) |idx| {
+                            if (dense_values) self.denseRemove(view.buckets[idx].idx);
+                            view.eraseAtIndex(idx, old_result.home_bucket);
+                            self.draining.?.key_count = view.key_count;
+                            return true;
+                        }
+                    }
+                }
+            }
+
+            if (stash_enabled) {
+                if (self.stash.len != 0) {
+                    if (self.findInStash(key, hash)) |i| {
+                        if (dense_values) self.denseRemove(self.stash.entries[i].idx);
+                        self.stash.len -= 1;
+                        self.stash.entries[i] = self.stash.entries[self.stash.len];
+                        if (separate_values) self.stash.values[i] = self.stash.values[self.stash.len];
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        const GetResult = struct {
+            bucket_idx: ?usize,
+            home_bucket: usize,
+        };
+
+        /// Lookup with a precomputed `hash` (must equal `hashFn(key)`).
+        inline fn getInternalHashed(self: *const Self, key: K, hash: u64) GetResult {
+            // Empty table - not found
+            if (self.buckets_mask == 0) {
+                return .{ .bucket_idx = null, .home_bucket = 0 };
+            }
+
+            const home_bucket = hash & self.buckets_mask;
+
+            // Prefetch the home bucket (we will definitely access it)
+            @prefetch(&self.buckets[home_bucket], .{ .rw = .read });
+
+            // If home bucket is empty or contains a non-home key, miss
+            if ((self.metadata[home_bucket] & IN_HOME_BUCKET_MASK) == 0) {
+                @branchHint(.unlikely);
+                return .{ .bucket_idx = null, .home_bucket = home_bucket };
+            }
+
+            const frag = hashFrag(hash);
+            var bucket = home_bucket;
+
+            while (true) {
+                // Check current bucket for match
+                // With stored hashes: compare full hash first (much cheaper than eqlFn)
+                const hash_match = if (store_hash)
+                    self.buckets[bucket].full_hash == hash
+                else
+                    (self.metadata[bucket] & HASH_FRAG_MASK) == frag;
+
+                if (hash_match and eqlFn(self.buckets[bucket].key, key)) {
+                    return .{ .bucket_idx = bucket, .home_bucket = home_bucket };
+                }
+
+                // Get displacement of current bucket
+                const displacement = self.metadata[bucket] & DISPLACEMENT_MASK;
+
+                // End of chain?
+                if (displacement == DISPLACEMENT_MASK) {
+                    @branchHint(.unlikely);
+                    return .{ .bucket_idx = null, .home_bucket = home_bucket };
+                }
+
+                // Compute the *next* bucket in the chain
+                const next_bucket = (home_bucket + probeOffset(displacement)) & self.buckets_mask;
+
+                // Prefetch the next bucket (we will access it next iteration)
+                @prefetch(&self.buckets[next_bucket], .{ .rw = .read, .locality = 1 });
+
+                // Advance to next bucket
+                bucket = next_bucket;
+            }
+        }
+
+        /// Group-prefetched lookup of up to `batch_size` keys.
+        /// Stage 1 hashes every key and prefetches its metadata and home bucket; stage 2 then
+        /// resolves each key while the other keys' loads are still in flight.
+        /// Writes the slot of each key (or null) to `out`.
+        inline fn findBatch(self: *const Self, comptime batch_size: usize, keys: []const K, out: *[batch_size]?Slot) void {
+            std.debug.assert(keys.len <= batch_size);
+
+            if (self.buckets_mask == 0) {
+                @memset(out[0..keys.len], null);
+                return;
+            }
+
+            // Stage 1: hash + prefetch
+            var hashes: [batch_size]u64 = undefined;
+            for (keys, hashes[0..keys.len]) |key, *hash| {
+                hash.* = hashFn(key);
+                const home_bucket = hash.* & self.buckets_mask;
+                @prefetch(&self.metadata[home_bucket], .{ .rw = .read });
+                @prefetch(&self.buckets[home_bucket], .{ .rw = .read });
+            }
+
+            // Stage 2: metadata check and chain walk, lines should now be (mostly) resident
+            for (keys, hashes[0..keys.len], out[0..keys.len]) |key, hash, *slot| {
+                slot.* = self.findHashed(key, hash);
+            }
+        }
+
+        fn eraseAtIndex(self: *Self, bucket_idx: usize, home_bucket: usize) void {
+            self.key_count -= 1;
+
+            // Case 1: Only key in chain
+            if ((self.metadata[bucket_idx] & IN_HOME_BUCKET_MASK) != 0 and
+                (self.metadata[bucket_idx] & DISPLACEMENT_MASK) == DISPLACEMENT_MASK)
+            {
+                self.setMeta(bucket_idx, EMPTY);
+                return;
+            }
+
+            // Determine home bucket if not in home position
+            var home = home_bucket;
+            if ((self.metadata[bucket_idx] & IN_HOME_BUCKET_MASK) == 0) {
+                home = self.bucketHash(bucket_idx) & self.buckets_mask;
+            }
+
+            // Case 2: Last key in multi-key chain
+            if ((self.metadata[bucket_idx] & DISPLACEMENT_MASK) == DISPLACEMENT_MASK) {
+                // Find penultimate key
+                var bucket = home;
+                while (true) {
+                    const displacement = self.metadata[bucket] & DISPLACEMENT_MASK;
+                    const next = (home + probeOffset(displacement)) & self.buckets_mask;
+                    if (next == bucket_idx) {
+                        self.setMeta(bucket, self.metadata[bucket] | DISPLACEMENT_MASK);
+                        self.setMeta(bucket_idx, EMPTY);
+                        return;
+                    }
+                    bucket = next;
+                }
+            }
+
+            // Case 3: Not the last key - swap with last and remove last
+            var bucket = bucket_idx;
+            while (true) {
+                const displacement = self.metadata[bucket] & DISPLACEMENT_MASK;
+                const prev = bucket;
+                bucket = (home + probeOffset(displacement)) & self.buckets_mask;
+
+                if ((self.metadata[bucket] & DISPLACEMENT_MASK) == DISPLACEMENT_MASK) {
+                    // Found last - swap it to bucket_idx
+                    self.setBucket(bucket_idx, self.buckets[bucket]);
+                    if (separate_values) self.setValue(bucket_idx, self.values[bucket]);
+                    self.setMeta(bucket_idx, (self.metadata[bucket_idx] & ~HASH_FRAG_MASK) |
+                        (self.metadata[bucket] & HASH_FRAG_MASK));
+                    self.setMeta(prev, self.metadata[prev] | DISPLACEMENT_MASK);
+                    self.setMeta(bucket, EMPTY);
+                    return;
+                }
+            }
+        }
+
+        /// `retain`, or `removeIf` with `remove_matching`.
+        fn retainInternal(self: *Self, context: anytype, comptime pred: anytype, comptime remove_matching: bool) usize {
+            if (journaling) self.syncJournal();
+            var removed: usize = 0;
+            if (self.buckets_mask != 0) removed += self.retainIn(self, context, pred, remove_matching);
+            if (incremental) {
+                if (self.draining != null) {
+                    var view = self.drainingView();
+                    removed += self.retainIn(&view, context, pred, remove_matching);
+                    self.draining.?.key_count = view.key_count;
+                }
+            }
+            if (stash_enabled) {
+                // Swap-removal moves an unvisited entry into the freed slot, which is visited next
+                var i: usize = 0;
+                while (i < self.stash.len) {
+                    if (pred(context, &self.stash.entries[i].key, self.stashValue(i)) != remove_matching) {
+                        i += 1;
+                        continue;
+                    }
+                    if (journaling) self.journalRecord(.remove, self.stash.entries[i].key, null);
+                    if (dense_values) self.denseRemove(self.stash.entries[i].idx);
+                    self.stash.len -= 1;
+                    self.stash.entries[i] = self.stash.entries[self.stash.len];
+                    if (separate_values) self.stash.values[i] = self.stash.values[self.stash.len];
+                    removed += 1;
+                }
+            }
+            return removed;
+        }
+
+        /// Filter every chain of `table`, this table or a view of its draining allocation.
+        fn retainIn(self: *Self, table: *Self, context: anytype, comptime pred: anytype, comptime remove_matching: bool) usize {
+            var removed: usize = 0;
+            for (0..table.bucketCount()) |home| {
+                if ((table.metadata[home] & IN_HOME_BUCKET_MASK) == 0) continue;
+                removed += self.retainChain(table, home, context, pred, remove_matching);
+            }
+            table.key_count -= removed;
+            return removed;
+        }
+
+        /// Filter the chain starting at `home`: kept entries are copied down into the chain's
+        /// first slots, whose links stay as they are, then the slots behind the last kept entry
+        /// are unlinked and freed.
+        fn retainChain(self: *Self, table: *Self, home: usize, context: anytype, comptime pred: anytype, comptime remove_matching: bool) usize {
+            var removed: usize = 0;
+            var read = home;
+            var write = home;
+            var last_kept: ?usize = null;
+            while (true) {
+                const link = table.metadata[read] & DISPLACEMENT_MASK;
+                if (pred(context, &table.buckets[read].key, table.valueAt(read)) != remove_matching) {
+                    if (write != read) {
+                        table.buckets[write] = table.buckets[read];
+                        if (separate_values) table.values[write] = table.values[read];
+                        table.metadata[write] = (table.metadata[write] & ~HASH_FRAG_MASK) |
+                            (table.metadata[read] & HASH_FRAG_MASK);
+                    }
+                    last_kept = write;
+                    write = (home + probeOffset(table.metadata[write] & DISPLACEMENT_MASK)) & table.buckets_mask;
+                } else {
+                    // The lookup that repoints the moved dense entry finds kept keys in their new
+                    // slot first, since every slot written to comes earlier in the chain
+                    if (journaling) self.journalRecord(.remove, table.buckets[read].key, null);
+                    if (dense_values) self.denseRemove(table.buckets[read].idx);
+                    removed += 1;
+                }
+                if (link == DISPLACEMENT_MASK) break;
+                read = (home + probeOffset(link)) & table.buckets_mask;
+            }
+            if (removed == 0) return 0;
+
+            var link: MetaType = undefined;
+            if (last_kept) |kept| {
+                link = table.metadata[kept] & DISPLACEMENT_MASK;
+                table.metadata[kept] |= DISPLACEMENT_MASK;
+            } else {
+                link = table.metadata[home] & DISPLACEMENT_MASK;
+                table.metadata[home] = EMPTY;
+            }
+            while (link != DISPLACEMENT_MASK) {
+                const slot = (home + probeOffset(link)) & table.buckets_mask;
+                link = table.metadata[slot] & DISPLACEMENT_MASK;
+                table.metadata[slot] = EMPTY;
+            }
+            return removed;
+        }
+
+        const FindEmptyResult = struct {
+            index: usize,
+            displacement: MetaType,
+        };
+
+        inline fn findFirstEmpty(self: *Self, home_bucket: usize) ?FindEmptyResult {
+            // Linear probing: check consecutive slots for cache efficiency
+            var displacement: MetaType = 1;
+
+            while (displacement < DISPLACEMENT_MASK) {
+                const empty = (home_bucket +% displacement) & self.buckets_mask;
+                if (self.metadata[empty] == EMPTY) {
+                    return .{ .index = empty, .displacement = displacement };
+                }
+                displacement += 1;
+            }
+
+            // Displacement limit reached - extremely rare, triggers rehash
+            return null;
+        }
+
+        inline fn findInsertLocationInChain(self: *Self, home_bucket: usize, displacement_to_empty: MetaType) usize {
+            var candidate = home_bucket;
+            while (true) {
+                const displacement = self.metadata[candidate] & DISPLACEMENT_MASK;
+                if (displacement > displacement_to_empty) {
+                    return candidate;
+                }
+                candidate = (home_bucket + probeOffset(displacement)) & self.buckets_mask;
+            }
+        }
+
+        /// Move the non-home key in `bucket` elsewhere in its chain.
+        /// Returns false, leaving the table unchanged, if no empty bucket is in reach.
+        inline fn evict(self: *Self, bucket: usize) bool {
+            // Find home bucket of occupying key
+            const home_bucket = self.bucketHash(bucket) & self.buckets_mask;
+
+            // Find new empty bucket first, so failure doesn't leave the chain broken
+            const empty_result = self.findFirstEmpty(home_bucket) orelse return false;
+            const empty = empty_result.index;
+            const displacement = empty_result.displacement;
+
+            // Find previous key in chain
+            var prev = home_bucket;
+            while (true) {
+                const prev_displacement = self.metadata[prev] & DISPLACEMENT_MASK;
+                const next = (home_bucket + probeOffset(prev_displacement)) & self.buckets_mask;
+                if (next == bucket) break;
+                prev = next;
+            }
+
+            // Disconnect from chain
+            self.setMeta(prev, (self.metadata[prev] & ~DISPLACEMENT_MASK) |
+                (self.metadata[bucket] & DISPLACEMENT_MASK));
+
+            // Find insert location
+            prev = self.findInsertLocationInChain(home_bucket, displacement);
+
+            // Move key/value
+            self.setBucket(empty, self.buckets[bucket]);
+            if (separate_values) self.setValue(empty, self.values[bucket]);
+
+            // Re-link
+            self.markDirty(empty);
+            self.setMeta(empty, (self.metadata[bucket] & HASH_FRAG_MASK) |
+                (self.metadata[prev] & DISPLACEMENT_MASK));
+            self.setMeta(prev, (self.metadata[prev] & ~DISPLACEMENT_MASK) | displacement);
+
+            return true;
+        }
+
+        /// Hash of the key stored in bucket `idx`.
+        /// Reads the cached full hash when the bucket stores one instead of rehashing the key.
+        inline fn bucketHash(self: *const Self, idx: usize) u64 {
+            return entryHash(&self.buckets[idx]);
+        }
+
+        inline fn entryHash(bucket: *const Bucket) u64 {
+            return if (store_hash) bucket.full_hash else hashFn(bucket.key);
+        }
+
+        /// Stop-the-world rehash into `bucket_count` buckets (or more, if keys don't fit).
+        /// Also merges in and frees the draining allocation of an incremental resize.
+        fn rehash(self: *Self, bucket_count: usize) !void {
+            if (options.grow_in_place) {
+                if (self.buckets_mask != 0 and bucket_count > self.bucketCount()) {
+                    if (try self.growInPlace(bucket_count)) return;
+                }
+            }
+            try self.rehashOutOfPlace(bucket_count);
+        }
+
+        fn rehashOutOfPlace(self: *Self, bucket_count: usize) !void {
+            var new_count = bucket_count;
+            while (true) {
+                var new_table = try self.emptyTableForCount(new_count);
+
+                // Rehash all keys (reusing cached hashes where the bucket stores them)
+                var success = new_table.insertAllFromParallel(self) catch |err| {
+                    new_table.freeStorage();
+                    return err;
+                };
+                if (incremental) {
+                    if (success and self.draining != null) {
+                        const view = self.drainingView();
+                        success = new_table.insertAllFrom(&view);
+                    }
+                }
+
+                if (!success) {
+                    // Displacement limit hit - double and retry
+                    new_table.freeStorage();
+                    new_count = new_count * 2;
+                    continue;
+                }
+
+                // Free old allocation(s)
+                if (incremental) self.freeDraining();
+                self.freeStorage();
+
+                self.* = new_table;
+                return;
+            }
+        }
+
+        /// Grow to `bucket_count` buckets inside the current allocation, extended with `remap`.
+        /// Returns false, with the table untouched, if the allocator can't extend it or there is
+        /// no memory for the fallback block below.
+        ///
+        /// Every old entry is first marked PENDING (occupied, in no chain), then reinserted in
+        /// slot order. Inserts skip PENDING slots when probing for an empty one; when a key's
+        /// new home is itself PENDING, the key takes that slot and the entry it displaced is
+        /// carried on to be reinserted next. If a displacement overflow interrupts this, the
+        /// keys are moved to a fresh table of the same size instead, as a regular rehash would
+        /// have built it. That table's block is reserved before any entry is marked PENDING (and
+        /// released untouched once the keys are in place); without it the extension is given
+        /// back and the caller falls back to a regular rehash. Only should the fresh table
+        /// overflow as well does the rehash allocate again with entries still PENDING.
+        fn growInPlace(self: *Self, bucket_count: usize) !bool {
+            const old_count = self.bucketCount();
+            const old_ptr: [*]u8 = @ptrCast(self.buckets);
+            const old_size = self.totalAllocSize();
+            // Blocks past the mapping threshold are mmap'd, not the allocator's to remap
+            if (isMappedSize(self.totalAllocSizeForCount(bucket_count))) return false;
+            const old_block: Block = @alignCast(old_ptr[0..old_size]);
+            const new_mem = self.allocator.remap(old_block, self.totalAllocSizeForCount(bucket_count)) orelse return false;
+
+            // Reserved after the remap, so an allocator that only extends its latest block still can
+            const fallback = self.allocBlock(self.totalAllocSizeForCount(bucket_count)) catch {
+                // Nothing has moved yet: give the extension back and let a regular rehash try,
+                // which keeps the table intact should it run out of memory as well
+                const old_mem = self.allocator.remap(new_mem, old_size) orelse
+                    @panic("allocator can neither shrink nor move a block it just extended");
+                self.buckets = @ptrCast(@alignCast(old_mem.ptr));
+                self.values = self.valuesIn(old_mem.ptr, old_count);
+                self.metadata = @ptrCast(@alignCast(old_mem.ptr + self.metadataOffsetForCount(old_count)));
+                return false;
+            };
+
+            // Move the metadata up behind the enlarged bucket array (the ranges may overlap)
+            const meta_bytes = old_count * @sizeOf(MetaType);
+            const old_meta_offset = self.metadataOffsetForCount(old_count);
+            const new_meta_offset = self.metadataOffsetForCount(bucket_count);
+            std.mem.copyBackwards(u8, new_mem[new_meta_offset..][0..meta_bytes], new_mem[old_meta_offset..][0..meta_bytes]);
+            if (separate_values) {
+                // Then the values, into the room the metadata just vacated
+                const value_bytes = old_count * @sizeOf(V);
+                const old_values_offset = self.valuesOffsetForCount(old_count);
+                const new_values_offset = self.valuesOffsetForCount(bucket_count);
+                std.mem.copyBackwards(u8, new_mem[new_values_offset..][0..value_bytes], new_mem[old_values_offset..][0..value_bytes]);
+            }
+
+            self.buckets = @ptrCast(@alignCast(new_mem.ptr));
+            self.values = self.valuesIn(new_mem.ptr, bucket_count);
+            self.metadata = @ptrCast(@alignCast(new_mem.ptr + new_meta_offset));
+            self.buckets_mask = bucket_count - 1;
+            self.key_count = 0;
+
+            for (self.metadata[0..old_count]) |*meta| {
+                if (meta.* != EMPTY) meta.* = PENDING;
+            }
+            @memset(self.metadata[old_count .. bucket_count + 4], EMPTY);
+            // Iteration stopper
+            self.metadata[bucket_count] = 0x01;
+            // Entries settle in their new homes without flagging them; the next clear resets all
+            if (track_dirty) @memset(self.dirtyPages()[0..dirtyPageCount(bucket_count)], 1);
+
+            for (0..old_count) |i| {
+                if (self.metadata[i] != PENDING) continue;
+                var carry = self.buckets[i];
+                var carry_val: if (separate_values) V else void = if (separate_values) self.values[i] else {};
+                self.metadata[i] = EMPTY;
+
+                while (true) {
+                    const hash = entryHash(&carry);
+                    const home_bucket = hash & self.buckets_mask;
+
+                    if (self.metadata[home_bucket] == PENDING) {
+                        // Settle the carried key in its home and carry the pending entry on instead
+                        const next = self.buckets[home_bucket];
+                        self.buckets[home_bucket] = carry;
+                        if (separate_values) std.mem.swap(V, &carry_val, &self.values[home_bucket]);
+                        self.metadata[home_bucket] = hashFrag(hash) | IN_HOME_BUCKET_MASK | DISPLACEMENT_MASK;
+                        self.key_count += 1;
+                        carry = next;
+                        continue;
+                    }
+
+                    const value = if (is_set) {} else if (dense_values) carry.idx else if (separate_values) carry_val else carry.val;
+                    if (self.insertRaw(carry.key, hash, value, true, false, true) == null) {
+                        @branchHint(.unlikely);
+                        // Park the carried key in any free slot; every non-empty slot is rehashed
+                        const free_slot = std.mem.indexOfScalar(MetaType, self.metadata[0..bucket_count], EMPTY).?;
+                        self.buckets[free_slot] = carry;
+                        if (separate_values) self.values[free_slot] = carry_val;
+                        self.metadata[free_slot] = PENDING;
+                        try self.rehashIntoBlock(fallback, bucket_count);
+                        return true;
+                    }
+                    break;
+                }
+            }
+            self.freeBlock(fallback);
+
+            // Stashed keys may fit in the larger table now
+            if (stash_enabled) {
+                const stashed = self.stash;
+                self.stash.len = 0;
+                for (stashed.entries[0..stashed.len], 0..) |*bucket, i| {
+                    const value = if (is_set) {} else if (dense_values) bucket.idx else if (separate_values) stashed.values[i] else bucket.val;
+                    const hash = entryHash(bucket);
+                    // Spread-out stashed keys can fill the table to its load limit before the
+                    // loop ends; the rest go back into the stash, which has room for all of them
+                    _ = self.insertRaw(bucket.key, hash, value, true, false, true) orelse
+                        self.stashInsert(bucket.key, hash, value).?;
+                }
+            }
+            return true;
+        }
+
+        /// Move every key, PENDING ones included, into a fresh table of `bucket_count` buckets laid
+        /// out in the unused `block` (reserved by `growInPlace`), then free this allocation.
+        /// Only if that table overflows too does the rehash go on to allocate.
+        fn rehashIntoBlock(self: *Self, block: []u8, bucket_count: usize) !void {
+            var new_table = self.emptyTableIn(block, bucket_count);
+            if (!new_table.insertAllFrom(self)) {
+                new_table.freeStorage();
+                return self.rehashOutOfPlace(bucket_count * 2);
+            }
+            self.freeStorage();
+            self.* = new_table;
+        }
+
+        /// A new, empty table with `bucket_count` buckets and this table's settings.
+        fn emptyTableForCount(self: *const Self, bucket_count: usize) !Self {
+            return self.emptyTableIn(try self.allocBlock(self.totalAllocSizeForCount(bucket_count)), bucket_count);
+        }
+
+        /// `emptyTableForCount` laid out in `new_mem`, a block of `totalAllocSizeForCount(bucket_count)`
+        /// bytes from `allocBlock` that the new table takes ownership of.
+        fn emptyTableIn(self: *const Self, new_mem: []u8, bucket_count: usize) Self {
+            var new_table = Self{
+                .key_count = 0,
+                .buckets_mask = bucket_count - 1,
+                .buckets = undefined,
+                .values = undefined,
+                .metadata = undefined,
+                .allocator = self.allocator,
+                .max_load = self.max_load,
+                .draining = if (incremental) null else {},
+                .stash = if (stash_enabled) .{} else {},
+                // Shared: only the buckets move
+                .dense = self.dense,
+                .rehash_pool = self.rehash_pool,
+                .journal = self.journal,
+            };
+
+            new_table.buckets = @ptrCast(@alignCast(new_mem.ptr));
+            new_table.values = new_table.valuesIn(new_mem.ptr, bucket_count);
+            new_table.metadata = @ptrCast(@alignCast(new_mem.ptr + new_table.metadataOffsetForCount(bucket_count)));
+
+            // Initialize metadata to empty (and the page flags to clean), unless the kernel just did
+            if (!isMappedSize(new_mem.len)) {
+                @memset(new_table.metadata[0 .. bucket_count + 4], EMPTY);
+                if (track_dirty) @memset(new_table.dirtyPages()[0..dirtyPageCount(bucket_count)], 0);
+            }
+            // Iteration stopper
+            new_table.metadata[bucket_count] = 0x01;
+            return new_table;
+        }
+
+        /// Insert every key of `src`, stash included (keys known to be unique).
+        /// Returns false on displacement overflow.
+        fn insertAllFrom(self: *Self, src: *const Self) bool {
+            if (src.buckets_mask == 0) return true;
+            for (0..src.bucketCount()) |i| {
+                if (src.metadata[i] != EMPTY) {
+                    if (self.insertRaw(src.buckets[i].key, src.bucketHash(i), src.payloadAt(i), true, false, true) == null) {
+                        return false;
+                    }
+                }
+            }
+            if (stash_enabled) {
+                for (src.stash.entries[0..src.stash.len], 0..) |*bucket, i| {
+                    if (self.insertRaw(bucket.key, entryHash(bucket), src.stashPayload(i), true, false, true) == null) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        /// `insertAllFrom`, on the rehash pool when there is one and `src` is large enough.
+        fn insertAllFromParallel(self: *Self, src: *const Self) !bool {
+            if (options.parallel_rehash) {
+                if (self.rehash_pool) |pool| {
+                    if (src.key_count >= MIN_PARALLEL_REHASH_KEYS and self.partitionCount(pool) >= MIN_PARALLEL_BUILD_PARTITIONS) {
+                        if (!try self.insertPartitioned(pool, TableSource{ .table = src }, false)) return false;
+                        if (stash_enabled) {
+                            for (src.stash.entries[0..src.stash.len], 0..) |*bucket, i| {
+                                if (self.insertRaw(bucket.key, entryHash(bucket), src.stashPayload(i), true, false, true) == null) {
+                                    return false;
+                                }
+                            }
+                        }
+                        return true;
+                    }
+                }
+            }
+            return self.insertAllFrom(src);
+        }
+
+        /// Free this table's own allocation (not the draining one).
+        fn freeStorage(self: *Self) void {
+            if (self.buckets_mask == 0) return;
+            const alloc_size = self.totalAllocSize();
+            const ptr: [*]u8 = @ptrCast(self.buckets);
+            self.freeBlock(ptr[0..alloc_size]);
+        }
+
+        /// Whether a storage block of `size` bytes is mapped rather than allocated (`Options.huge_pages`).
+        inline fn isMappedSize(size: usize) bool {
+            return huge_pages and size >= HUGE_PAGE_SIZE;
+        }
+
+        /// Alignment of a storage block: enough for the buckets, values and metadata laid out in
+        /// it, and for a `TablePool` to thread its free list through the block once it's freed.
+        const BLOCK_ALIGNMENT: std.mem.Alignment = .fromByteUnits(@max(@alignOf(Bucket), @alignOf(V), @alignOf(MetaType), @alignOf(TablePool.FreeBlock)));
+        const Block = []align(BLOCK_ALIGNMENT.toByteUnits()) u8;
+
+        fn allocBlock(self: *const Self, size: usize) !Block {
+            if (isMappedSize(size)) return @alignCast(try mapHugeBlock(size));
+            return self.allocator.alignedAlloc(u8, BLOCK_ALIGNMENT, size);
+        }
+
+        fn freeBlock(self: *const Self, block: []u8) void {
+            if (isMappedSize(block.len)) unmapHugeBlock(block) else self.allocator.free(@as(Block, @alignCast(block)));
+        }
+
+        fn metadataOffset(self: *const Self) usize {
+            return self.metadataOffsetForCount(self.bucketCount());
+        }
+
+        fn metadataOffsetForCount(self: *const Self, bucket_count: usize) usize {
+            // With `Options.separate_values` the value array sits between buckets and metadata
+            const end = if (separate_values)
+                self.valuesOffsetForCount(bucket_count) + bucket_count * @sizeOf(V)
+            else
+                bucket_count * @sizeOf(Bucket);
+            // Align to MetaType
+            return std.mem.alignForward(usize, end, @alignOf(MetaType));
+        }
+
+        fn valuesOffsetForCount(self: *const Self, bucket_count: usize) usize {
+            _ = self;
+            return std.mem.alignForward(usize, bucket_count * @sizeOf(Bucket), @alignOf(V));
+        }
+
+        /// The value array of an allocation for `bucket_count` buckets starting at `mem_ptr`.
+        fn valuesIn(self: *const Self, mem_ptr: [*]u8, bucket_count: usize) Values {
+            return if (separate_values) @ptrCast(@alignCast(mem_ptr + self.valuesOffsetForCount(bucket_count))) else {};
+        }
+
+        fn totalAllocSize(self: *const Self) usize {
+            return self.totalAllocSizeForCount(self.bucketCount());
+        }
+
+        fn totalAllocSizeForCount(self: *const Self, bucket_count: usize) usize {
+            const end = self.metadataOffsetForCount(bucket_count) + (bucket_count + 4) * @sizeOf(MetaType);
+            // With `Options.track_dirty_pages` the page flags follow the metadata
+            return if (track_dirty) end + dirtyPageCount(bucket_count) else end;
+        }
+
+        fn dirtyPageCount(bucket_count: usize) usize {
+            return (bucket_count + DIRTY_PAGE_BUCKETS - 1) / DIRTY_PAGE_BUCKETS;
+        }
+
+        /// The page flags of `Options.track_dirty_pages`, behind the metadata.
+        inline fn dirtyPages(self: *const Self) [*]u8 {
+            const base: [*]u8 = @ptrCast(self.buckets);
+            const bucket_count = self.bucketCount();
+            return base + self.metadataOffsetForCount(bucket_count) + (bucket_count + 4) * @sizeOf(MetaType);
+        }
+
+        /// Flag the metadata page of bucket `idx` for the next `clear`. An atomic store, as the
+        /// workers of a parallel build or rehash flag pages of one table concurrently.
+        inline fn markDirty(self: *Self, idx: usize) void {
+            if (track_dirty) @atomicStore(u8, &self.dirtyPages()[idx / DIRTY_PAGE_BUCKETS], 1, .monotonic);
+        }
+
+        fn minBucketCountForSize(self: *const Self, size: usize) usize {
+            if (size == 0) return 0;
+            var bucket_count: usize = MIN_NONZERO_BUCKET_COUNT;
+            while (size > @as(usize, @intFromFloat(@as(f32, @floatFromInt(bucket_count)) * self.max_load))) {
+                bucket_count *= 2;
+            }
+            return bucket_count;
+        }
+    };
+}
+
+// ============================================================================
+// Small Tables
+// ============================================================================
+
+/// A table that keeps up to `inline_capacity` entries inside the struct, with no allocation,
+/// and moves them into a `HashMap` on the heap once it outgrows them.
+///
+/// ## Example
+/// ```zig
+/// var map = SmallHashMap(u32, u32, 16).init(allocator);
+/// defer map.deinit();
+/// try map.put(1, 10); // no allocation until the 17th key
+/// ```
+pub fn SmallHashMap(comptime K: type, comptime V: type, comptime inline_capacity: usize) type {
+    return SmallHashMapWithOptions(K, V, AutoHashFn(K).hash, AutoEqlFn(K).eql, .{}, inline_capacity);
+}
+
+/// `SmallHashMap` with custom hash/equality functions, and `Options` for the heap table.
+///
+/// While the entries fit inline, a lookup hashes the key once, compares an 8-bit fragment of
+/// the hash against the fragments of all inline entries in one vector compare, and compares
+/// keys only where a fragment matches. A table that has spilled stays on the heap, `clear`
+/// included, until `deinit`.
+pub fn SmallHashMapWithOptions(
+    comptime K: type,
+    comptime V: type,
+    comptime hashFn: fn (K) u64,
+    comptime eqlFn: fn (K, K) bool,
+    comptime options: Options,
+    comptime inline_capacity: usize,
+) type {
+    comptime {
+        if (inline_capacity == 0 or inline_capacity > 64) @compileError("SmallHashMap inline capacity must be between 1 and 64");
+    }
+
+    return struct {
+        const Self = @This();
+        const is_set = V == void;
+
+        /// The table the entries move to once there are more than `inline_capacity`.
+        pub const Map = HashMapWithOptions(K, V, hashFn, eqlFn, options);
+        pub const Entry = Map.Entry;
+        pub const GetOrPutResult = Map.GetOrPutResult;
+
+        /// One bit per inline entry.
+        const Mask = std.meta.Int(.unsigned, inline_capacity);
+
+        // Fields
+        len: usize,
+        /// Top 8 bits of the hash of each inline key.
+        frags: [inline_capacity]u8,
+        keys: [inline_capacity]K,
+        values: [inline_capacity]V,
+        /// The entries once spilled, `null` while they fit inline.
+        heap: ?Map,
+        allocator: Allocator,
+
+        /// Initialize an empty table; allocates nothing.
+        pub fn init(allocator: Allocator) Self {
+            return .{
+                .len = 0,
+                .frags = .{0} ** inline_capacity,
+                .keys = undefined,
+                .values = undefined,
+                .heap = null,
+                .allocator = allocator,
+            };
+        }
+
+        /// Deinitialize and free the heap table, if any.
+        pub fn deinit(self: *Self) void {
+            if (self.heap) |*map| map.deinit();
+            self.* = Self.init(self.allocator);
+        }
+
+        /// Returns the number of entries.
+        pub fn count(self: *const Self) usize {
+            return if (self.heap) |*map| map.count() else self.len;
+        }
+
+        /// Whether the entries have moved to the heap.
+        pub fn isSpilled(self: *const Self) bool {
+            return self.heap != null;
+        }
+
+        /// Insert or update a key-value pair. Allocates only when the table spills.
+        pub fn put(self: *Self, key: K, value: V) !void {
+            if (is_set) @compileError("Use add() for sets");
+            const result = try self.getOrPut(key);
+            result.value_ptr.* = value;
+        }
+
+        /// Add a key to the set. Allocates only when the table spills.
+        pub fn add(self: *Self, key: K) !void {
+            if (!is_set) @compileError("Use put() for maps");
+            if (self.heap) |*map| return map.add(key);
+            const frag = hashFrag8(hashFn(key));
+            if (self.findInline(key, frag) != null) return;
+            if (self.len == inline_capacity) {
+                try self.spill();
+                return self.heap.?.add(key);
+            }
+            self.appendInline(key, frag);
+        }
+
+        /// Get a pointer to the value of `key`, inserting it with an undefined value if absent.
+        pub fn getOrPut(self: *Self, key: K) !GetOrPutResult {
+            if (is_set) @compileError("Use add() for sets");
+            if (self.heap) |*map| return map.getOrPut(key);
+            const frag = hashFrag8(hashFn(key));
+            if (self.findInline(key, frag)) |i| {
+                return .{ .value_ptr = &self.values[i], .found_existing = true };
+            }
+            if (self.len == inline_capacity) {
+                try self.spill();
+                return self.heap.?.getOrPut(key);
+            }
+            self.appendInline(key, frag);
+            return .{ .value_ptr = &self.values[self.len - 1], .found_existing = false };
+        }
+
+        /// Get the value associated with a key, or null if not found.
+        pub fn get(self: *const Self, key: K) ?V {
+            if (is_set) @compileError("Use contains() for sets");
+            if (self.heap) |*map| return map.get(key);
+            const i = self.findInline(key, hashFrag8(hashFn(key))) orelse return null;
+            return self.values[i];
+        }
+
+        /// Get a pointer to the value for modification.
+        pub fn getPtr(self: *Self, key: K) ?*V {
+            if (is_set) @compileError("Use contains() for sets");
+            if (self.heap) |*map| return map.getPtr(key);
+            const i = self.findInline(key, hashFrag8(hashFn(key))) orelse return null;
+            return &self.values[i];
+        }
+
+        /// Check if a key exists.
+        pub fn contains(self: *const Self, key: K) bool {
+            if (self.heap) |*map| return map.contains(key);
+            return self.findInline(key, hashFrag8(hashFn(key))) != null;
+        }
+
+        /// Remove a key. Returns true if the key was found and removed.
+        pub fn remove(self: *Self, key: K) bool {
+            if (self.heap) |*map| return map.remove(key);
+            const i = self.findInline(key, hashFrag8(hashFn(key))) orelse return false;
+            // Swap in the last entry
+            self.len -= 1;
+            self.frags[i] = self.frags[self.len];
+            self.keys[i] = self.keys[self.len];
+            self.values[i] = self.values[self.len];
+            return true;
+        }
+
+        /// Remove all entries, keeping the heap table's allocation if it has spilled.
+        pub fn clear(self: *Self) void {
+            if (self.heap) |*map| map.clear();
+            self.len = 0;
+        }
+
+        /// Returns an iterator over the entries.
+        pub fn iterator(self: *const Self) Iterator {
+            return .{ .small = self, .inner = if (self.heap) |*map| map.iterator() else null };
+        }
+
+        pub const Iterator = struct {
+            small: *const Self,
+            index: usize = 0,
+            inner: ?Map.Iterator,
+
+            /// Next key and value (a placeholder value for sets).
+            pub fn next(self: *Iterator) ?Entry {
+                if (self.inner) |*inner| {
+                    return if (is_set) blk: {
+                        const bucket = inner.next() orelse break :blk null;
+                        break :blk .{ .key_ptr = &bucket.key, .value_ptr = &self.small.values[0] };
+                    } else inner.nextEntry();
+                }
+                if (self.index == self.small.len) return null;
+                self.index += 1;
+                return .{ .key_ptr = &self.small.keys[self.index - 1], .value_ptr = &self.small.values[self.index - 1] };
+            }
+        };
+
+        inline fn hashFrag8(hash: u64) u8 {
+            return @truncate(hash >> 56);
+        }
+
+        /// Index of `key` among the inline entries.
+        inline fn findInline(self: *const Self, key: K, frag: u8) ?usize {
+            if (self.len == 0) return null;
+            const frags: @Vector(inline_capacity, u8) = self.frags;
+            const wanted: @Vector(inline_capacity, u8) = @splat(frag);
+            var mask: Mask = @bitCast(frags == wanted);
+            // Only the first `len` entries are live
+            mask &= @as(Mask, math.maxInt(Mask)) >> @intCast(inline_capacity - self.len);
+            while (mask != 0) : (mask &= mask - 1) {
+                const i = @ctz(mask);
+                if (eqlFn(self.keys[i], key)) return i;
+            }
+            return null;
+        }
+
+        inline fn appendInline(self: *Self, key: K, frag: u8) void {
+            self.frags[self.len] = frag;
+            self.keys[self.len] = key;
+            self.len += 1;
+        }
+
+        /// Move the inline entries into a new heap table with room to double.
+        fn spill(self: *Self) !void {
+            var map = Map.init(self.allocator);
+            errdefer map.deinit();
+            try map.reserve(inline_capacity * 2);
+            for (self.keys[0..self.len], self.values[0..self.len]) |key, value| {
+                if (is_set) map.addAssumeCapacity(key) else map.putAssumeCapacity(key, value);
+            }
+            self.heap = map;
+            self.len = 0;
+        }
+    };
+}
+
+// ============================================================================
+// Sharded Tables
+// ============================================================================
+
+/// A table for concurrent use from many threads: `shard_count` independent tables, each behind
+/// its own `std.Thread.RwLock`, with keys split between them by hash bits.
+///
+/// ## Example
+/// ```zig
+/// var map = ShardedHashMap(u64, Session, 64).init(allocator);
+/// defer map.deinit();
+/// try map.put(id, session); // from any thread
+/// ```
+pub fn ShardedHashMap(comptime K: type, comptime V: type, comptime shard_count: usize) type {
+    return ShardedHashMapWithOptions(K, V, AutoHashFn(K).hash, AutoEqlFn(K).eql, .{}, shard_count);
+}
+
+/// `ShardedHashMap` with custom hash/equality functions, and `Options` for the shard tables.
+///
+/// Each operation hashes the key once, picks the shard from the hash bits just below the
+/// metadata fragment, and runs the `*WithHash` variant of the operation on that shard under its
+/// lock: exclusive for writes, shared for reads. The home bucket (low bits) and fragment (top
+/// bits) within a shard therefore stay independent of the shard choice. Threads only contend
+/// when they hit the same shard, so with a few shards per thread readers and writers mostly run
+/// in parallel. Shards are cache-line aligned so their locks don't share lines.
+///
+/// No operation hands out pointers into a shard, since they would outlive the lock; use
+/// `lockShard` for read-modify-write sequences. Operations that span shards (`count`, `clear`,
+/// `ensureTotalCapacity`) take the shard locks one at a time, so they are not atomic with respect
+/// to concurrent writers.
+pub fn ShardedHashMapWithOptions(
+    comptime K: type,
+    comptime V: type,
+    comptime hashFn: fn (K) u64,
+    comptime eqlFn: fn (K, K) bool,
+    comptime options: Options,
+    comptime shard_count: usize,
+) type {
+    if (shard_count == 0 or !math.isPowerOfTwo(shard_count)) {
+        @compileError("ShardedHashMap shard_count must be a power of two");
+    }
+
+    return struct {
+        const Self = @This();
+        const is_set = V == void;
+
+        /// The table type of each shard.
+        pub const Map = HashMapWithOptions(K, V, hashFn, eqlFn, options);
+
+        const shard_bits: u16 = math.log2_int(usize, shard_count);
+        const frag_bits: u16 = @popCount(Map.HASH_FRAG_MASK);
+        const shard_shift: u6 = @intCast(64 - frag_bits - shard_bits);
+
+        comptime {
+            if (frag_bits + shard_bits > 32) {
+                @compileError("ShardedHashMap shard bits overlap the low half of the hash; use fewer shards or fragment bits");
+            }
+        }
+
+        const Shard = struct {
+            lock: std.Thread.RwLock align(std.atomic.cache_line) = .{},
+            map: Map,
+        };
+
+        /// A shard held under its exclusive lock, from `lockShard`.
+        pub const LockedShard = struct {
+            /// The shard table; valid until `unlock`.
+            map: *Map,
+            /// `Map.hashKey` of the key passed to `lockShard`, for the `*WithHash` operations.
+            hash: u64,
+            lock: *std.Thread.RwLock,
+
+            /// Release the shard lock.
+            pub fn unlock(self: LockedShard) void {
+                self.lock.unlock();
+            }
+        };
+
+        // Fields
+        shards: [shard_count]Shard,
+
+        /// Initialize an empty table; allocates nothing until the first insert into a shard.
+        /// `allocator` must be thread-safe.
+        pub fn init(allocator: Allocator) Self {
+            var self: Self = undefined;
+            for (&self.shards) |*shard| shard.* = .{ .map = Map.init(allocator) };
+            return self;
+        }
+
+        /// Deinitialize and free all shards. Not thread-safe.
+        pub fn deinit(self: *Self) void {
+            for (&self.shards) |*shard| shard.map.deinit();
+            self.* = undefined;
+        }
+
+        /// The shard `hash` belongs to.
+        pub fn shardIndex(hash: u64) usize {
+            return @intCast((hash >> shard_shift) & (shard_count - 1));
+        }
+
+        inline fn shardFor(self: *Self, hash: u64) *Shard {
+            return &self.shards[shardIndex(hash)];
+        }
+
+        /// Returns the number of entries, summed over the shards one at a time.
+        pub fn count(self: *Self) usize {
+            var total: usize = 0;
+            for (&self.shards) |*shard| {
+                shard.lock.lockShared();
+                defer shard.lock.unlockShared();
+                total += shard.map.count();
+            }
+            return total;
+        }
+
+        /// Insert or update a key-value pair.
+        pub fn put(self: *Self, key: K, value: V) !void {
+            if (is_set) @compileError("Use add() for sets");
+            const hash = hashFn(key);
+            const shard = self.shardFor(hash);
+            shard.lock.lock();
+            defer shard.lock.unlock();
+            try shard.map.putWithHash(key, value, hash);
+        }
+
+        /// Add a key to the set.
+        pub fn add(self: *Self, key: K) !void {
+            if (!is_set) @compileError("Use put() for maps");
+            const hash = hashFn(key);
+            const shard = self.shardFor(hash);
+            shard.lock.lock();
+            defer shard.lock.unlock();
+            try shard.map.addWithHash(key, hash);
+        }
+
+        /// Get the value of `key`, inserting `value` first if it is absent.
+        pub fn getOrPutValue(self: *Self, key: K, value: V) !V {
+            if (is_set) @compileError("Use add() for sets");
+            const hash = hashFn(key);
+            const shard = self.shardFor(hash);
+            shard.lock.lock();
+            defer shard.lock.unlock();
+            const result = try shard.map.getOrPutWithHash(key, hash);
+            if (!result.found_existing) result.value_ptr.* = value;
+            return result.value_ptr.*;
+        }
+
+        /// Get the value associated with a key, or null if not found.
+        pub fn get(self: *Self, key: K) ?V {
+            if (is_set) @compileError("Use contains() for sets");
+            const hash = hashFn(key);
+            const shard = self.shardFor(hash);
+            shard.lock.lockShared();
+            defer shard.lock.unlockShared();
+            return shard.map.getWithHash(key, hash);
+        }
+
+        /// Check if a key exists.
+        pub fn contains(self: *Self, key: K) bool {
+            const hash = hashFn(key);
+            const shard = self.shardFor(hash);
+            shard.lock.lockShared();
+            defer shard.lock.unlockShared();
+            return shard.map.containsWithHash(key, hash);
+        }
+
+        /// Remove a key. Returns true if the key was found and removed.
+        pub fn remove(self: *Self, key: K) bool {
+            const hash = hashFn(key);
+            const shard = self.shardFor(hash);
+            shard.lock.lock();
+            defer shard.lock.unlock();
+            return shard.map.removeWithHash(key, hash);
+        }
+
+        /// Lock the shard of `key` exclusively and return it, for several operations on keys of
+        /// that shard (with `hash`, or `Map.hashKey` for other keys) without releasing the lock
+        /// in between. Call `unlock` on the result; locking a second shard while holding one can
+        /// deadlock.
+        pub fn lockShard(self: *Self, key: K) LockedShard {
+            const hash = hashFn(key);
+            const shard = self.shardFor(hash);
+            shard.lock.lock();
+            return .{ .map = &shard.map, .hash = hash, .lock = &shard.lock };
+        }
+
+        /// Remove all keys from every shard without deallocating.
+        pub fn clear(self: *Self) void {
+            for (&self.shards) |*shard| {
+                shard.lock.lock();
+                defer shard.lock.unlock();
+                shard.map.clear();
+            }
+        }
+
+        /// Give every shard room for its even share of `new_capacity` keys. Shards that receive
+        /// more than their share later grow as usual.
+        pub fn ensureTotalCapacity(self: *Self, new_capacity: usize) !void {
+            const per_shard = (new_capacity + shard_count - 1) / shard_count;
+            for (&self.shards) |*shard| {
+                shard.lock.lock();
+                defer shard.lock.unlock();
+                try shard.map.ensureTotalCapacity(per_shard);
+            }
+        }
+    };
+}
+
+// ============================================================================
+// Table Pool
+// ============================================================================
+
+/// An allocator adapter that keeps freed blocks and hands them out again for allocations of
+/// the same size and alignment, so tables that are created and destroyed at a high rate reuse
+/// their storage instead of going back to the backing allocator (and the OS) every time.
+///
+/// Table storage comes in few distinct sizes, one per power-of-two bucket count, which makes
+/// exact size classes a good fit. Each class keeps up to `max_blocks_per_class` freed blocks in
+/// a list threaded through the blocks themselves. Blocks smaller than a pointer, classes beyond
+/// `MAX_CLASSES` and blocks beyond the cap go straight to the backing allocator. `resize` and
+/// `remap` pass through, so `Options.grow_in_place` still works. Not thread-safe.
+///
+/// ## Example
+/// ```zig
+/// var pool = TablePool.init(std.heap.page_allocator, 64);
+/// defer pool.deinit();
+/// var map = HashMap(u32, u32).init(pool.allocator());
+/// ```
+pub const TablePool = struct {
+    backing: Allocator,
+    max_blocks_per_class: usize,
+    classes: [MAX_CLASSES]SizeClass = undefined,
+    class_count: usize = 0,
+
+    /// Distinct block sizes kept.
+    pub const MAX_CLASSES = 48;
+
+    const SizeClass = struct {
+        len: usize,
+        alignment: std.mem.Alignment,
+        free_list: ?*FreeBlock,
+        free_count: usize,
+    };
+
+    const FreeBlock = struct {
+        next: ?*FreeBlock,
+    };
+
+    pub fn init(backing: Allocator, max_blocks_per_class: usize) TablePool {
+        return .{ .backing = backing, .max_blocks_per_class = max_blocks_per_class };
+    }
+
+    /// Return every kept block to the backing allocator.
+    pub fn deinit(self: *TablePool) void {
+        self.trim();
+        self.class_count = 0;
+    }
+
+    /// Return every kept block to the backing allocator, keeping the pool usable.
+    pub fn trim(self: *TablePool) void {
+        for (self.classes[0..self.class_count]) |*class| {
+            while (class.free_list) |block| {
+                class.free_list = block.next;
+                const ptr: [*]u8 = @ptrCast(block);
+                self.backing.rawFree(ptr[0..class.len], class.alignment, @returnAddress());
+            }
+            class.free_count = 0;
+        }
+    }
+
+    /// Number of freed blocks currently kept for reuse.
+    pub fn cachedBlocks(self: *const TablePool) usize {
+        var total: usize = 0;
+        for (self.classes[0..self.class_count]) |class| total += class.free_count;
+        return total;
+    }
+
+    pub fn allocator(self: *TablePool) Allocator {
+        return .{
+            .ptr = self,
+            .vtable = &.{
+                .alloc = alloc,
+                .resize = resize,
+                .remap = remap,
+                .free = free,
+            },
+        };
+    }
+
+    fn poolable(len: usize, alignment: std.mem.Alignment) bool {
+        return len >= @sizeOf(FreeBlock) and alignment.compare(.gte, .of(FreeBlock));
+    }
+
+    fn findClass(self: *TablePool, len: usize, alignment: std.mem.Alignment) ?*SizeClass {
+        for (self.classes[0..self.class_count]) |*class| {
+            if (class.len == len and class.alignment == alignment) return class;
+        }
+        return null;
+    }
+
+    fn alloc(ctx: *anyopaque, len: usize, alignment: std.mem.Alignment, ret_addr: usize) ?[*]u8 {
+        const self: *TablePool = @ptrCast(@alignCast(ctx));
+        if (poolable(len, alignment)) {
+            if (self.findClass(len, alignment)) |class| {
+                if (class.free_list) |block| {
+                    class.free_list = block.next;
+                    class.free_count -= 1;
+                    return @ptrCast(block);
+                }
+            }
+        }
+        return self.backing.rawAlloc(len, alignment, ret_addr);
+    }
+
+    fn resize(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) bool {
+        const self: *TablePool = @ptrCast(@alignCast(ctx));
+        return self.backing.rawResize(memory, alignment, new_len, ret_addr);
+    }
+
+    fn remap(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) ?[*]u8 {
+        const self: *TablePool = @ptrCast(@alignCast(ctx));
+        return self.backing.rawRemap(memory, alignment, new_len, ret_addr);
+    }
+
+    fn free(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, ret_addr: usize) void {
+        const self: *TablePool = @ptrCast(@alignCast(ctx));
+        if (poolable(memory.len, alignment)) {
+            const class = self.findClass(memory.len, alignment) orelse blk: {
+                if (self.class_count == MAX_CLASSES) break :blk null;
+                self.classes[self.class_count] = .{ .len = memory.len, .alignment = alignment, .free_list = null, .free_count = 0 };
+                self.class_count += 1;
+                break :blk &self.classes[self.class_count - 1];
+            };
+            if (class) |c| {
+                if (c.free_count < self.max_blocks_per_class) {
+                    const block: *FreeBlock = @ptrCast(@alignCast(memory.ptr));
+                    block.next = c.free_list;
+                    c.free_list = block;
+                    c.free_count += 1;
+                    return;
+                }
+            }
+        }
+        self.backing.rawFree(memory, alignment, ret_addr);
+    }
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+test "basic map operations" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, []const u8).init(allocator);
+    defer map.deinit();
+
+    try map.put(1, "one");
+    try map.put(2, "two");
+    try map.put(3, "three");
+
+    try std.testing.expectEqual(@as(usize, 3), map.count());
+    try std.testing.expectEqualStrings("one", map.get(1).?);
+    try std.testing.expectEqualStrings("two", map.get(2).?);
+    try std.testing.expectEqualStrings("three", map.get(3).?);
+    try std.testing.expect(map.get(4) == null);
+
+    // Update
+    try map.put(2, "TWO");
+    try std.testing.expectEqualStrings("TWO", map.get(2).?);
+
+    // Remove
+    try std.testing.expect(map.remove(2));
+    try std.testing.expect(map.get(2) == null);
+    try std.testing.expectEqual(@as(usize, 2), map.count());
+
+    // Remove non-existent
+    try std.testing.expect(!map.remove(999));
+
+    std.debug.print("HASH_FRAG_SIZE_BITS: {any}\n", .{HASH_FRAG_SIZE_BITS});
+    std.debug.print("HASH_FRAG_MASK: {any}\n", .{HASH_FRAG_MASK});
+    std.debug.print("IN_HOME_BUCKET_MASK: {any}\n", .{IN_HOME_BUCKET_MASK});
+    std.debug.print("DISPLACEMENT_MASK: {any}\n", .{DISPLACEMENT_MASK});
+}
+
+test "basic set operations" {
+    const allocator = std.testing.allocator;
+    var set = HashMap(u32, void).init(allocator);
+    defer set.deinit();
+
+    try set.add(1);
+    try set.add(2);
+    try set.add(3);
+
+    try std.testing.expectEqual(@as(usize, 3), set.count());
+    try std.testing.expect(set.contains(1));
+    try std.testing.expect(set.contains(2));
+    try std.testing.expect(set.contains(3));
+    try std.testing.expect(!set.contains(4));
+
+    // Remove
+    try std.testing.expect(set.remove(2));
+    try std.testing.expect(!set.contains(2));
+    try std.testing.expectEqual(@as(usize, 2), set.count());
+}
+
+test "string keys" {
+    const allocator = std.testing.allocator;
+    var map = HashMap([]const u8, i32).init(allocator);
+    defer map.deinit();
+
+    try map.put("hello", 1);
+    try map.put("world", 2);
+    try map.put("foo", 3);
+
+    try std.testing.expectEqual(@as(i32, 1), map.get("hello").?);
+    try std.testing.expectEqual(@as(i32, 2), map.get("world").?);
+    try std.testing.expectEqual(@as(i32, 3), map.get("foo").?);
+    try std.testing.expect(map.get("bar") == null);
+}
+
+test "many insertions and removals" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
+
+    // Insert many
+    for (0..1000) |i| {
+        try map.put(@intCast(i), @intCast(i * 2));
+    }
+    try std.testing.expectEqual(@as(usize, 1000), map.count());
+
+    // Verify all
+    for (0..1000) |i| {
+        try std.testing.expectEqual(@as(u32, @intCast(i * 2)), map.get(@intCast(i)).?);
+    }
+
+    // Remove every third
+    for (0..1000) |i| {
+        if (i % 3 == 0) {
+            try std.testing.expect(map.remove(@intCast(i)));
+        }
+    }
+
+    // Verify remaining
+    var remaining: usize = 0;
+    for (0..1000) |i| {
+        if (i % 3 != 0) {
+            try std.testing.expectEqual(@as(u32, @intCast(i * 2)), map.get(@intCast(i)).?);
+            remaining += 1;
+        } else {
+            try std.testing.expect(map.get(@intCast(i)) == null);
+        }
+    }
+    try std.testing.expectEqual(remaining, map.count());
+}
+
+test "iterator" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
+
+    try map.put(1, 10);
+    try map.put(2, 20);
+    try map.put(3, 30);
+
+    var sum: u32 = 0;
+    var iter = map.iterator();
+    while (iter.next()) |bucket| {
+        sum += bucket.val;
+    }
+    try std.testing.expectEqual(@as(u32, 60), sum);
+}
+
+test "clone" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
+
+    try map.put(1, 10);
+    try map.put(2, 20);
+
+    var map2 = try map.clone();
+    defer map2.deinit();
+
+    try std.testing.expectEqual(@as(u32, 10), map2.get(1).?);
+    try std.testing.expectEqual(@as(u32, 20), map2.get(2).?);
+
+    // Modify original shouldn't affect clone
+    try map.put(1, 100);
+    try std.testing.expectEqual(@as(u32, 10), map2.get(1).?);
+}
+
+test "reserve and shrink" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
+
+    try map.reserve(100);
+    try std.testing.expect(map.capacity() >= 100);
+
+    for (0..50) |i| {
+        try map.put(@intCast(i), @intCast(i));
+    }
+
+    try map.shrink();
+    try std.testing.expectEqual(@as(usize, 50), map.count());
+}
+
+test "ensureTotalCapacity and ensureUnusedCapacity" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
+
+    // Pre-allocate for 1000 items
+    try map.ensureTotalCapacity(1000);
+    try std.testing.expect(map.capacity() >= 1000);
+
+    // Insert 500 items - should not cause any rehash
+    const initial_bucket_count = map.bucketCount();
+    for (0..500) |i| {
+        try map.put(@intCast(i), @intCast(i));
+    }
+    try std.testing.expectEqual(initial_bucket_count, map.bucketCount());
+
+    // ensureUnusedCapacity for 500 more - should not grow since we have room
+    try map.ensureUnusedCapacity(500);
+    try std.testing.expectEqual(initial_bucket_count, map.bucketCount());
+}
+
+test "clear" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
+
+    for (0..100) |i| {
+        try map.put(@intCast(i), @intCast(i));
+    }
+    try std.testing.expectEqual(@as(usize, 100), map.count());
+
+    map.clear();
+    try std.testing.expectEqual(@as(usize, 0), map.count());
+    try std.testing.expect(map.get(50) == null);
+
+    // Can still use after clear
+    try map.put(1, 1);
+    try std.testing.expectEqual(@as(u32, 1), map.get(1).?);
+}
+
+test "putNoClobber" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
+
+    try std.testing.expect(try map.putNoClobber(1, 10));
+    try std.testing.expect(!try map.putNoClobber(1, 20));
+    try std.testing.expectEqual(@as(u32, 10), map.get(1).?);
+}
+
+test "enum keys" {
+    const Color = enum { red, green, blue };
+    const allocator = std.testing.allocator;
+    var map = HashMap(Color, []const u8).init(allocator);
+    defer map.deinit();
+
+    try map.put(.red, "rouge");
+    try map.put(.green, "vert");
+    try map.put(.blue, "bleu");
+
+    try std.testing.expectEqualStrings("rouge", map.get(.red).?);
+    try std.testing.expectEqualStrings("vert", map.get(.green).?);
+    try std.testing.expectEqualStrings("bleu", map.get(.blue).?);
+}
+
+test "getOrPut" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
+
+    // First insert
+    const result1 = try map.getOrPut(1);
+    try std.testing.expect(!result1.found_existing);
+    result1.value_ptr.* = 10;
+
+    // Second access - should find existing
+    const result2 = try map.getOrPut(1);
+    try std.testing.expect(result2.found_existing);
+    try std.testing.expectEqual(@as(u32, 10), result2.value_ptr.*);
+
+    // Modify via pointer
+    result2.value_ptr.* = 20;
+    try std.testing.expectEqual(@as(u32, 20), map.get(1).?);
+}
+
+test "getEntry" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, []const u8).init(allocator);
+    defer map.deinit();
+
+    try map.put(42, "answer");
+
+    const entry = map.getEntry(42).?;
+    try std.testing.expectEqual(@as(u32, 42), entry.key_ptr.*);
+    try std.testing.expectEqualStrings("answer", entry.value_ptr.*);
+
+    try std.testing.expect(map.getEntry(999) == null);
+}
+
+test "key iterator" {
+    const allocator = std.testing.allocator;
+    var set = HashMap(u32, void).init(allocator);
+    defer set.deinit();
+
+    try set.add(10);
+    try set.add(20);
+    try set.add(30);
+
+    var sum: u32 = 0;
+    var iter = set.keyIterator();
+    while (iter.next()) |key| {
+        sum += key;
+    }
+    try std.testing.expectEqual(@as(u32, 60), sum);
+}
+
+test "value iterator" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
+
+    try map.put(1, 100);
+    try map.put(2, 200);
+    try map.put(3, 300);
+
+    var sum: u32 = 0;
+    var iter = map.valueIterator();
+    while (iter.next()) |val| {
+        sum += val;
+    }
+    try std.testing.expectEqual(@as(u32, 600), sum);
+}
+
+test "empty table operations" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
+
+    try std.testing.expectEqual(@as(usize, 0), map.count());
+    try std.testing.expectEqual(@as(usize, 0), map.bucketCount());
+    try std.testing.expect(map.get(1) == null);
+    try std.testing.expect(!map.remove(1));
+
+    var iter = map.iterator();
+    try std.testing.expect(iter.next() == null);
+}
+
+test "set with many collisions" {
+    const allocator = std.testing.allocator;
+    var set = HashMap(u32, void).init(allocator);
+    defer set.deinit();
+
+    // Insert values that might have hash collisions
+    for (0..500) |i| {
+        try set.add(@intCast(i * 8)); // Multiples of 8
+    }
+    try std.testing.expectEqual(@as(usize, 500), set.count());
+
+    // Verify all exist
+    for (0..500) |i| {
+        try std.testing.expect(set.contains(@intCast(i * 8)));
+    }
+
+    // Remove half
+    for (0..250) |i| {
+        try std.testing.expect(set.remove(@intCast(i * 8)));
+    }
+    try std.testing.expectEqual(@as(usize, 250), set.count());
+
+    // Verify remaining
+    for (250..500) |i| {
+        try std.testing.expect(set.contains(@intCast(i * 8)));
+    }
+}
+
+test "max load factor adjustment" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
+
+    // Set low load factor
+    map.setMaxLoadFactor(0.5);
+
+    for (0..100) |i| {
+        try map.put(@intCast(i), @intCast(i));
+    }
+
+    // With 0.5 load factor, bucket count should be >= 200
+    try std.testing.expect(map.bucketCount() >= 200);
+}
+
+test "getPtr modification" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
+
+    try map.put(1, 10);
+
+    const ptr = map.getPtr(1).?;
+    ptr.* = 999;
+
+    try std.testing.expectEqual(@as(u32, 999), map.get(1).?);
+}
+
+test "custom hash function" {
+    const MyHashFn = struct {
+        fn hash(key: u32) u64 {
+            return key; // Identity hash for testing
+        }
+    };
+    const MyEqlFn = struct {
+        fn eql(a: u32, b: u32) bool {
+            return a == b;
+        }
+    };
+
+    const allocator = std.testing.allocator;
+    var map = HashMapWithFns(u32, u32, MyHashFn.hash, MyEqlFn.eql).init(allocator);
+    defer map.deinit();
+
+    try map.put(1, 10);
+    try map.put(2, 20);
+
+    try std.testing.expectEqual(@as(u32, 10), map.get(1).?);
+    try std.testing.expectEqual(@as(u32, 20), map.get(2).?);
+}
+
+test "stress test - many operations" {
+    const allocator = std.testing.allocator;
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
+
+    // Insert 10000 items
+    for (0..10000) |i| {
+        try map.put(@intCast(i), @intCast(i * 3));
+    }
+    try std.testing.expectEqual(@as(usize, 10000), map.count());
+
+    // Remove every other
+    for (0..10000) |i| {
+        if (i % 2 == 0) {
+            _ = map.remove(@intCast(i));
+        }
+    }
+    try std.testing.expectEqual(@as(usize, 5000), map.count());
 
-    // Remove non-existent
-    try std.testing.expect(!map.remove(999));
+    // Re-insert removed ones
+    for (0..10000) |i| {
+        if (i % 2 == 0) {
+            try map.put(@intCast(i), @intCast(i * 5));
+        }
+    }
+    try std.testing.expectEqual(@as(usize, 10000), map.count());
 
-    std.debug.print("HASH_FRAG_SIZE_BITS: {any}\n", .{HASH_FRAG_SIZE_BITS});
-    std.debug.print("HASH_FRAG_MASK: {any}\n", .{HASH_FRAG_MASK});
-    std.debug.print("IN_HOME_BUCKET_MASK: {any}\n", .{IN_HOME_BUCKET_MASK});
-    std.debug.print("DISPLACEMENT_MASK: {any}\n", .{DISPLACEMENT_MASK});
+    // Verify
+    for (0..10000) |i| {
+        const expected: u32 = if (i % 2 == 0) @intCast(i * 5) else @intCast(i * 3);
+        try std.testing.expectEqual(expected, map.get(@intCast(i)).?);
+    }
 }
 
-test "basic set operations" {
+test "getMany and containsMany" {
     const allocator = std.testing.allocator;
-    var set = HashMap(u32, void).init(allocator);
-    defer set.deinit();
+    var map = HashMap(u32, u32).init(allocator);
+    defer map.deinit();
 
-    try set.add(1);
-    try set.add(2);
-    try set.add(3);
+    // Batch lookups on an empty table
+    var empty_out: [4]?u32 = undefined;
+    try std.testing.expectEqual(@as(usize, 0), map.getMany(&.{ 1, 2, 3, 4 }, &empty_out));
+    for (empty_out) |v| try std.testing.expect(v == null);
 
-    try std.testing.expectEqual(@as(usize, 3), set.count());
-    try std.testing.expect(set.contains(1));
-    try std.testing.expect(set.contains(2));
-    try std.testing.expect(set.contains(3));
-    try std.testing.expect(!set.contains(4));
+    for (0..1000) |i| {
+        try map.put(@intCast(i), @intCast(i * 7));
+    }
 
-    // Remove
-    try std.testing.expect(set.remove(2));
-    try std.testing.expect(!set.contains(2));
-    try std.testing.expectEqual(@as(usize, 2), set.count());
+    // Mix of hits and misses, length not a multiple of the batch size
+    var keys: [101]u32 = undefined;
+    for (&keys, 0..) |*k, i| k.* = @intCast(i * 20);
+
+    var values: [101]?u32 = undefined;
+    const found = map.getManyBatched(8, &keys, &values);
+    var expected_found: usize = 0;
+    for (keys, values) |k, v| {
+        if (k < 1000) {
+            try std.testing.expectEqual(k * 7, v.?);
+            expected_found += 1;
+        } else {
+            try std.testing.expect(v == null);
+        }
+    }
+    try std.testing.expectEqual(expected_found, found);
+
+    var present: [101]bool = undefined;
+    try std.testing.expectEqual(expected_found, map.containsMany(&keys, &present));
+    for (keys, present) |k, p| try std.testing.expectEqual(k < 1000, p);
 }
 
-test "string keys" {
+test "precomputed-hash operations" {
     const allocator = std.testing.allocator;
-    var map = HashMap([]const u8, i32).init(allocator);
-    defer map.deinit();
-
-    try map.put("hello", 1);
-    try map.put("world", 2);
-    try map.put("foo", 3);
-
-    try std.testing.expectEqual(@as(i32, 1), map.get("hello").?);
-    try std.testing.expectEqual(@as(i32, 2), map.get("world").?);
-    try std.testing.expectEqual(@as(i32, 3), map.get("foo").?);
-    try std.testing.expect(map.get("bar") == null);
+    const Map = HashMap([]const u8, u32);
+
+    var a = Map.init(allocator);
+    defer a.deinit();
+    var b = Map.init(allocator);
+    defer b.deinit();
+
+    // Probing an empty table with a hash must not touch unallocated buckets
+    const hello = Map.hashKey("hello");
+    a.prefetch(hello);
+    try std.testing.expect(a.getWithHash("hello", hello) == null);
+    try std.testing.expect(!a.removeWithHash("hello", hello));
+
+    try a.putWithHash("hello", 1, hello);
+    try b.put("hello", 2);
+
+    // Hash once, probe both tables
+    a.prefetch(hello);
+    b.prefetch(hello);
+    try std.testing.expectEqual(@as(u32, 1), a.getWithHash("hello", hello).?);
+    try std.testing.expectEqual(@as(u32, 2), b.getWithHash("hello", hello).?);
+    try std.testing.expect(b.containsWithHash("hello", hello));
+
+    b.getPtrWithHash("hello", hello).?.* = 20;
+    try std.testing.expectEqual(@as(u32, 20), b.get("hello").?);
+
+    const world = Map.hashKey("world");
+    const gop = try a.getOrPutWithHash("world", world);
+    try std.testing.expect(!gop.found_existing);
+    gop.value_ptr.* = 3;
+    try std.testing.expectEqual(@as(u32, 3), a.get("world").?);
+
+    try std.testing.expect(a.removeWithHash("hello", hello));
+    try std.testing.expect(!a.contains("hello"));
+    try std.testing.expectEqual(@as(usize, 1), a.count());
+
+    var set = HashMap(u64, void).init(allocator);
+    defer set.deinit();
+    try set.addWithHash(7, HashMap(u64, void).hashKey(7));
+    try std.testing.expect(set.contains(7));
 }
 
-test "many insertions and removals" {
+test "string keys survive growth and churn" {
     const allocator = std.testing.allocator;
-    var map = HashMap(u32, u32).init(allocator);
+    var map = HashMap([]const u8, u32).init(allocator);
     defer map.deinit();
 
-    // Insert many
-    for (0..1000) |i| {
-        try map.put(@intCast(i), @intCast(i * 2));
-    }
-    try std.testing.expectEqual(@as(usize, 1000), map.count());
+    var storage: [2000][8]u8 = undefined;
+    for (&storage, 0..) |*buf, i| _ = std.fmt.bufPrint(buf, "k{d:0>7}", .{i}) catch unreachable;
 
-    // Verify all
-    for (0..1000) |i| {
-        try std.testing.expectEqual(@as(u32, @intCast(i * 2)), map.get(@intCast(i)).?);
+    // Grows through many rehashes, all driven by cached hashes
+    for (&storage, 0..) |*buf, i| try map.put(buf, @intCast(i));
+
+    // Removal exercises eraseAtIndex's home-bucket lookup for displaced keys
+    for (&storage, 0..) |*buf, i| {
+        if (i % 3 == 0) try std.testing.expect(map.remove(buf));
     }
+    try map.shrink();
 
-    // Remove every third
-    for (0..1000) |i| {
+    for (&storage, 0..) |*buf, i| {
         if (i % 3 == 0) {
-            try std.testing.expect(map.remove(@intCast(i)));
+            try std.testing.expect(map.get(buf) == null);
+        } else {
+            try std.testing.expectEqual(@as(u32, @intCast(i)), map.get(buf).?);
         }
     }
+}
 
-    // Verify remaining
-    var remaining: usize = 0;
-    for (0..1000) |i| {
-        if (i % 3 != 0) {
-            try std.testing.expectEqual(@as(u32, @intCast(i * 2)), map.get(@intCast(i)).?);
-            remaining += 1;
-        } else {
-            try std.testing.expect(map.get(@intCast(i)) == null);
+test "stored-hash option" {
+    const Point = struct {
+        x: i32,
+        y: i32,
+
+        fn hash(p: @This()) u64 {
+            return hashInteger(@as(u64, @as(u32, @bitCast(p.x))) << 32 | @as(u32, @bitCast(p.y)));
         }
+        fn eql(a: @This(), b: @This()) bool {
+            return a.x == b.x and a.y == b.y;
+        }
+    };
+
+    const Plain = HashMapWithOptions(Point, u32, Point.hash, Point.eql, .{});
+    const Stored = HashMapWithOptions(Point, u32, Point.hash, Point.eql, .{ .store_hash = true });
+    try std.testing.expect(@sizeOf(Stored.Bucket) > @sizeOf(Plain.Bucket));
+
+    // Strings store the hash by default and can opt out
+    const Unhashed = HashMapWithOptions([]const u8, u32, autoHash([]const u8), autoEql([]const u8), .{ .store_hash = false });
+    try std.testing.expect(@sizeOf(Unhashed.Bucket) < @sizeOf(HashMap([]const u8, u32).Bucket));
+
+    const allocator = std.testing.allocator;
+    var map = Stored.init(allocator);
+    defer map.deinit();
+
+    for (0..2000) |i| {
+        const n: i32 = @intCast(i);
+        try map.put(.{ .x = n, .y = -n }, @intCast(i));
     }
-    try std.testing.expectEqual(remaining, map.count());
+    for (0..2000) |i| {
+        const n: i32 = @intCast(i);
+        if (i % 2 == 0) try std.testing.expect(map.remove(.{ .x = n, .y = -n }));
+    }
+    for (0..2000) |i| {
+        const n: i32 = @intCast(i);
+        const got = map.get(.{ .x = n, .y = -n });
+        if (i % 2 == 0) try std.testing.expect(got == null) else try std.testing.expectEqual(@as(u32, @intCast(i)), got.?);
+    }
+
+    var strings = Unhashed.init(allocator);
+    defer strings.deinit();
+    try strings.put("alpha", 1);
+    try strings.put("beta", 2);
+    try std.testing.expect(strings.remove("alpha"));
+    try std.testing.expectEqual(@as(u32, 2), strings.get("beta").?);
 }
 
-test "iterator" {
+test "iterator reset" {
     const allocator = std.testing.allocator;
     var map = HashMap(u32, u32).init(allocator);
     defer map.deinit();
 
     try map.put(1, 10);
     try map.put(2, 20);
-    try map.put(3, 30);
 
-    var sum: u32 = 0;
     var iter = map.iterator();
-    while (iter.next()) |bucket| {
-        sum += bucket.val;
-    }
-    try std.testing.expectEqual(@as(u32, 60), sum);
+
+    // First pass
+    var count1: u32 = 0;
+    while (iter.next()) |_| count1 += 1;
+    try std.testing.expectEqual(@as(u32, 2), count1);
+
+    // After reset
+    iter.reset();
+    var count2: u32 = 0;
+    while (iter.next()) |_| count2 += 1;
+    try std.testing.expectEqual(@as(u32, 2), count2);
 }
 
-test "clone" {
+test "incremental resize" {
     const allocator = std.testing.allocator;
-    var map = HashMap(u32, u32).init(allocator);
+    const Map = HashMapWithOptions(u32, u32, autoHash(u32), autoEql(u32), .{ .incremental_resize = true, .resize_step = 2 });
+    var map = Map.init(allocator);
     defer map.deinit();
 
-    try map.put(1, 10);
-    try map.put(2, 20);
+    // Grow through several resizes, checking every key while old and new tables coexist
+    var saw_resizing = false;
+    for (0..5000) |i| {
+        try map.put(@intCast(i), @intCast(i));
+        saw_resizing = saw_resizing or map.isResizing();
+        if (i % 97 == 0) {
+            for (0..i + 1) |j| try std.testing.expectEqual(@as(u32, @intCast(j)), map.get(@intCast(j)).?);
+        }
+    }
+    try std.testing.expect(saw_resizing);
+    try std.testing.expectEqual(@as(usize, 5000), map.count());
 
-    var map2 = try map.clone();
-    defer map2.deinit();
+    // Iteration covers both tables exactly once
+    var iter = map.iterator();
+    var seen: usize = 0;
+    while (iter.next()) |bucket| {
+        try std.testing.expectEqual(bucket.key, bucket.val);
+        seen += 1;
+    }
+    try std.testing.expectEqual(map.count(), seen);
+
+    // Updates and removes reach keys still in the old table
+    for (0..5000) |i| {
+        if (i % 3 == 0) try std.testing.expect(map.remove(@intCast(i)));
+        if (i % 3 == 1) {
+            const r = try map.getOrPut(@intCast(i));
+            try std.testing.expect(r.found_existing);
+            r.value_ptr.* += 1;
+        }
+    }
 
-    try std.testing.expectEqual(@as(u32, 10), map2.get(1).?);
-    try std.testing.expectEqual(@as(u32, 20), map2.get(2).?);
+    var copy = try map.clone();
+    defer copy.deinit();
+    try copy.finishResize();
+    try std.testing.expect(!copy.isResizing());
+
+    for (0..5000) |i| {
+        const k: u32 = @intCast(i);
+        const expected: ?u32 = switch (i % 3) {
+            0 => null,
+            1 => k + 1,
+            else => k,
+        };
+        try std.testing.expectEqual(expected, map.get(k));
+        try std.testing.expectEqual(expected, copy.get(k));
+    }
+    try std.testing.expectEqual(map.count(), copy.count());
 
-    // Modify original shouldn't affect clone
-    try map.put(1, 100);
-    try std.testing.expectEqual(@as(u32, 10), map2.get(1).?);
+    map.clear();
+    try std.testing.expect(!map.isResizing());
+    try std.testing.expectEqual(@as(usize, 0), map.count());
 }
 
-test "reserve and shrink" {
-    const allocator = std.testing.allocator;
-    var map = HashMap(u32, u32).init(allocator);
+test "grow in place" {
+    const Map = HashMapWithOptions(u32, u32, autoHash(u32), autoEql(u32), .{ .grow_in_place = true });
+
+    // A fixed buffer allocator can extend its most recent allocation, so every doubling
+    // happens in place; the fallback block reserved behind it is handed back right after,
+    // so between inserts the buffer never holds more than the current table
+    const buffer = try std.testing.allocator.alloc(u8, 1 << 22);
+    defer std.testing.allocator.free(buffer);
+    var fba = std.heap.FixedBufferAllocator.init(buffer);
+
+    var map = Map.init(fba.allocator());
     defer map.deinit();
 
-    try map.reserve(100);
-    try std.testing.expect(map.capacity() >= 100);
+    for (0..20000) |i| {
+        try map.put(@intCast(i), @intCast(i * 3));
+        try std.testing.expectEqual(map.totalAllocSize(), fba.end_index);
+    }
+    try std.testing.expectEqual(@as(usize, 20000), map.count());
 
-    for (0..50) |i| {
-        try map.put(@intCast(i), @intCast(i));
+    for (0..20000) |i| {
+        try std.testing.expectEqual(@as(u32, @intCast(i * 3)), map.get(@intCast(i)).?);
+        if (i % 2 == 0) try std.testing.expect(map.remove(@intCast(i)));
     }
 
-    try map.shrink();
-    try std.testing.expectEqual(@as(usize, 50), map.count());
+    var iter = map.iterator();
+    var seen: usize = 0;
+    while (iter.next()) |bucket| {
+        try std.testing.expect(bucket.key % 2 == 1);
+        seen += 1;
+    }
+    try std.testing.expectEqual(@as(usize, 10000), seen);
+
+    // Growth via reserve takes the same path
+    try map.reserve(100000);
+    try std.testing.expectEqual(map.totalAllocSize(), fba.end_index);
+    for (0..20000) |i| {
+        try std.testing.expectEqual(i % 2 == 1, map.contains(@intCast(i)));
+    }
 }
 
-test "ensureTotalCapacity and ensureUnusedCapacity" {
+test "grow in place without memory for the fallback block" {
+    const Map = HashMapWithOptions(u32, u32, autoHash(u32), autoEql(u32), .{ .grow_in_place = true });
+
+    // Only the first table is allocated: the first doubling extends it in place, fails to
+    // reserve its fallback and gives the extension back, and the regular rehash fails too
+    const buffer = try std.testing.allocator.alloc(u8, 1 << 20);
+    defer std.testing.allocator.free(buffer);
+    var fba = std.heap.FixedBufferAllocator.init(buffer);
+    var failing = std.testing.FailingAllocator.init(fba.allocator(), .{ .fail_index = 1 });
+
+    var map = Map.init(failing.allocator());
+    defer map.deinit();
+
+    var n: u32 = 0;
+    while (true) : (n += 1) {
+        map.put(n, n * 3) catch |err| {
+            try std.testing.expectEqual(error.OutOfMemory, err);
+            break;
+        };
+    }
+    try std.testing.expect(n > 0);
+    try std.testing.expectEqual(map.totalAllocSize(), fba.end_index);
+
+    // The table is as it was before the failed insert
+    const buckets = map.bucketCount();
+    try std.testing.expectEqual(@as(usize, n), map.count());
+    for (0..n) |i| try std.testing.expectEqual(@as(u32, @intCast(i * 3)), map.get(@intCast(i)).?);
+    try std.testing.expect(!map.contains(n));
+    try map.put(0, 1);
+    try std.testing.expect(map.remove(1));
+    try std.testing.expectEqual(buckets, map.bucketCount());
+    try std.testing.expectEqual(@as(usize, n - 1), map.count());
+}
+
+test "overflow stash" {
+    // Every key hashes to home bucket 0, so chains overflow DISPLACEMENT_MASK however large the table
+    const Clustered = struct {
+        fn hash(k: u32) u64 {
+            return @as(u64, k) << 40;
+        }
+        fn eql(a: u32, b: u32) bool {
+            return a == b;
+        }
+    };
+    const Map = HashMapWithOptions(u32, u32, Clustered.hash, Clustered.eql, .{ .stash_capacity = 64 });
+
     const allocator = std.testing.allocator;
-    var map = HashMap(u32, u32).init(allocator);
+    var map = Map.init(allocator);
     defer map.deinit();
 
-    // Pre-allocate for 1000 items
-    try map.ensureTotalCapacity(1000);
-    try std.testing.expect(map.capacity() >= 1000);
+    const n = DISPLACEMENT_MASK + 50;
+    for (0..n) |i| try map.put(@intCast(i), @intCast(i));
+    try std.testing.expectEqual(@as(usize, n), map.count());
+    // Growth stayed load-driven instead of doubling on every overflow
+    try std.testing.expectEqual(map.minBucketCountForSize(n), map.bucketCount());
 
-    // Insert 500 items - should not cause any rehash
-    const initial_bucket_count = map.bucketCount();
-    for (0..500) |i| {
-        try map.put(@intCast(i), @intCast(i));
+    // Stashed keys are updated in place, not duplicated
+    for (0..n) |i| try map.put(@intCast(i), @intCast(i + 1));
+    try std.testing.expectEqual(@as(usize, n), map.count());
+
+    var iter = map.iterator();
+    var seen: usize = 0;
+    while (iter.next()) |bucket| {
+        try std.testing.expectEqual(bucket.key + 1, bucket.val);
+        seen += 1;
     }
-    try std.testing.expectEqual(initial_bucket_count, map.bucketCount());
+    try std.testing.expectEqual(@as(usize, n), seen);
 
-    // ensureUnusedCapacity for 500 more - should not grow since we have room
-    try map.ensureUnusedCapacity(500);
-    try std.testing.expectEqual(initial_bucket_count, map.bucketCount());
+    var copy = try map.clone();
+    defer copy.deinit();
+
+    for (0..n) |i| {
+        if (i % 2 == 0) try std.testing.expect(map.remove(@intCast(i)));
+    }
+    for (0..n) |i| {
+        const expected: ?u32 = if (i % 2 == 0) null else @intCast(i + 1);
+        try std.testing.expectEqual(expected, map.get(@intCast(i)));
+        try std.testing.expectEqual(@as(u32, @intCast(i + 1)), copy.get(@intCast(i)).?);
+    }
+
+    // Rehashing carries the stash across
+    try copy.reserve(4 * n);
+    try std.testing.expectEqual(@as(usize, n), copy.count());
+    for (0..n) |i| try std.testing.expect(copy.contains(@intCast(i)));
 }
 
-test "clear" {
-    const allocator = std.testing.allocator;
-    var map = HashMap(u32, u32).init(allocator);
+test "grow in place with a narrow displacement and a large stash" {
+    // Homes 8 buckets apart: with 3 displacement bits each chain holds 7 keys and the rest stash
+    const Spaced = struct {
+        fn hash(k: u32) u64 {
+            return @as(u64, k) << 3;
+        }
+        fn eql(a: u32, b: u32) bool {
+            return a == b;
+        }
+    };
+    const Map = HashMapWithOptions(u32, u32, Spaced.hash, Spaced.eql, .{ .meta_bits = 8, .hash_frag_bits = 4, .stash_capacity = 512, .grow_in_place = true });
+    try std.testing.expectEqual(@as(Map.MetaType, 7), Map.DISPLACEMENT_MASK);
+
+    const buffer = try std.testing.allocator.alloc(u8, 1 << 20);
+    defer std.testing.allocator.free(buffer);
+    var fba = std.heap.FixedBufferAllocator.init(buffer);
+
+    var map = Map.init(fba.allocator());
     defer map.deinit();
+    map.setMaxLoadFactor(0.99);
+    try map.reserve(50);
+    try std.testing.expectEqual(@as(usize, 64), map.bucketCount());
 
-    for (0..100) |i| {
-        try map.put(@intCast(i), @intCast(i));
+    // 8 full chains and 300 stashed keys
+    const n = 7 * 8 + 300;
+    for (0..n) |i| try map.put(@intCast(i), @intCast(i * 3));
+    try std.testing.expectEqual(@as(usize, 64), map.bucketCount());
+
+    // Every doubling now spreads more stashed keys than the load limit leaves room for
+    map.setMaxLoadFactor(0.5);
+    try map.put(n, n * 3);
+    try std.testing.expectEqual(@as(usize, n + 1), map.count());
+    for (0..n + 1) |i| try std.testing.expectEqual(@as(u32, @intCast(i * 3)), map.get(@intCast(i)).?);
+
+    var iter = map.iterator();
+    var seen: usize = 0;
+    while (iter.next()) |bucket| {
+        try std.testing.expectEqual(bucket.key * 3, bucket.val);
+        seen += 1;
     }
-    try std.testing.expectEqual(@as(usize, 100), map.count());
+    try std.testing.expectEqual(@as(usize, n + 1), seen);
+}
 
-    map.clear();
-    try std.testing.expectEqual(@as(usize, 0), map.count());
-    try std.testing.expect(map.get(50) == null);
+test "metadata layout options" {
+    const allocator = std.testing.allocator;
 
-    // Can still use after clear
-    try map.put(1, 1);
-    try std.testing.expectEqual(@as(u32, 1), map.get(1).?);
+    // Defaults: 16-bit metadata throughout, wider fragments for strings
+    try std.testing.expect(HashMap(u16, void).MetaType == u16);
+    try std.testing.expect(HashMap(u32, void).MetaType == u16);
+    try std.testing.expect(HashMap(u16, u32).MetaType == u16);
+    try std.testing.expectEqual(@as(usize, 6), HashMap([]const u8, u32).Meta.FRAG_BITS);
+    try std.testing.expectEqual(HASH_FRAG_MASK, HashMap(u64, u64).HASH_FRAG_MASK);
+
+    const Small = HashMapWithOptions(u16, void, autoHash(u16), autoEql(u16), .{ .meta_bits = 8 });
+    try std.testing.expect(Small.MetaType == u8);
+    var small = Small.init(allocator);
+    defer small.deinit();
+    for (0..3000) |i| try small.add(@intCast(i * 7));
+    for (0..3000) |i| {
+        if (i % 2 == 0) try std.testing.expect(small.remove(@intCast(i * 7)));
+    }
+    // Iteration scans 8 one-byte entries per u64
+    var iter = small.iterator();
+    var seen: usize = 0;
+    while (iter.next()) |bucket| {
+        try std.testing.expect((bucket.key / 7) % 2 == 1);
+        seen += 1;
+    }
+    try std.testing.expectEqual(@as(usize, 1500), seen);
+
+    const Wide = HashMapWithOptions(u64, u64, autoHash(u64), autoEql(u64), .{ .meta_bits = 32, .hash_frag_bits = 16 });
+    try std.testing.expectEqual(@as(Wide.MetaType, 0xFFFF_0000), Wide.HASH_FRAG_MASK);
+    try std.testing.expectEqual(@as(Wide.MetaType, 0x7FFF), Wide.DISPLACEMENT_MASK);
+
+    var wide = Wide.init(allocator);
+    defer wide.deinit();
+    for (0..5000) |i| try wide.put(i, i * 2);
+    for (0..5000) |i| try std.testing.expectEqual(@as(u64, i * 2), wide.get(i).?);
+    try std.testing.expect(wide.get(5000) == null);
+
+    // Narrow metadata also works for maps and with in-place growth
+    const Narrow = HashMapWithOptions(u32, u32, autoHash(u32), autoEql(u32), .{ .meta_bits = 8, .hash_frag_bits = 2, .grow_in_place = true });
+    var narrow = Narrow.init(allocator);
+    defer narrow.deinit();
+    for (0..5000) |i| try narrow.put(@intCast(i), @intCast(i + 1));
+    for (0..5000) |i| try std.testing.expectEqual(@as(u32, @intCast(i + 1)), narrow.get(@intCast(i)).?);
+    try std.testing.expectEqual(@as(usize, 5000), narrow.count());
 }
 
-test "putNoClobber" {
+test "separate values layout" {
+    const Big = struct { a: u64, pad: [7]u64 = undefined };
     const allocator = std.testing.allocator;
-    var map = HashMap(u32, u32).init(allocator);
+
+    inline for (.{
+        Options{ .separate_values = true },
+        Options{ .separate_values = true, .grow_in_place = true },
+        Options{ .separate_values = true, .incremental_resize = true },
+    }) |opts| {
+        const Map = HashMapWithOptions(u64, Big, AutoHashFn(u64).hash, AutoEqlFn(u64).eql, opts);
+        try std.testing.expect(@sizeOf(Map.Bucket) == @sizeOf(u64));
+
+        var map = Map.init(allocator);
+        defer map.deinit();
+
+        const n = 5000;
+        for (0..n) |i| try map.put(i, .{ .a = i * 3 });
+        for (0..n) |i| try std.testing.expectEqual(@as(u64, i * 3), map.get(i).?.a);
+
+        for (0..n) |i| map.getPtr(i).?.a += 1;
+        for (0..n) |i| {
+            if (i % 3 == 0) try std.testing.expect(map.remove(i));
+        }
+
+        var copy = try map.clone();
+        defer copy.deinit();
+
+        var iter = map.iterator();
+        var seen: usize = 0;
+        while (iter.nextEntry()) |entry| {
+            try std.testing.expect(entry.key_ptr.* % 3 != 0);
+            try std.testing.expectEqual(entry.key_ptr.* * 3 + 1, entry.value_ptr.a);
+            seen += 1;
+        }
+        try std.testing.expectEqual(map.count(), seen);
+
+        var sum: u64 = 0;
+        var values = copy.valueIterator();
+        while (values.next()) |v| sum += v.a;
+        var expected: u64 = 0;
+        for (0..n) |i| {
+            if (i % 3 != 0) expected += i * 3 + 1;
+        }
+        try std.testing.expectEqual(expected, sum);
+    }
+
+    // Stashed keys keep their values in the stash's own value array
+    const Clustered = struct {
+        fn hash(k: u32) u64 {
+            return @as(u64, k) << 40;
+        }
+        fn eql(a: u32, b: u32) bool {
+            return a == b;
+        }
+    };
+    const Stashed = HashMapWithOptions(u32, u64, Clustered.hash, Clustered.eql, .{ .stash_capacity = 64, .separate_values = true });
+    var map = Stashed.init(allocator);
     defer map.deinit();
 
-    try std.testing.expect(try map.putNoClobber(1, 10));
-    try std.testing.expect(!try map.putNoClobber(1, 20));
-    try std.testing.expectEqual(@as(u32, 10), map.get(1).?);
+    const n = DISPLACEMENT_MASK + 50;
+    for (0..n) |i| try map.put(@intCast(i), i);
+    for (0..n) |i| {
+        if (i % 2 == 0) try std.testing.expect(map.remove(@intCast(i)));
+    }
+    for (0..n) |i| {
+        const expected: ?u64 = if (i % 2 == 0) null else i;
+        try std.testing.expectEqual(expected, map.get(@intCast(i)));
+    }
 }
 
-test "enum keys" {
-    const Color = enum { red, green, blue };
+test "dense values layout" {
+    const Big = struct { a: u64, pad: [15]u64 = undefined };
     const allocator = std.testing.allocator;
-    var map = HashMap(Color, []const u8).init(allocator);
-    defer map.deinit();
 
-    try map.put(.red, "rouge");
-    try map.put(.green, "vert");
-    try map.put(.blue, "bleu");
+    inline for (.{
+        Options{ .dense_values = true },
+        Options{ .dense_values = true, .grow_in_place = true },
+        Options{ .dense_values = true, .incremental_resize = true },
+    }) |opts| {
+        const Map = HashMapWithOptions(u64, Big, AutoHashFn(u64).hash, AutoEqlFn(u64).eql, opts);
+
+        var map = Map.init(allocator);
+        defer map.deinit();
+
+        const n = 5000;
+        for (0..n) |i| try map.put(i, .{ .a = i * 3 });
+        // Overwrites keep their dense slot
+        for (0..n) |i| try map.put(i, .{ .a = i * 3 + 1 });
+        try std.testing.expectEqual(@as(usize, n), map.denseValues().len);
+
+        for (0..n) |i| {
+            if (i % 3 == 0) try std.testing.expect(map.remove(i));
+        }
+        const gop = try map.getOrPut(n);
+        try std.testing.expect(!gop.found_existing);
+        gop.value_ptr.* = .{ .a = n * 3 + 1 };
+
+        for (0..n + 1) |i| {
+            const expected: ?u64 = if (i % 3 == 0 and i != n) null else i * 3 + 1;
+            try std.testing.expectEqual(expected, if (map.getPtr(i)) |v| v.a else null);
+        }
+
+        // The dense arrays stay packed and in step with the buckets
+        try std.testing.expectEqual(map.count(), map.denseValues().len);
+        for (map.denseKeys(), map.denseValues()) |k, v| {
+            try std.testing.expectEqual(k * 3 + 1, v.a);
+            try std.testing.expectEqual(v.a, map.get(k).?.a);
+        }
+
+        var copy = try map.clone();
+        defer copy.deinit();
+
+        var sum: u64 = 0;
+        var values = copy.valueIterator();
+        while (values.next()) |v| sum += v.a;
+        var iter = map.iterator();
+        var expected: u64 = 0;
+        while (iter.nextEntry()) |entry| expected += entry.value_ptr.a;
+        try std.testing.expectEqual(expected, sum);
+
+        map.clear();
+        try std.testing.expectEqual(@as(usize, 0), map.denseValues().len);
+        try std.testing.expect(map.get(1) == null);
+    }
 
-    try std.testing.expectEqualStrings("rouge", map.get(.red).?);
-    try std.testing.expectEqualStrings("vert", map.get(.green).?);
-    try std.testing.expectEqualStrings("bleu", map.get(.blue).?);
+    // Removing a stashed key repoints whichever bucket takes over its dense slot
+    const Clustered = struct {
+        fn hash(k: u32) u64 {
+            return @as(u64, k) << 40;
+        }
+        fn eql(a: u32, b: u32) bool {
+            return a == b;
+        }
+    };
+    const Stashed = HashMapWithOptions(u32, u64, Clustered.hash, Clustered.eql, .{ .stash_capacity = 64, .dense_values = true });
+    var map = Stashed.init(allocator);
+    defer map.deinit();
+
+    const n = DISPLACEMENT_MASK + 50;
+    for (0..n) |i| try map.put(@intCast(i), i);
+    var left: usize = n;
+    while (left > 0) {
+        left -= 1;
+        if (left % 2 == 0) try std.testing.expect(map.remove(@intCast(left)));
+    }
+    for (0..n) |k| {
+        const expected: ?u64 = if (k % 2 == 0) null else k;
+        try std.testing.expectEqual(expected, map.get(@intCast(k)));
+    }
 }
 
-test "getOrPut" {
+test "assume-capacity inserts" {
     const allocator = std.testing.allocator;
+    const n = 10_000;
+
     var map = HashMap(u32, u32).init(allocator);
     defer map.deinit();
+    try map.ensureTotalCapacity(n);
+    const buckets = map.bucketCount();
+
+    for (0..n) |i| map.putAssumeCapacity(@intCast(i), @intCast(i));
+    // Overwrite and getOrPut an existing key: no new entries
+    map.putAssumeCapacity(7, 70);
+    const gop = map.getOrPutAssumeCapacity(7);
+    try std.testing.expect(gop.found_existing);
+    try std.testing.expectEqual(@as(u32, 70), gop.value_ptr.*);
+    try std.testing.expectEqual(@as(usize, n), map.count());
+    try std.testing.expectEqual(buckets, map.bucketCount());
+    for (0..n) |i| {
+        const expected: u32 = if (i == 7) 70 else @intCast(i);
+        try std.testing.expectEqual(expected, map.get(@intCast(i)).?);
+    }
 
-    // First insert
-    const result1 = try map.getOrPut(1);
-    try std.testing.expect(!result1.found_existing);
-    result1.value_ptr.* = 10;
-
-    // Second access - should find existing
-    const result2 = try map.getOrPut(1);
-    try std.testing.expect(result2.found_existing);
-    try std.testing.expectEqual(@as(u32, 10), result2.value_ptr.*);
-
-    // Modify via pointer
-    result2.value_ptr.* = 20;
-    try std.testing.expectEqual(@as(u32, 20), map.get(1).?);
+    var set = HashMap(u64, void).init(allocator);
+    defer set.deinit();
+    try set.ensureUnusedCapacity(n);
+    for (0..n) |i| set.addAssumeCapacity(i * 31);
+    set.addAssumeCapacity(0);
+    try std.testing.expectEqual(@as(usize, n), set.count());
+
+    // Dense values need their value array reserved as well; incremental tables finish resizing first
+    const Dense = HashMapWithOptions(u32, u64, AutoHashFn(u32).hash, AutoEqlFn(u32).eql, .{ .dense_values = true });
+    var dense = Dense.init(allocator);
+    defer dense.deinit();
+    try dense.ensureTotalCapacity(n);
+    for (0..n) |i| dense.putAssumeCapacity(@intCast(i), i);
+    try std.testing.expectEqual(@as(u64, 1234), dense.get(1234).?);
+
+    const Incremental = HashMapWithOptions(u32, u32, AutoHashFn(u32).hash, AutoEqlFn(u32).eql, .{ .incremental_resize = true });
+    var inc = Incremental.init(allocator);
+    defer inc.deinit();
+    for (0..n) |i| try inc.put(@intCast(i), 0);
+    try inc.ensureUnusedCapacity(n);
+    try std.testing.expect(!inc.isResizing());
+    for (n..2 * n) |i| inc.getOrPutAssumeCapacity(@intCast(i)).value_ptr.* = 1;
+    try std.testing.expectEqual(@as(usize, 2 * n), inc.count());
+
+    // Keys sharing a home past the displacement limit still go in: the table grows rather than panics
+    const Spaced = struct {
+        fn hash(k: u32) u64 {
+            return @as(u64, k) << 3;
+        }
+        fn eql(a: u32, b: u32) bool {
+            return a == b;
+        }
+    };
+    const Narrow = HashMapWithOptions(u32, u32, Spaced.hash, Spaced.eql, .{ .meta_bits = 8, .hash_frag_bits = 4 });
+    var narrow = Narrow.init(allocator);
+    defer narrow.deinit();
+    try narrow.ensureTotalCapacity(10);
+    const reserved = narrow.bucketCount();
+    for (0..10) |i| narrow.putAssumeCapacity(@intCast(i * 8), @intCast(i));
+    try std.testing.expectEqual(@as(usize, 10), narrow.count());
+    try std.testing.expect(narrow.bucketCount() > reserved);
+    for (0..10) |i| try std.testing.expectEqual(@as(u32, @intCast(i)), narrow.get(@intCast(i * 8)).?);
 }
 
-test "getEntry" {
+test "parallel build from slices" {
     const allocator = std.testing.allocator;
-    var map = HashMap(u32, []const u8).init(allocator);
+    var pool: std.Thread.Pool = undefined;
+    try pool.init(.{ .allocator = allocator, .n_jobs = 4 });
+    defer pool.deinit();
+
+    const n = 200_000;
+    const keys = try allocator.alloc(u64, n);
+    defer allocator.free(keys);
+    const vals = try allocator.alloc(u32, n);
+    defer allocator.free(vals);
+    for (keys, vals, 0..) |*k, *v, i| {
+        // Every tenth key repeats an earlier one
+        k.* = if (i % 10 == 9) (i - 5) *% 0x9E3779B97F4A7C15 else i *% 0x9E3779B97F4A7C15;
+        v.* = @intCast(i);
+    }
+
+    var map = try HashMap(u64, u32).fromSlices(allocator, &pool, keys, vals);
     defer map.deinit();
+    try std.testing.expectEqual(@as(usize, n - n / 10), map.count());
+    for (keys, 0..) |k, i| {
+        const got = map.get(k).?;
+        // A repeated key holds one of its two values
+        try std.testing.expect(got == i or (i % 10 == 4 and got == i + 5) or (i % 10 == 9 and got == i - 5));
+    }
 
-    try map.put(42, "answer");
+    // 8-bit metadata: many small partitions, so most chains are near a partition boundary
+    const small = try allocator.alloc(u16, 60_000);
+    defer allocator.free(small);
+    for (small, 0..) |*k, i| k.* = @intCast(i);
 
-    const entry = map.getEntry(42).?;
-    try std.testing.expectEqual(@as(u32, 42), entry.key_ptr.*);
-    try std.testing.expectEqualStrings("answer", entry.value_ptr.*);
+    const SmallSet = HashMapWithOptions(u16, void, autoHash(u16), autoEql(u16), .{ .meta_bits = 8 });
+    var set = try SmallSet.fromSlices(allocator, &pool, small, &.{});
+    defer set.deinit();
+    try std.testing.expectEqual(small.len, set.count());
+    for (small) |k| try std.testing.expect(set.contains(k));
 
-    try std.testing.expect(map.getEntry(999) == null);
+    // Keys clustered on one home bucket overflow into the workers' stashes
+    const Clustered = struct {
+        fn hash(k: u32) u64 {
+            return if (k < DISPLACEMENT_MASK + 40) @as(u64, k) << 40 else hashInteger(k);
+        }
+        fn eql(a: u32, b: u32) bool {
+            return a == b;
+        }
+    };
+    const Stashed = HashMapWithOptions(u32, u32, Clustered.hash, Clustered.eql, .{ .stash_capacity = 64 });
+    const clustered = try allocator.alloc(u32, 50_000);
+    defer allocator.free(clustered);
+    for (clustered, 0..) |*k, i| k.* = @intCast(i);
+
+    var stashed = try Stashed.fromSlices(allocator, &pool, clustered, clustered);
+    defer stashed.deinit();
+    try std.testing.expectEqual(@as(usize, clustered.len), stashed.count());
+    for (clustered) |k| try std.testing.expectEqual(k, stashed.get(k).?);
 }
 
-test "key iterator" {
+test "parallel rehash" {
     const allocator = std.testing.allocator;
-    var set = HashMap(u32, void).init(allocator);
-    defer set.deinit();
+    var pool: std.Thread.Pool = undefined;
+    try pool.init(.{ .allocator = allocator, .n_jobs = 4 });
+    defer pool.deinit();
 
-    try set.add(10);
-    try set.add(20);
-    try set.add(30);
+    const Map = HashMapWithOptions(u64, u64, autoHash(u64), autoEql(u64), .{ .parallel_rehash = true });
+    var map = Map.init(allocator);
+    defer map.deinit();
+    map.setRehashPool(&pool);
+
+    // Growth past MIN_PARALLEL_REHASH_KEYS rehashes on the pool
+    const n: u64 = 300_000;
+    for (0..n) |i| try map.put(i *% 0x9E3779B97F4A7C15, i);
+    try map.reserve(4 * n);
+    try std.testing.expectEqual(@as(usize, n), map.count());
+    for (0..n) |i| try std.testing.expectEqual(@as(u64, i), map.get(i *% 0x9E3779B97F4A7C15).?);
+
+    // Shrink after removing most keys
+    for (0..n) |i| {
+        if (i % 4 != 0) _ = map.remove(i *% 0x9E3779B97F4A7C15);
+    }
+    try map.shrink();
+    try std.testing.expectEqual(@as(usize, n / 4), map.count());
+    for (0..n) |i| try std.testing.expectEqual(i % 4 == 0, map.contains(i *% 0x9E3779B97F4A7C15));
 
-    var sum: u32 = 0;
-    var iter = set.keyIterator();
-    while (iter.next()) |key| {
-        sum += key;
+    // Stashed keys, dense values and string keys move along too
+    const Clustered = struct {
+        fn hash(k: u32) u64 {
+            return if (k < DISPLACEMENT_MASK + 40) @as(u64, k) << 40 else hashInteger(k);
+        }
+        fn eql(a: u32, b: u32) bool {
+            return a == b;
+        }
+    };
+    const Stashed = HashMapWithOptions(u32, u32, Clustered.hash, Clustered.eql, .{ .stash_capacity = 64, .parallel_rehash = true });
+    var stashed = Stashed.init(allocator);
+    defer stashed.deinit();
+    stashed.setRehashPool(&pool);
+    for (0..100_000) |i| try stashed.put(@intCast(i), @intCast(i));
+    try stashed.reserve(400_000);
+    for (0..100_000) |i| try std.testing.expectEqual(@as(u32, @intCast(i)), stashed.get(@intCast(i)).?);
+
+    const Dense = HashMapWithOptions(u32, u64, autoHash(u32), autoEql(u32), .{ .dense_values = true, .parallel_rehash = true });
+    var dense = Dense.init(allocator);
+    defer dense.deinit();
+    dense.setRehashPool(&pool);
+    for (0..100_000) |i| try dense.put(@intCast(i), i * 3);
+    try dense.reserve(400_000);
+    for (0..100_000) |i| try std.testing.expectEqual(@as(u64, i * 3), dense.get(@intCast(i)).?);
+
+    const Strings = HashMapWithOptions([]const u8, u32, autoHash([]const u8), autoEql([]const u8), .{ .parallel_rehash = true });
+    var strings = Strings.init(allocator);
+    defer strings.deinit();
+    strings.setRehashPool(&pool);
+    var names: std.ArrayList([]u8) = .empty;
+    defer {
+        for (names.items) |name| allocator.free(name);
+        names.deinit(allocator);
     }
-    try std.testing.expectEqual(@as(u32, 60), sum);
+    for (0..80_000) |i| {
+        const name = try std.fmt.allocPrint(allocator, "key-{d}", .{i});
+        try names.append(allocator, name);
+        try strings.put(name, @intCast(i));
+    }
+    try strings.reserve(320_000);
+    for (names.items, 0..) |name, i| try std.testing.expectEqual(@as(u32, @intCast(i)), strings.get(name).?);
 }
 
-test "value iterator" {
+test "range iterators and parallel forEach/reduce" {
     const allocator = std.testing.allocator;
-    var map = HashMap(u32, u32).init(allocator);
-    defer map.deinit();
+    var pool: std.Thread.Pool = undefined;
+    try pool.init(.{ .allocator = allocator, .n_jobs = 4 });
+    defer pool.deinit();
 
-    try map.put(1, 100);
-    try map.put(2, 200);
-    try map.put(3, 300);
+    var map = HashMap(u64, u64).init(allocator);
+    defer map.deinit();
+    const n: u64 = 200_000;
+    var expected: u64 = 0;
+    for (0..n) |i| {
+        try map.put(i *% 0x9E3779B97F4A7C15, i);
+        expected += i;
+    }
 
-    var sum: u32 = 0;
-    var iter = map.valueIterator();
-    while (iter.next()) |val| {
-        sum += val;
+    // Ranges tiling the bucket array visit every entry once
+    var seen: usize = 0;
+    const third = map.bucketCount() / 3;
+    const bounds = [_]usize{ 0, third, 2 * third, map.bucketCount() };
+    for (bounds[0..3], bounds[1..]) |begin, end| {
+        var it = map.iteratorRange(begin, end);
+        while (it.nextEntry()) |entry| {
+            try std.testing.expectEqual(entry.key_ptr.*, entry.value_ptr.* *% 0x9E3779B97F4A7C15);
+            seen += 1;
+        }
     }
-    try std.testing.expectEqual(@as(u32, 600), sum);
+    try std.testing.expectEqual(@as(usize, n), seen);
+
+    const Sum = struct {
+        fn add(total: *std.atomic.Value(u64), _: *const u64, value: *const u64) void {
+            _ = total.fetchAdd(value.*, .monotonic);
+        }
+        fn accumulate(_: void, acc: u64, _: *const u64, value: *const u64) u64 {
+            return acc + value.*;
+        }
+        fn combine(_: void, a: u64, b: u64) u64 {
+            return a + b;
+        }
+    };
+    var total = std.atomic.Value(u64).init(0);
+    map.parallelForEach(&pool, &total, Sum.add);
+    try std.testing.expectEqual(expected, total.load(.monotonic));
+    try std.testing.expectEqual(expected, try map.parallelReduce(&pool, u64, 0, {}, Sum.accumulate, Sum.combine));
+
+    // The last range picks up stashed keys and an in-progress incremental resize
+    const Clustered = struct {
+        fn hash(k: u32) u64 {
+            return if (k < DISPLACEMENT_MASK + 40) @as(u64, k) << 40 else hashInteger(k);
+        }
+        fn eql(a: u32, b: u32) bool {
+            return a == b;
+        }
+        fn count(_: void, acc: usize, _: *const u32, _: *const void) usize {
+            return acc + 1;
+        }
+        fn combine(_: void, a: usize, b: usize) usize {
+            return a + b;
+        }
+    };
+    const Set = HashMapWithOptions(u32, void, Clustered.hash, Clustered.eql, .{ .stash_capacity = 64, .incremental_resize = true });
+    var set = Set.init(allocator);
+    defer set.deinit();
+    var added: u32 = 0;
+    while (added < 100_000 or !set.isResizing()) : (added += 1) try set.add(added);
+    try std.testing.expect(set.stash.len > 0);
+    try std.testing.expectEqual(@as(usize, added), try set.parallelReduce(&pool, usize, 0, {}, Clustered.count, Clustered.combine));
 }
 
-test "empty table operations" {
+test "batch iteration" {
     const allocator = std.testing.allocator;
-    var map = HashMap(u32, u32).init(allocator);
+
+    // Sparse after churn: most groups of metadata are empty
+    var map = HashMap(u64, u64).init(allocator);
     defer map.deinit();
+    for (0..50_000) |i| try map.put(i, i * 2);
+    for (0..50_000) |i| {
+        if (i % 16 != 0) _ = map.remove(i);
+    }
 
-    try std.testing.expectEqual(@as(usize, 0), map.count());
-    try std.testing.expectEqual(@as(usize, 0), map.bucketCount());
-    try std.testing.expect(map.get(1) == null);
-    try std.testing.expect(!map.remove(1));
+    inline for (.{ 1, 7, 64 }) |batch_len| {
+        var expected = map.iterator();
+        var it = map.iterator();
+        var buf: [batch_len]*const HashMap(u64, u64).Bucket = undefined;
+        var seen: usize = 0;
+        while (true) {
+            const batch = it.nextBatch(&buf);
+            for (batch) |bucket| {
+                try std.testing.expectEqual(expected.next().?, bucket);
+                try std.testing.expectEqual(bucket.key * 2, bucket.val);
+            }
+            seen += batch.len;
+            if (batch.len < buf.len) break;
+        }
+        try std.testing.expectEqual(map.count(), seen);
+        try std.testing.expect(expected.next() == null);
+        try std.testing.expectEqual(@as(usize, 0), it.nextBatch(&buf).len);
+    }
 
-    var iter = map.iterator();
-    try std.testing.expect(iter.next() == null);
+    // Entries from every segment: buckets, a draining allocation and the stash
+    const Clustered = struct {
+        fn hash(k: u32) u64 {
+            return if (k < DISPLACEMENT_MASK + 40) @as(u64, k) << 40 else hashInteger(k);
+        }
+        fn eql(a: u32, b: u32) bool {
+            return a == b;
+        }
+    };
+    const Map = HashMapWithOptions(u32, u32, Clustered.hash, Clustered.eql, .{ .stash_capacity = 64, .incremental_resize = true, .separate_values = true });
+    var clustered = Map.init(allocator);
+    defer clustered.deinit();
+    var added: u32 = 0;
+    while (added < 20_000 or !clustered.isResizing()) : (added += 1) try clustered.put(added, added + 1);
+    try std.testing.expect(clustered.stash.len > 0);
+
+    var it = clustered.iterator();
+    var buf: [13]Map.Entry = undefined;
+    var seen: usize = 0;
+    while (true) {
+        const batch = it.nextEntryBatch(&buf);
+        for (batch) |entry| try std.testing.expectEqual(entry.key_ptr.* + 1, entry.value_ptr.*);
+        seen += batch.len;
+        if (batch.len < buf.len) break;
+    }
+    try std.testing.expectEqual(@as(usize, added), seen);
 }
 
-test "set with many collisions" {
+test "retain and removeIf" {
     const allocator = std.testing.allocator;
-    var set = HashMap(u32, void).init(allocator);
-    defer set.deinit();
 
-    // Insert values that might have hash collisions
-    for (0..500) |i| {
-        try set.add(@intCast(i * 8)); // Multiples of 8
-    }
-    try std.testing.expectEqual(@as(usize, 500), set.count());
+    const Visit = struct {
+        visits: usize = 0,
 
-    // Verify all exist
-    for (0..500) |i| {
-        try std.testing.expect(set.contains(@intCast(i * 8)));
-    }
+        fn keepEven(self: *@This(), key: *const u32, value: *u32) bool {
+            self.visits += 1;
+            value.* += 1;
+            return key.* % 2 == 0;
+        }
+        fn every7th(_: void, key: *const u32, _: *u32) bool {
+            return key.* % 7 == 0;
+        }
+    };
 
-    // Remove half
-    for (0..250) |i| {
-        try std.testing.expect(set.remove(@intCast(i * 8)));
-    }
-    try std.testing.expectEqual(@as(usize, 250), set.count());
+    // Clustered keys give long chains, a stash, and in-place compaction across chain links
+    const Clustered = struct {
+        fn hash(k: u32) u64 {
+            return if (k < DISPLACEMENT_MASK + 40) @as(u64, k) << 40 else hashInteger(k);
+        }
+        fn eql(a: u32, b: u32) bool {
+            return a == b;
+        }
+    };
+    inline for (.{
+        Options{ .stash_capacity = 64 },
+        Options{ .stash_capacity = 64, .separate_values = true },
+        Options{ .stash_capacity = 64, .dense_values = true },
+        Options{ .stash_capacity = 64, .incremental_resize = true },
+    }) |opts| {
+        const Map = HashMapWithOptions(u32, u32, Clustered.hash, Clustered.eql, opts);
+        var map = Map.init(allocator);
+        defer map.deinit();
+        var n: u32 = 0;
+        while (n < 30_000 or (opts.incremental_resize and !map.isResizing())) : (n += 1) try map.put(n, n);
+        try std.testing.expect(map.stash.len > 0);
+
+        var visit = Visit{};
+        try std.testing.expectEqual(@as(usize, n / 2), map.retain(&visit, Visit.keepEven));
+        try std.testing.expectEqual(@as(usize, n), visit.visits);
+        try std.testing.expectEqual(@as(usize, n - n / 2), map.count());
+        for (0..n) |i| {
+            const k: u32 = @intCast(i);
+            if (k % 2 == 0) try std.testing.expectEqual(k + 1, map.get(k).?) else try std.testing.expect(!map.contains(k));
+        }
 
-    // Verify remaining
-    for (250..500) |i| {
-        try std.testing.expect(set.contains(@intCast(i * 8)));
+        const removed = map.removeIf({}, Visit.every7th);
+        try std.testing.expectEqual((n + 13) / 14, removed);
+        for (0..n) |i| {
+            const k: u32 = @intCast(i);
+            try std.testing.expectEqual(k % 2 == 0 and k % 7 != 0, map.contains(k));
+        }
+
+        // Chains stay intact for later inserts and removes
+        for (0..n) |i| try map.put(@intCast(i), 5);
+        try std.testing.expectEqual(@as(usize, n), map.count());
+        for (0..n) |i| try std.testing.expect(map.remove(@intCast(i)));
+        try std.testing.expectEqual(@as(usize, 0), map.count());
     }
 }
 
-test "max load factor adjustment" {
+test "clear with dirty page tracking" {
     const allocator = std.testing.allocator;
-    var map = HashMap(u32, u32).init(allocator);
+    inline for (.{
+        Options{ .track_dirty_pages = true },
+        Options{ .track_dirty_pages = true, .grow_in_place = true },
+    }) |opts| {
+        const Set = HashMapWithOptions(u64, void, autoHash(u64), autoEql(u64), opts);
+        var set = Set.init(allocator);
+        defer set.deinit();
+
+        for (0..100_000) |i| try set.add(i);
+        const bucket_count = set.bucketCount();
+        set.clear();
+        try std.testing.expectEqual(@as(usize, 0), set.count());
+        for (set.metadata[0..bucket_count]) |meta| try std.testing.expectEqual(Set.Meta.EMPTY, meta);
+
+        // A few keys dirty a few pages; clearing only resets those
+        for (0..10) |round| {
+            for (0..50) |i| try set.add(round * 1000 + i);
+            var dirty: usize = 0;
+            for (set.dirtyPages()[0..Set.dirtyPageCount(bucket_count)]) |flag| dirty += flag;
+            try std.testing.expect(dirty <= 100);
+            set.clear();
+            for (set.metadata[0..bucket_count]) |meta| try std.testing.expectEqual(Set.Meta.EMPTY, meta);
+            try std.testing.expect(!set.contains(round * 1000));
+        }
+        try std.testing.expectEqual(bucket_count, set.bucketCount());
+    }
+}
+
+test "small inline map" {
+    // Nothing is allocated while the entries fit inline
+    var map = SmallHashMap(u32, u32, 8).init(std.testing.failing_allocator);
     defer map.deinit();
+    for (0..8) |i| try map.put(@intCast(i), @intCast(i * 10));
+    try map.put(3, 33);
+    try std.testing.expectEqual(@as(usize, 8), map.count());
+    try std.testing.expect(!map.isSpilled());
+    try std.testing.expectEqual(@as(?u32, 33), map.get(3));
+    try std.testing.expectEqual(@as(?u32, null), map.get(8));
+    try std.testing.expect(map.remove(0));
+    try std.testing.expect(!map.remove(0));
+    (try map.getOrPut(0)).value_ptr.* = 1;
+    try std.testing.expectError(error.OutOfMemory, map.put(100, 0));
 
-    // Set low load factor
-    map.setMaxLoadFactor(0.5);
+    var sum: u32 = 0;
+    var it = map.iterator();
+    while (it.next()) |entry| sum += entry.value_ptr.*;
+    try std.testing.expectEqual(@as(u32, 1 + 10 + 20 + 33 + 40 + 50 + 60 + 70), sum);
 
-    for (0..100) |i| {
-        try map.put(@intCast(i), @intCast(i));
-    }
+    // Spilling moves every entry to the heap table
+    var set = SmallHashMap([]const u8, void, 4).init(std.testing.allocator);
+    defer set.deinit();
+    const words = [_][]const u8{ "alpha", "beta", "gamma", "delta", "epsilon", "zeta" };
+    for (words[0..4]) |w| try set.add(w);
+    try std.testing.expect(!set.isSpilled());
+    for (words[4..]) |w| try set.add(w);
+    try std.testing.expect(set.isSpilled());
+    try std.testing.expectEqual(words.len, set.count());
+    for (words) |w| try std.testing.expect(set.contains(w));
+
+    var seen: usize = 0;
+    var set_it = set.iterator();
+    while (set_it.next()) |_| seen += 1;
+    try std.testing.expectEqual(words.len, seen);
+
+    set.clear();
+    try std.testing.expectEqual(@as(usize, 0), set.count());
+    try set.add("alpha");
+    try std.testing.expect(set.contains("alpha") and !set.contains("beta"));
+}
 
-    // With 0.5 load factor, bucket count should be >= 200
-    try std.testing.expect(map.bucketCount() >= 200);
+test "table pool reuses storage" {
+    var pool = TablePool.init(std.testing.allocator, 4);
+    defer pool.deinit();
+
+    var map = HashMap(u64, u64).init(pool.allocator());
+    for (0..1000) |i| try map.put(i, i);
+    const storage = @intFromPtr(map.buckets);
+    map.deinit();
+    try std.testing.expect(pool.cachedBlocks() > 0);
+
+    // The same growth sequence pops the same blocks
+    const cached = pool.cachedBlocks();
+    map = HashMap(u64, u64).init(pool.allocator());
+    for (0..1000) |i| try map.put(i, i + 1);
+    try std.testing.expectEqual(storage, @intFromPtr(map.buckets));
+    for (0..1000) |i| try std.testing.expectEqual(@as(u64, i + 1), map.get(i).?);
+    map.deinit();
+    try std.testing.expectEqual(cached, pool.cachedBlocks());
+
+    // Blocks beyond the per-class cap go back to the backing allocator
+    var maps: [6]HashMap(u64, u64) = undefined;
+    for (&maps) |*m| {
+        m.* = HashMap(u64, u64).init(pool.allocator());
+        try m.put(1, 1);
+    }
+    for (&maps) |*m| m.deinit();
+    pool.trim();
+    try std.testing.expectEqual(@as(usize, 0), pool.cachedBlocks());
 }
 
-test "getPtr modification" {
+test "huge page storage" {
     const allocator = std.testing.allocator;
-    var map = HashMap(u32, u32).init(allocator);
+    const Map = HashMapWithOptions(u64, u64, autoHash(u64), autoEql(u64), .{ .huge_pages = true, .track_dirty_pages = true });
+    var map = Map.init(allocator);
     defer map.deinit();
 
-    try map.put(1, 10);
+    // Small tables come from the allocator; past HUGE_PAGE_SIZE they are mapped
+    const n: u64 = 400_000;
+    for (0..n) |i| try map.put(i *% 0x9E3779B97F4A7C15, i);
+    try std.testing.expect(map.totalAllocSize() >= HUGE_PAGE_SIZE);
+    map.prefault();
+    for (0..n) |i| try std.testing.expectEqual(@as(u64, i), map.get(i *% 0x9E3779B97F4A7C15).?);
 
-    const ptr = map.getPtr(1).?;
-    ptr.* = 999;
+    var copy = try map.clone();
+    defer copy.deinit();
+    try std.testing.expectEqual(@as(usize, n), copy.count());
 
-    try std.testing.expectEqual(@as(u32, 999), map.get(1).?);
+    map.clear();
+    try std.testing.expectEqual(@as(usize, 0), map.count());
+    try map.put(7, 7);
+    try std.testing.expectEqual(@as(u64, 7), map.get(7).?);
+    try map.reserve(4 * n);
+    try std.testing.expectEqual(@as(u64, 7), map.get(7).?);
+    try std.testing.expect(copy.contains(0x9E3779B97F4A7C15));
 }
 
-test "custom hash function" {
-    const MyHashFn = struct {
-        fn hash(key: u32) u64 {
-            return key; // Identity hash for testing
-        }
-    };
-    const MyEqlFn = struct {
-        fn eql(a: u32, b: u32) bool {
-            return a == b;
-        }
-    };
-
+test "mapped persistent format" {
+    // `Mapped.open` maps the file with mmap
+    if (builtin.os.tag == .windows) return error.SkipZigTest;
     const allocator = std.testing.allocator;
-    var map = HashMapWithFns(u32, u32, MyHashFn.hash, MyEqlFn.eql).init(allocator);
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    // Integer keys with separate values, written to a file and mapped
+    const Map = HashMapWithOptions(u64, u64, autoHash(u64), autoEql(u64), .{ .separate_values = true });
+    var map = Map.init(allocator);
     defer map.deinit();
+    for (0..10_000) |i| try map.put(i * 7, i);
+    try map.writeMappedFile(tmp.dir, "ints.vzt");
+
+    var mapped = try Map.Mapped.open(tmp.dir, "ints.vzt");
+    defer mapped.close();
+    try std.testing.expectEqual(map.count(), mapped.count());
+    try std.testing.expectEqual(map.bucketCount(), mapped.bucketCount());
+    for (0..10_000) |i| {
+        try std.testing.expectEqual(@as(u64, i), mapped.get(i * 7).?);
+        try std.testing.expect(!mapped.contains(i * 7 + 1));
+    }
 
-    try map.put(1, 10);
-    try map.put(2, 20);
+    // Empty buckets and their values are written as zeroes, not as whatever the allocation held
+    var ints_out: std.Io.Writer.Allocating = .init(allocator);
+    defer ints_out.deinit();
+    try map.writeMapped(&ints_out.writer);
+    const storage_bytes = ints_out.written()[std.mem.alignForward(usize, @sizeOf(MappedHeader), MAPPED_ALIGNMENT)..];
+    const values_offset = std.mem.alignForward(usize, map.bucketCount() * @sizeOf(Map.MappedBucket), @alignOf(u64));
+    for (0..map.bucketCount()) |i| {
+        if (map.metadata[i] != 0) continue;
+        try std.testing.expect(std.mem.allEqual(u8, storage_bytes[i * @sizeOf(Map.MappedBucket)..][0..@sizeOf(Map.MappedBucket)], 0));
+        try std.testing.expect(std.mem.allEqual(u8, storage_bytes[values_offset + i * 8 ..][0..8], 0));
+    }
 
-    try std.testing.expectEqual(@as(u32, 10), map.get(1).?);
-    try std.testing.expectEqual(@as(u32, 20), map.get(2).?);
+    // String keys, written to memory; keys come back as slices of the buffer
+    const Names = HashMap([]const u8, u32);
+    const n = 2000;
+    const storage = try allocator.alloc([16]u8, n);
+    defer allocator.free(storage);
+    var names = Names.init(allocator);
+    defer names.deinit();
+    for (storage, 0..) |*buf, i| try names.put(try std.fmt.bufPrint(buf, "name-{d}", .{i}), @intCast(i));
+
+    var out: std.Io.Writer.Allocating = .init(allocator);
+    defer out.deinit();
+    try names.writeMapped(&out.writer);
+    const bytes = try allocator.alignedAlloc(u8, .@"64", out.written().len);
+    defer allocator.free(bytes);
+    @memcpy(bytes, out.written());
+
+    const view = try Names.Mapped.fromBytes(bytes);
+    try std.testing.expectEqual(@as(usize, n), view.count());
+    var key_buf: [16]u8 = undefined;
+    for (0..n) |i| {
+        try std.testing.expectEqual(@as(u32, @intCast(i)), view.get(try std.fmt.bufPrint(&key_buf, "name-{d}", .{i})).?);
+    }
+    try std.testing.expect(!view.contains("name-x"));
+    var visited: usize = 0;
+    var it = view.iterator();
+    while (it.next()) |entry| {
+        try std.testing.expectEqual(names.get(entry.key).?, entry.value_ptr.*);
+        try std.testing.expect(@intFromPtr(entry.key.ptr) >= @intFromPtr(bytes.ptr));
+        visited += 1;
+    }
+    try std.testing.expectEqual(@as(usize, n), visited);
+
+    // Empty tables round-trip; other table types and damaged headers are rejected
+    var empty = Names.init(allocator);
+    defer empty.deinit();
+    var empty_out: std.Io.Writer.Allocating = .init(allocator);
+    defer empty_out.deinit();
+    try empty.writeMapped(&empty_out.writer);
+    @memcpy(bytes[0..empty_out.written().len], empty_out.written());
+    const empty_view = try Names.Mapped.fromBytes(bytes[0..empty_out.written().len]);
+    try std.testing.expectEqual(@as(usize, 0), empty_view.count());
+    try std.testing.expect(!empty_view.contains("name-1"));
+
+    try std.testing.expectError(error.LayoutMismatch, HashMap(u32, u32).Mapped.fromBytes(bytes));
+    try std.testing.expectError(error.Misaligned, Names.Mapped.fromBytes(bytes[8..]));
+    bytes[0] = 'X';
+    try std.testing.expectError(error.InvalidFormat, Names.Mapped.fromBytes(bytes));
 }
 
-test "stress test - many operations" {
+test "snapshot writeTo and readFrom" {
     const allocator = std.testing.allocator;
-    var map = HashMap(u32, u32).init(allocator);
+
+    // Integer keys: the storage block is read back as is
+    const Map = HashMapWithOptions(u64, u64, autoHash(u64), autoEql(u64), .{ .track_dirty_pages = true });
+    var map = Map.init(allocator);
     defer map.deinit();
+    for (0..5000) |i| try map.put(i *% 0x9E3779B97F4A7C15, i);
+
+    var out: std.Io.Writer.Allocating = .init(allocator);
+    defer out.deinit();
+    try map.writeTo(&out.writer);
+    var reader: std.Io.Reader = .fixed(out.written());
+    var loaded = try Map.readFrom(allocator, &reader);
+    defer loaded.deinit();
+    try std.testing.expectEqual(map.count(), loaded.map.count());
+    for (0..5000) |i| try std.testing.expectEqual(@as(u64, i), loaded.map.get(i *% 0x9E3779B97F4A7C15).?);
+
+    // The result is a regular table
+    try loaded.map.put(1, 1);
+    try std.testing.expect(loaded.map.remove(0x9E3779B97F4A7C15));
+    loaded.map.clear();
+    try std.testing.expectEqual(@as(usize, 0), loaded.map.count());
+    try std.testing.expect(!loaded.map.contains(1));
+
+    // String keys with separate values: keys are repointed at the owned key bytes
+    const Names = HashMapWithOptions([]const u8, u32, autoHash([]const u8), autoEql([]const u8), .{ .separate_values = true });
+    const n = 3000;
+    const storage = try allocator.alloc([16]u8, n);
+    defer allocator.free(storage);
+    var names = Names.init(allocator);
+    defer names.deinit();
+    for (storage, 0..) |*buf, i| try names.put(try std.fmt.bufPrint(buf, "name-{d}", .{i}), @intCast(i));
+
+    var names_out: std.Io.Writer.Allocating = .init(allocator);
+    defer names_out.deinit();
+    try names.writeTo(&names_out.writer);
+    var names_reader: std.Io.Reader = .fixed(names_out.written());
+    var loaded_names = try Names.readFrom(allocator, &names_reader);
+    defer loaded_names.deinit();
+    @memset(storage, [_]u8{0} ** 16);
+
+    try std.testing.expectEqual(@as(usize, n), loaded_names.map.count());
+    var key_buf: [16]u8 = undefined;
+    for (0..n) |i| {
+        try std.testing.expectEqual(@as(u32, @intCast(i)), loaded_names.map.get(try std.fmt.bufPrint(&key_buf, "name-{d}", .{i})).?);
+    }
+    var it = loaded_names.map.keyIterator();
+    while (it.next()) |key| {
+        try std.testing.expect(@intFromPtr(key.ptr) >= @intFromPtr(loaded_names.key_bytes.ptr));
+    }
 
-    // Insert 10000 items
-    for (0..10000) |i| {
-        try map.put(@intCast(i), @intCast(i * 3));
+    // Truncated streams and other table types fail cleanly
+    var short: std.Io.Reader = .fixed(names_out.written()[0 .. names_out.written().len - 1]);
+    try std.testing.expectError(error.EndOfStream, Names.readFrom(allocator, &short));
+    const bad_load = try allocator.dupe(u8, names_out.written());
+    defer allocator.free(bad_load);
+    for ([_]f32{ 0, -0.5, 1.5, std.math.nan(f32) }) |max_load| {
+        std.mem.bytesAsValue(MappedHeader, bad_load[0..@sizeOf(MappedHeader)]).max_load = max_load;
+        var bad_reader: std.Io.Reader = .fixed(bad_load);
+        try std.testing.expectError(error.InvalidFormat, Names.readFrom(allocator, &bad_reader));
     }
-    try std.testing.expectEqual(@as(usize, 10000), map.count());
+    var other: std.Io.Reader = .fixed(names_out.written());
+    try std.testing.expectError(error.LayoutMismatch, Map.readFrom(allocator, &other));
+}
 
-    // Remove every other
-    for (0..10000) |i| {
-        if (i % 2 == 0) {
-            _ = map.remove(@intCast(i));
+test "change journal and replay" {
+    const allocator = std.testing.allocator;
+    const Map = HashMapWithOptions(u64, u64, autoHash(u64), autoEql(u64), .{ .journal = true });
+    const Keep = struct {
+        fn notMultipleOf3(_: void, key: *const u64, _: *u64) bool {
+            return key.* % 3 != 0;
         }
+    };
+
+    var journal = Journal.init(allocator);
+    defer journal.deinit();
+    var primary = Map.init(allocator);
+    defer primary.deinit();
+    primary.setJournal(&journal);
+
+    // A batch of changes, shipped after a sync
+    try primary.put(999, 1);
+    primary.clear();
+    for (0..3000) |i| try primary.put(i, i);
+    for (0..1000) |i| _ = primary.remove(i * 2);
+    for (3000..3500) |i| {
+        const gop = try primary.getOrPut(i);
+        gop.value_ptr.* = i * 10;
     }
-    try std.testing.expectEqual(@as(usize, 5000), map.count());
+    try std.testing.expect(try primary.putNoClobber(5000, 5));
+    _ = primary.retain({}, Keep.notMultipleOf3);
+    primary.syncJournal();
+
+    var replica = Map.init(allocator);
+    defer replica.deinit();
+    try std.testing.expectEqual(journal.entries, try replica.replay(journal.bytes.items));
+    try std.testing.expectEqual(primary.count(), replica.count());
+    var it = primary.iterator();
+    while (it.next()) |bucket| try std.testing.expectEqual(bucket.val, replica.get(bucket.key).?);
+
+    // Later changes replay on top of the replica's state
+    journal.reset();
+    try primary.put(1, 100);
+    _ = primary.remove(3001);
+    primary.syncJournal();
+    try std.testing.expectEqual(@as(usize, 2), try replica.replay(journal.bytes.items));
+    try std.testing.expectEqual(@as(u64, 100), replica.get(1).?);
+    try std.testing.expect(!replica.contains(3001));
+    try std.testing.expectEqual(primary.count(), replica.count());
+
+    // Clones are not journaled; truncated records are rejected
+    var copy = try primary.clone();
+    defer copy.deinit();
+    try copy.put(77, 77);
+    try std.testing.expectEqual(@as(usize, 2), journal.entries);
+    try std.testing.expectError(error.InvalidJournal, replica.replay(journal.bytes.items[0 .. journal.bytes.items.len - 1]));
+
+    // String sets: the ULEB128 length prefix
+    const Names = HashMapWithOptions([]const u8, void, autoHash([]const u8), autoEql([]const u8), .{ .journal = true });
+    var names_journal = Journal.init(allocator);
+    defer names_journal.deinit();
+    var names = Names.init(allocator);
+    defer names.deinit();
+    names.setJournal(&names_journal);
+    const long = "x" ** 300;
+    try names.add("a");
+    try names.add(long);
+    _ = names.remove("a");
+    var names_replica = Names.init(allocator);
+    defer names_replica.deinit();
+    try std.testing.expectEqual(@as(usize, 3), try names_replica.replay(names_journal.bytes.items));
+    try std.testing.expect(names_replica.contains(long));
+    try std.testing.expect(!names_replica.contains("a"));
+}
 
-    // Re-insert removed ones
-    for (0..10000) |i| {
-        if (i % 2 == 0) {
-            try map.put(@intCast(i), @intCast(i * 5));
+test "shared table across mappings" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+    const Map = HashMap(u64, [2]u64);
+    const fd = try posix.memfd_create("verztable-test", 0);
+    defer posix.close(fd);
+
+    var writer = try Map.Shared.create(fd, 10_000);
+    defer writer.close();
+    for (0..10_000) |i| try writer.put(i, .{ i, i });
+    const Fill = struct {
+        fn untilFull(w: *Map.Shared.Writer) !void {
+            var key: u64 = 1 << 32;
+            while (true) : (key += 1) try w.put(key, .{ key, key });
+        }
+    };
+    try std.testing.expectError(error.OutOfCapacity, Fill.untilFull(&writer));
+
+    var reader = try Map.Shared.open(fd);
+    defer reader.close();
+    try std.testing.expectEqual(writer.count(), reader.count());
+    for (0..10_000) |i| try std.testing.expectEqual([2]u64{ i, i }, reader.get(i).?);
+    try std.testing.expect(writer.remove(5));
+    try std.testing.expect(!reader.contains(5));
+    try std.testing.expectEqual(writer.count(), reader.count());
+
+    // A reader never sees a half-written value while the writer keeps rewriting them
+    const Rewrite = struct {
+        fn run(w: *Map.Shared.Writer, done: *std.atomic.Value(bool)) void {
+            var round: u64 = 0;
+            while (!done.load(.acquire)) : (round += 1) {
+                for (100..164) |i| w.put(i, .{ round, round }) catch unreachable;
+            }
         }
+    };
+    var done = std.atomic.Value(bool).init(false);
+    const thread = try std.Thread.spawn(.{}, Rewrite.run, .{ &writer, &done });
+    for (0..100_000) |n| {
+        const value = reader.get(100 + n % 64).?;
+        try std.testing.expectEqual(value[0], value[1]);
     }
-    try std.testing.expectEqual(@as(usize, 10000), map.count());
+    done.store(true, .release);
+    thread.join();
 
-    // Verify
-    for (0..10000) |i| {
-        const expected: u32 = if (i % 2 == 0) @intCast(i * 5) else @intCast(i * 3);
-        try std.testing.expectEqual(expected, map.get(@intCast(i)).?);
-    }
+    writer.clear();
+    try std.testing.expectEqual(@as(usize, 0), reader.count());
+    try std.testing.expect(!reader.contains(1));
 }
 
-test "iterator reset" {
-    const allocator = std.testing.allocator;
-    var map = HashMap(u32, u32).init(allocator);
+test "sharded table from many threads" {
+    if (builtin.single_threaded) return error.SkipZigTest;
+    const Map = ShardedHashMap(u64, u64, 16);
+    var map = Map.init(std.testing.allocator);
     defer map.deinit();
+    try map.ensureTotalCapacity(4 * 20_000);
+
+    // Each thread writes its own keys, reads and removes, and bumps a shared counter
+    const Worker = struct {
+        fn run(m: *Map, t: usize) void {
+            const base = t * 20_000;
+            for (base..base + 20_000) |i| m.put(i, i * 2) catch unreachable;
+            for (base..base + 20_000) |i| std.debug.assert(m.get(i).? == i * 2);
+            for (base..base + 20_000) |i| {
+                if (i % 4 == 0) std.debug.assert(m.remove(i));
+            }
+            for (0..1_000) |_| {
+                const shard = m.lockShard(1 << 40);
+                defer shard.unlock();
+                const result = shard.map.getOrPutWithHash(1 << 40, shard.hash) catch unreachable;
+                if (!result.found_existing) result.value_ptr.* = 0;
+                result.value_ptr.* += 1;
+            }
+        }
+    };
+    var threads: [4]std.Thread = undefined;
+    for (&threads, 0..) |*thread, t| thread.* = try std.Thread.spawn(.{}, Worker.run, .{ &map, t });
+    for (threads) |thread| thread.join();
+
+    try std.testing.expectEqual(@as(usize, 4 * 15_000 + 1), map.count());
+    try std.testing.expectEqual(@as(?u64, 4_000), map.get(1 << 40));
+    for (0..4 * 20_000) |i| {
+        try std.testing.expectEqual(i % 4 != 0, map.contains(i));
+    }
+    try std.testing.expectEqual(@as(u64, 14), try map.getOrPutValue(7, 99));
+    try std.testing.expectEqual(@as(u64, 99), try map.getOrPutValue(8, 99));
 
-    try map.put(1, 10);
-    try map.put(2, 20);
-
-    var iter = map.iterator();
-
-    // First pass
-    var count1: u32 = 0;
-    while (iter.next()) |_| count1 += 1;
-    try std.testing.expectEqual(@as(u32, 2), count1);
+    // Keys spread over every shard
+    for (&map.shards) |*shard| try std.testing.expect(shard.map.count() > 0);
 
-    // After reset
-    iter.reset();
-    var count2: u32 = 0;
-    while (iter.next()) |_| count2 += 1;
-    try std.testing.expectEqual(@as(u32, 2), count2);
+    map.clear();
+    try std.testing.expectEqual(@as(usize, 0), map.count());
 }